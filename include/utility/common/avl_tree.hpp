@@ -9,6 +9,20 @@
 #ifndef _btr_AvlTree_hpp_
 #define _btr_AvlTree_hpp_
 
+// SYSTEM INCLUDES
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+#if BTR_X86 > 0
+#include <iterator>
+#include <system_error>
+#include <thread>
+#endif
+
+// PROJECT INCLUDES
+#include "utility/common/node_allocator.hpp"
+#include "utility/common/sorters.hpp"
+
 namespace btr
 {
 
@@ -57,6 +71,12 @@ class NodeBase
 {
 public:
 
+  /**
+   * True if the node keeps data derived from its subtree in augment(). The tree then refreshes
+   * all ancestors of a changed node instead of stopping where heights settle.
+   */
+  static const bool AUGMENTED = false;
+
 // LIFECYCLE
 
   /**
@@ -82,6 +102,13 @@ public:
   N* right();
   void right(N* node);
 
+  /**
+   * Recompute data derived from the subtree. Called by the tree whenever the children of the
+   * node change, children first. Augmented nodes hide it and set AUGMENTED,
+   * @see AggregateNodeBase.
+   */
+  void augment();
+
 private:
 
 // ATTRIBUTES
@@ -94,16 +121,113 @@ private:
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+template <typename N, typename K, typename H, typename A>
+class AvlTree;
+
+template <typename N, typename K, typename H, typename A>
+class WavlTree;
+
+/**
+ * The class implements a bidirectional, in-order iterator over AvlTree and WavlTree nodes.
+ *
+ * Nodes don't link to their parents, so the iterator holds the path from the root to the current
+ * node. Copying an iterator copies that path; prefer pre-increment.
+ *
+ * IMPORTANT: Inserting or erasing keys invalidates all iterators.
+ */
+template <typename N>
+class AvlTreeIterator
+{
+public:
+
+#if BTR_X86 > 0
+  typedef std::bidirectional_iterator_tag iterator_category;
+  typedef N value_type;
+  typedef ptrdiff_t difference_type;
+  typedef N* pointer;
+  typedef N& reference;
+#endif
+
+  /** Path capacity, @see AvlTree::MAX_HEIGHT */
+  static const uint8_t MAX_DEPTH = (sizeof(void*) * 8 * 3) / 2;
+
+// LIFECYCLE
+
+  /**
+   * Create an end iterator of a tree.
+   *
+   * @param root - tree root, used to step back from the end
+   */
+  explicit AvlTreeIterator(N* root = nullptr);
+
+// OPERATIONS
+
+  N& operator*() const;
+  N* operator->() const;
+
+  /**
+   * @return the current node or nullptr at the end
+   */
+  N* node() const;
+
+  AvlTreeIterator& operator++();
+  AvlTreeIterator operator++(int);
+  AvlTreeIterator& operator--();
+  AvlTreeIterator operator--(int);
+
+  bool operator==(const AvlTreeIterator& other) const;
+  bool operator!=(const AvlTreeIterator& other) const;
+
+private:
+
+  template <typename, typename, typename, typename>
+  friend class AvlTree;
+  template <typename, typename, typename, typename>
+  friend class WavlTree;
+
+// OPERATIONS
+
+  /**
+   * Extend the path with node and its leftmost descendants.
+   */
+  void pushLeft(N* node);
+
+  /**
+   * Extend the path with node and its rightmost descendants.
+   */
+  void pushRight(N* node);
+
+// ATTRIBUTES
+
+  N* root_;
+  N* path_[MAX_DEPTH];
+  uint8_t depth_;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
 /**
  * The class represents an AVL self-balancing binary search tree.
  *
+ * Nodes are created and destroyed through allocator A, @see node_allocator.hpp.
+ *
  * WARNING: make sure H is SIGNED integer
  */
-template <typename N, typename K = uint16_t, typename H = int16_t>
+template <typename N, typename K = uint16_t, typename H = int16_t,
+          typename A = HeapNodeAllocator<N>>
 class AvlTree
 {
 public:
 
+  /**
+   * Upper bound of the tree height. An AVL tree of n nodes is at most 1.44 * log2(n + 2) high,
+   * and n is bounded by the address space. Insert, erase and traverse keep a path of at most this
+   * many nodes on the stack instead of recursing.
+   */
+  static const uint8_t MAX_HEIGHT = AvlTreeIterator<N>::MAX_DEPTH;
+
+  typedef AvlTreeIterator<N> Iterator;
+
 // LIFECYCLE
 
   /**
@@ -120,13 +244,129 @@ public:
 
   N* root();
   void root(N* root);
+
+  /**
+   * @return the node allocator
+   */
+  A& allocator();
+
   N* rotateRight(N* node);
   N* rotateLeft(N* node);
   N* insert(K key);
+
+  /**
+   * Insert a key greater than any key in the tree, e.g. an increasing timestamp. The tree keeps
+   * its right spine between calls, so the new node is linked below the maximum without a search
+   * from the root and the rebalancing walk stops as soon as a subtree keeps its height, which
+   * makes sequential appends amortized O(1) for nodes that aren't augmented. Any other
+   * modification discards the spine, and the next append rebuilds it in O(log n). A key not
+   * greater than the maximum is passed to insert.
+   *
+   * @param key - the key to insert
+   * @return the tree root, like insert()
+   */
+  N* append(K key);
+
   N* search(K key);
   N* erase(K key);
   void eraseBranch(N* node);
 
+  /**
+   * Replace the tree with a perfectly balanced tree of the given keys in O(n). Duplicate keys
+   * are inserted once.
+   *
+   * @param begin - the first key, keys must be sorted in ascending order
+   * @param end - past the last key
+   * @return 0 on success, otherwise -1 and errno is set to ENOMEM if the allocator was exhausted.
+   *  The tree then holds the keys allocated so far
+   */
+  template<typename I>
+  int buildFromSorted(I begin, I end);
+
+  /**
+   * Insert a batch of keys. Large batches are sorted and merged with the existing nodes, which
+   * are relinked into a perfectly balanced tree in O(n + m). Small batches are inserted one by
+   * one. Existing nodes and their data are kept either way.
+   *
+   * @param keys - the keys to insert, reordered by the call
+   * @param count - the number of keys
+   * @return 0 on success, otherwise -1 and errno is set to ENOMEM if the allocator was exhausted.
+   *  The tree then holds the keys allocated so far
+   */
+  int insertBatch(K* keys, uint32_t count);
+
+  /**
+   * Move keys not less than key to another tree in O(log n).
+   *
+   * @param key - the split key
+   * @param right - receives the keys, its previous keys are erased
+   */
+  void split(K key, AvlTree* right);
+
+  /**
+   * Move all keys of another tree into this one in O(log n). Every key of the other tree must be
+   * greater than every key of this one.
+   *
+   * @param right - the tree to take keys from, empty on success
+   * @return 0 on success, otherwise -1 and errno is set to EINVAL if the keys overlap
+   */
+  int join(AvlTree* right);
+
+  /**
+   * Move keys of another tree that this one lacks into this one. Nodes of this tree are kept
+   * for keys present in both. Runs in O(m log(n / m + 1)), m <= n being the tree sizes.
+   *
+   * @param other - the tree to take keys from, empty on return
+   */
+  void setUnion(AvlTree* other);
+
+  /**
+   * Erase keys that another tree lacks. Runs in O(m log(n / m + 1)).
+   *
+   * @param other - the tree to intersect with, empty on return
+   */
+  void setIntersection(AvlTree* other);
+
+  /**
+   * Erase keys that another tree has. Runs in O(m log(n / m + 1)).
+   *
+   * @param other - the tree to subtract, empty on return
+   */
+  void setDifference(AvlTree* other);
+
+  /**
+   * Erase keys in [key_min, key_max] in O(log n + k), k being the number of erased keys.
+   */
+  void eraseRange(K key_min, K key_max);
+
+  /**
+   * Recompute augmented data on the path to a node after its value changed in place.
+   *
+   * @return the node or nullptr if the key is absent
+   */
+  N* refresh(K key);
+
+  /**
+   * @return the number of keys less than key. Requires size(), @see AggregateNodeBase
+   */
+  uint32_t rank(K key);
+
+  /**
+   * @return the node with the index-th smallest key, counting from 0, or nullptr.
+   *  Requires size(), @see AggregateNodeBase
+   */
+  N* select(uint32_t index);
+
+  /**
+   * Aggregate values of nodes with keys in [key_min, key_max] in O(log n).
+   * Requires AggregateNodeBase.
+   *
+   * @param result - set to the aggregate if the range holds keys, left unchanged otherwise
+   * @return the number of keys in the range
+   */
+  template<typename V>
+  uint32_t aggregate(K key_min, K key_max, V* result);
+
   static H balance(N* node);
   static H height(N* node);
   static H max(H v1, H v2);
@@ -135,28 +375,195 @@ public:
   static N* searchMin(N* node);
   static N* search(N* root, K key);
 
+  /**
+   * Visit nodes of a subtree in key order. Unlike traverse(), the visitor is called directly and
+   * can be inlined.
+   *
+   * @param node - subtree root
+   * @param visitor - callable taking N* and returning -1 to stop, 0 to continue
+   * @return -1 if the visitor stopped the traversal, 0 otherwise
+   */
+  template<typename F>
+  static int visit(N* node, F&& visitor);
+
+  /**
+   * Visit nodes with keys in [key_min, key_max] in key order.
+   *
+   * @see visit(N*, F&&)
+   */
+  template<typename F>
+  static int visit(N* node, F&& visitor, K key_min, K key_max);
+
+  /**
+   * @return an iterator at the smallest key
+   */
+  Iterator begin();
+
+  /**
+   * @return an iterator past the largest key
+   */
+  Iterator end();
+
+  /**
+   * @return an iterator at the first key not less than key, or end()
+   */
+  Iterator lowerBound(K key);
+
+  /**
+   * @return an iterator at the first key greater than key, or end()
+   */
+  Iterator upperBound(K key);
+
+  /**
+   * Provide the range of nodes matching key. The range is empty or holds one node since keys are
+   * unique.
+   *
+   * @param key - the key to look up
+   * @param first - set to lowerBound(key)
+   * @param last - set to upperBound(key)
+   */
+  void equalRange(K key, Iterator* first, Iterator* last);
+
 private:
 
 // OPERATIONS
 
   /**
-   * Insert a new node at the node position.
+   * Recompute node's height and augmented data from its children.
+   */
+  static void update(N* node);
+
+  /**
+   * Rotate a subtree right without changing the tree root.
+   *
+   * @return new subtree root
+   */
+  static N* rotateRightSubtree(N* node);
+
+  /**
+   * Rotate a subtree left without changing the tree root.
+   *
+   * @return new subtree root
+   */
+  static N* rotateLeftSubtree(N* node);
+
+  /**
+   * Insert a key, see insert().
+   *
+   * @return 0 if the key was inserted or is already in the tree, otherwise -1 and errno is set
+   *  to ENOMEM if the allocator was exhausted
+   */
+  int insertKey(K key);
+
+  /**
+   * Update node's height and restore balance after key was inserted below it.
+   *
+   * @return new subtree root
+   */
+  static N* rebalanceInsert(N* node, K key);
+
+  /**
+   * Update node's height and restore balance after a node was erased below it.
+   *
+   * @return new subtree root
+   */
+  static N* rebalanceErase(N* node);
+
+  /**
+   * Flatten a subtree into a list linked through right children in key order. Needs no stack.
+   *
+   * @param node - subtree root
+   * @param count - set to the number of nodes
+   * @return the list head
+   */
+  static N* flatten(N* node, uint32_t* count);
+
+  /**
+   * Link the first count nodes of a list, linked through right children in key order, into a
+   * perfectly balanced subtree. Recursion depth is log2(count).
+   *
+   * @param list - the list head, advanced past the consumed nodes
+   * @param count - the number of nodes
+   * @return subtree root
+   */
+  static N* buildBalanced(N** list, uint32_t count);
+
+  /**
+   * Link two subtrees with a middle node whose key is between them. Recursion depth is the
+   * height difference of the subtrees.
+   *
+   * @return new subtree root
+   */
+  static N* joinNodes(N* left, N* node, N* right);
+
+  /**
+   * Join where left is higher than right.
+   */
+  static N* joinRight(N* left, N* node, N* right);
+
+  /**
+   * Join where right is higher than left.
+   */
+  static N* joinLeft(N* left, N* node, N* right);
+
+  /**
+   * Link two subtrees where every key of left is less than every key of right.
+   */
+  static N* joinNodes(N* left, N* right);
+
+  /**
+   * Detach the node with the largest key from a subtree.
+   *
+   * @param last - set to the detached node
+   * @return the remaining subtree
+   */
+  static N* splitLast(N* node, N** last);
+
+  /**
+   * Split a subtree by a key.
    *
-   * @return new root
+   * @param left - set to the subtree with smaller keys
+   * @param right - set to the subtree with greater keys
+   * @param found - set to the detached node with the key or nullptr
    */
-  N* insert(N* node, K key);
+  static void splitNodes(N* node, K key, N** left, N** right, N** found);
+
+  N* unionNodes(N* node, N* other, uint8_t forks);
+  N* intersectionNodes(N* node, N* other, uint8_t forks);
+  N* differenceNodes(N* node, N* other, uint8_t forks);
 
   /**
-   * Erase a node at the node position.
+   * Run two functions, in parallel if the allocator is thread-safe and the subtree is high
+   * enough to pay for a thread.
    *
-   * @return new root
+   * @param forks - how many more levels of recursion may spawn threads
+   * @param height - the height of the subtree being processed
    */
-  N* erase(N* root, K key);
+  template<typename F1, typename F2>
+  static void forkJoin(uint8_t forks, H height, F1&& f1, F2&& f2);
+
+  /**
+   * @return how many levels of set operation recursion may spawn threads
+   */
+  static uint8_t maxForks();
+
+  /**
+   * Destroy a subtree without touching the root.
+   */
+  void destroyBranch(N* node);
 
 // ATTRIBUTES
 
+  /** Subtrees lower than this are processed on the calling thread. */
+  static const uint8_t FORK_HEIGHT = 14;
+
+  A alloc_;
   N* root_;
 
+  /** Nodes on the path from the root to the maximum, valid when spine_depth_ > 0. */
+  N* spine_[MAX_HEIGHT];
+  uint8_t spine_depth_;
+
 }; // class AvlTree
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -174,6 +581,13 @@ inline NodeObserver<N>::NodeObserver() :
 {
 }
 
+template<typename N>
+inline AvlTreeIterator<N>::AvlTreeIterator(N* root) :
+  root_(root),
+  depth_(0)
+{
+}
+
 template<typename N, typename K, typename H>
 inline NodeBase<N, K, H>::NodeBase(K key) :
   key_(key),
@@ -183,14 +597,16 @@ inline NodeBase<N, K, H>::NodeBase(K key) :
 {
 }
 
-template<typename N, typename K, typename H>
-inline AvlTree<N, K, H>::AvlTree() :
-  root_(nullptr)
+template<typename N, typename K, typename H, typename A>
+inline AvlTree<N, K, H, A>::AvlTree() :
+  alloc_(),
+  root_(nullptr),
+  spine_depth_(0)
 {
 }
 
-template<typename N, typename K, typename H>
-inline AvlTree<N, K, H>::~AvlTree()
+template<typename N, typename K, typename H, typename A>
+inline AvlTree<N, K, H, A>::~AvlTree()
 {
   eraseBranch(root_);
 }
@@ -205,6 +621,111 @@ inline int NodeObserver<N>::onTraverse(N* n)
   return rc;
 }
 
+template<typename N>
+inline N& AvlTreeIterator<N>::operator*() const
+{
+  return *path_[depth_ - 1];
+}
+
+template<typename N>
+inline N* AvlTreeIterator<N>::operator->() const
+{
+  return path_[depth_ - 1];
+}
+
+template<typename N>
+inline N* AvlTreeIterator<N>::node() const
+{
+  return (0 == depth_ ? nullptr : path_[depth_ - 1]);
+}
+
+template<typename N>
+inline AvlTreeIterator<N>& AvlTreeIterator<N>::operator++()
+{
+  N* child = path_[depth_ - 1];
+
+  if (nullptr != child->right()) {
+    pushLeft(child->right());
+  } else {
+    // Climb while coming from a right subtree. The next parent is the successor.
+    --depth_;
+
+    while (depth_ > 0 && path_[depth_ - 1]->right() == child) {
+      child = path_[--depth_];
+    }
+  }
+  return *this;
+}
+
+template<typename N>
+inline AvlTreeIterator<N> AvlTreeIterator<N>::operator++(int)
+{
+  AvlTreeIterator<N> it(*this);
+  ++(*this);
+  return it;
+}
+
+template<typename N>
+inline AvlTreeIterator<N>& AvlTreeIterator<N>::operator--()
+{
+  if (0 == depth_) {
+    pushRight(root_);
+    return *this;
+  }
+
+  N* child = path_[depth_ - 1];
+
+  if (nullptr != child->left()) {
+    pushRight(child->left());
+  } else {
+    // Climb while coming from a left subtree. The next parent is the predecessor.
+    --depth_;
+
+    while (depth_ > 0 && path_[depth_ - 1]->left() == child) {
+      child = path_[--depth_];
+    }
+  }
+  return *this;
+}
+
+template<typename N>
+inline AvlTreeIterator<N> AvlTreeIterator<N>::operator--(int)
+{
+  AvlTreeIterator<N> it(*this);
+  --(*this);
+  return it;
+}
+
+template<typename N>
+inline bool AvlTreeIterator<N>::operator==(const AvlTreeIterator<N>& other) const
+{
+  return (node() == other.node());
+}
+
+template<typename N>
+inline bool AvlTreeIterator<N>::operator!=(const AvlTreeIterator<N>& other) const
+{
+  return (node() != other.node());
+}
+
+template<typename N>
+inline void AvlTreeIterator<N>::pushLeft(N* node)
+{
+  while (nullptr != node) {
+    path_[depth_++] = node;
+    node = node->left();
+  }
+}
+
+template<typename N>
+inline void AvlTreeIterator<N>::pushRight(N* node)
+{
+  while (nullptr != node) {
+    path_[depth_++] = node;
+    node = node->right();
+  }
+}
+
 template<typename N, typename K, typename H>
 inline K NodeBase<N, K, H>::key() const
 {
@@ -254,153 +775,754 @@ inline void NodeBase<N, K, H>::right(N* node)
 }
 
 template<typename N, typename K, typename H>
-inline N* AvlTree<N, K, H>::root()
+inline void NodeBase<N, K, H>::augment()
+{
+}
+
+template<typename N, typename K, typename H, typename A>
+inline N* AvlTree<N, K, H, A>::root()
 {
   return root_;
 }
 
-template<typename N, typename K, typename H>
-inline void AvlTree<N, K, H>::root(N* root)
+template<typename N, typename K, typename H, typename A>
+inline void AvlTree<N, K, H, A>::root(N* root)
 {
+  spine_depth_ = 0;
   root_ = root;
 }
 
-template<typename N, typename K, typename H>
-inline N* AvlTree<N, K, H>::rotateRight(N* node)
+template<typename N, typename K, typename H, typename A>
+inline A& AvlTree<N, K, H, A>::allocator()
 {
-  N* left = node->left();
-  N* left_right = left->right();
-
-  left->right(node);
-  node->left(left_right);
-
-  node->height(max(height(node->left()), height(node->right())) + 1);
-  left->height(max(height(left->left()), height(left->right())) + 1);
+  return alloc_;
+}
 
+template<typename N, typename K, typename H, typename A>
+inline N* AvlTree<N, K, H, A>::rotateRight(N* node)
+{
+  N* left = rotateRightSubtree(node);
+  spine_depth_ = 0;
   root_ = left;
   return left;
 }
 
-template<typename N, typename K, typename H>
-inline N* AvlTree<N, K, H>::rotateLeft(N* node)
+template<typename N, typename K, typename H, typename A>
+inline N* AvlTree<N, K, H, A>::rotateLeft(N* node)
 {
-  N* right = node->right();
-  N* right_left = right->left();
-
-  right->left(node);
-  node->right(right_left);
-
-  node->height(max(height(node->left()), height(node->right())) + 1);
-  right->height(max(height(right->left()), height(right->right())) + 1);
-
+  N* right = rotateLeftSubtree(node);
+  spine_depth_ = 0;
   root_ = right;
   return right;
 }
 
-template<typename N, typename K, typename H>
-inline N* AvlTree<N, K, H>::insert(K key)
+template<typename N, typename K, typename H, typename A>
+inline N* AvlTree<N, K, H, A>::insert(K key)
 {
-  N* n = insert(root_, key);
-  root_ = n;
-  return n;
+  insertKey(key);
+  return root_;
 }
 
-template<typename N, typename K, typename H>
-N* AvlTree<N, K, H>::search(K key)
+template<typename N, typename K, typename H, typename A>
+inline int AvlTree<N, K, H, A>::insertKey(K key)
 {
-  return search(root_, key);
+  N* path[MAX_HEIGHT];
+  uint8_t depth = 0;
+  N* node = root_;
+
+  while (nullptr != node) {
+    if (key < node->key()) {
+      path[depth++] = node;
+      node = node->left();
+    } else if (key > node->key()) {
+      path[depth++] = node;
+      node = node->right();
+    } else {
+      // Invalid condition as keys are the same. No new node is inserted.
+      return 0;
+    }
+  }
+
+  // Returns nullptr if the allocator is exhausted, leaving the tree unchanged.
+  N* child = alloc_.create(key);
+
+  if (nullptr == child) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  spine_depth_ = 0;
+
+  // Walk back up linking the (possibly rotated) subtree into its parent. Once a subtree keeps
+  // its height, the ancestors are unaffected, unless they hold augmented data.
+  //
+  while (depth > 0) {
+    node = path[--depth];
+
+    if (key < node->key()) {
+      node->left(child);
+    } else {
+      node->right(child);
+    }
+
+    H old_height = node->height();
+    child = rebalanceInsert(node, key);
+
+    if (!N::AUGMENTED && child == node && old_height == node->height()) {
+      return 0;
+    }
+  }
+
+  root_ = child;
+  return 0;
 }
 
-template<typename N, typename K, typename H>
-inline N* AvlTree<N, K, H>::erase(K key)
+template<typename N, typename K, typename H, typename A>
+inline N* AvlTree<N, K, H, A>::append(K key)
 {
-  N* n = erase(root_, key);
-  root_ = n;
-  return n;
+  if (0 == spine_depth_) {
+    for (N* node = root_; nullptr != node; node = node->right()) {
+      spine_[spine_depth_++] = node;
+    }
+  }
+
+  if (spine_depth_ > 0 && !(spine_[spine_depth_ - 1]->key() < key)) {
+    return insert(key);
+  }
+
+  N* child = alloc_.create(key);
+
+  if (nullptr == child) {
+    return root_;
+  }
+
+  uint8_t depth = spine_depth_;
+  spine_[spine_depth_++] = child;
+
+  // The same walk up as in insert. The key is the maximum, so the only possible rotation is a
+  // left one, which lifts the next spine node into the place of the rotated one.
+  //
+  while (depth > 0) {
+    N* node = spine_[--depth];
+    node->right(spine_[depth + 1]);
+
+    H old_height = node->height();
+    N* top = rebalanceInsert(node, key);
+
+    if (top != node) {
+      memmove(spine_ + depth, spine_ + depth + 1, (spine_depth_ - depth - 1) * sizeof(N*));
+      --spine_depth_;
+    } else if (!N::AUGMENTED && old_height == node->height()) {
+      return root_;
+    }
+  }
+
+  root_ = spine_[0];
+  return root_;
 }
 
-template<typename N, typename K, typename H>
-void AvlTree<N, K, H>::eraseBranch(N* node)
+template<typename N, typename K, typename H, typename A>
+N* AvlTree<N, K, H, A>::search(K key)
 {
+  return search(root_, key);
+}
+
+template<typename N, typename K, typename H, typename A>
+inline N* AvlTree<N, K, H, A>::erase(K key)
+{
+  N* path[MAX_HEIGHT];
+  bool went_right[MAX_HEIGHT];
+  uint8_t depth = 0;
+  N* node = root_;
+
+  while (nullptr != node && key != node->key()) {
+    path[depth] = node;
+    went_right[depth] = (key > node->key());
+    node = (went_right[depth] ? node->right() : node->left());
+    ++depth;
+  }
+
   if (nullptr == node) {
-    return;
+    return root_;
+  }
+
+  spine_depth_ = 0;
+
+  if (nullptr != node->left() && nullptr != node->right()) {
+    // Node has both child nodes. Its successor, which has no left child, takes its place in
+    // the tree, and the successor's right child takes the successor's place. No node data is
+    // moved, so pointers to other nodes stay valid.
+    //
+    uint8_t node_depth = depth;
+    path[depth] = nullptr;
+    went_right[depth] = true;
+    ++depth;
+
+    N* successor = node->right();
+
+    while (nullptr != successor->left()) {
+      path[depth] = successor;
+      went_right[depth] = false;
+      ++depth;
+      successor = successor->left();
+    }
+
+    N* child = successor->right();
+
+    // If the successor is the right child, the walk up below relinks its right side first.
+    successor->left(node->left());
+    successor->right(node->right());
+    successor->height(node->height());
+    path[node_depth] = successor;
+
+    // Link the successor into the parent now, as the walk up may stop before reaching it.
+    if (0 == node_depth) {
+      root_ = successor;
+    } else if (went_right[node_depth - 1]) {
+      path[node_depth - 1]->right(successor);
+    } else {
+      path[node_depth - 1]->left(successor);
+    }
+
+    alloc_.destroy(node);
+    node = child;
+  } else {
+    // Node has at most one child, which takes its place.
+    N* child = (nullptr != node->left() ? node->left() : node->right());
+    alloc_.destroy(node);
+    node = child;
   }
 
-  eraseBranch(node->left());
-  eraseBranch(node->right());
-  delete node;
+  while (depth > 0) {
+    N* parent = path[--depth];
+
+    if (went_right[depth]) {
+      parent->right(node);
+    } else {
+      parent->left(node);
+    }
+
+    H old_height = parent->height();
+    node = rebalanceErase(parent);
+
+    if (!N::AUGMENTED && node == parent && old_height == parent->height()) {
+      return root_;
+    }
+  }
+
+  root_ = node;
+  return node;
+}
+
+template<typename N, typename K, typename H, typename A>
+void AvlTree<N, K, H, A>::eraseBranch(N* node)
+{
+  spine_depth_ = 0;
 
   if (root_ == node) {
     root_ = nullptr;
   }
+  destroyBranch(node);
 }
 
-template<typename N, typename K, typename H>
-H AvlTree<N, K, H>::balance(N* node)
+template<typename N, typename K, typename H, typename A>
+template<typename I>
+int AvlTree<N, K, H, A>::buildFromSorted(I begin, I end)
 {
-  return (nullptr == node ? 0 : height(node->left()) - height(node->right()));
+  eraseBranch(root_);
+
+  N* head = nullptr;
+  N* tail = nullptr;
+  uint32_t count = 0;
+  int ret = 0;
+
+  for (I it = begin; it != end; ++it) {
+    K key = *it;
+
+    if (nullptr != tail && !(tail->key() < key)) {
+      continue;
+    }
+
+    N* node = alloc_.create(key);
+
+    if (nullptr == node) {
+      errno = ENOMEM;
+      ret = -1;
+      break;
+    }
+
+    if (nullptr == tail) {
+      head = node;
+    } else {
+      tail->right(node);
+    }
+    tail = node;
+    ++count;
+  }
+
+  root_ = buildBalanced(&head, count);
+  return ret;
 }
 
-template<typename N, typename K, typename H>
-H AvlTree<N, K, H>::height(N* node)
+template<typename N, typename K, typename H, typename A>
+int AvlTree<N, K, H, A>::insertBatch(K* keys, uint32_t count)
 {
-  return (nullptr == node ? 0 : node->height());
+  // A tree of height h holds at least ~1.6^h nodes. Merging touches all of them, so it only
+  // pays off when the batch is a noticeable fraction of the tree.
+  H h = height(root_);
+  uint64_t min_nodes = (uint64_t(1) << ((h * 2 / 3) < 63 ? (h * 2 / 3) : 63));
+
+  if (uint64_t(count) * h < min_nodes) {
+    for (uint32_t i = 0; i < count; i++) {
+      if (0 != insertKey(keys[i])) {
+        return -1;
+      }
+    }
+    return 0;
+  }
+
+  Sorters::heapSort(keys, count);
+  spine_depth_ = 0;
+
+  uint32_t size = 0;
+  N* node = flatten(root_, &size);
+  N* head = nullptr;
+  N* tail = nullptr;
+  uint32_t i = 0;
+  int ret = 0;
+
+  while (nullptr != node || i < count) {
+    N* next = nullptr;
+
+    if (i < count && i > 0 && keys[i] == keys[i - 1]) {
+      ++i;
+      continue;
+    }
+
+    if (nullptr != node && (i == count || !(keys[i] < node->key()))) {
+      if (i < count && keys[i] == node->key()) {
+        ++i;
+      }
+      next = node;
+      node = node->right();
+    } else {
+      next = alloc_.create(keys[i]);
+
+      if (nullptr == next) {
+        errno = ENOMEM;
+        ret = -1;
+        i = count;
+        continue;
+      }
+      ++i;
+      ++size;
+    }
+
+    if (nullptr == tail) {
+      head = next;
+    } else {
+      tail->right(next);
+    }
+    tail = next;
+  }
+
+  if (nullptr != tail) {
+    tail->right(nullptr);
+  }
+
+  root_ = buildBalanced(&head, size);
+  return ret;
 }
 
-template<typename N, typename K, typename H>
-H AvlTree<N, K, H>::max(H v1, H v2)
+template<typename N, typename K, typename H, typename A>
+void AvlTree<N, K, H, A>::split(K key, AvlTree* right)
 {
-  return (v1 > v2 ? v1 : v2);
+  static_assert(A::TRANSFERABLE, "Split moves nodes between allocators");
+
+  right->eraseBranch(right->root_);
+
+  N* left = nullptr;
+  N* greater = nullptr;
+  N* found = nullptr;
+  splitNodes(root_, key, &left, &greater, &found);
+
+  spine_depth_ = 0;
+  root_ = left;
+  right->root_ = (nullptr == found ? greater : joinNodes(nullptr, found, greater));
 }
 
-template<typename N, typename K, typename H>
-int AvlTree<N, K, H>::traverse(N* node, NodeObserver<N>* o)
+template<typename N, typename K, typename H, typename A>
+int AvlTree<N, K, H, A>::join(AvlTree* right)
+{
+  static_assert(A::TRANSFERABLE, "Join moves nodes between allocators");
+
+  if (nullptr != root_ && nullptr != right->root_) {
+    N* last = root_;
+
+    while (nullptr != last->right()) {
+      last = last->right();
+    }
+
+    if (!(last->key() < searchMin(right->root_)->key())) {
+      errno = EINVAL;
+      return -1;
+    }
+  }
+
+  spine_depth_ = 0;
+  right->spine_depth_ = 0;
+  root_ = joinNodes(root_, right->root_);
+  right->root_ = nullptr;
+  return 0;
+}
+
+template<typename N, typename K, typename H, typename A>
+void AvlTree<N, K, H, A>::setUnion(AvlTree* other)
+{
+  static_assert(A::TRANSFERABLE, "Union moves nodes between allocators");
+
+  N* node = root_;
+  N* other_node = other->root_;
+  root_ = nullptr;
+  other->root_ = nullptr;
+  spine_depth_ = 0;
+  other->spine_depth_ = 0;
+  root_ = unionNodes(node, other_node, maxForks());
+}
+
+template<typename N, typename K, typename H, typename A>
+void AvlTree<N, K, H, A>::setIntersection(AvlTree* other)
+{
+  static_assert(A::TRANSFERABLE, "Intersection destroys nodes of another allocator");
+
+  N* node = root_;
+  N* other_node = other->root_;
+  root_ = nullptr;
+  other->root_ = nullptr;
+  spine_depth_ = 0;
+  other->spine_depth_ = 0;
+  root_ = intersectionNodes(node, other_node, maxForks());
+}
+
+template<typename N, typename K, typename H, typename A>
+void AvlTree<N, K, H, A>::setDifference(AvlTree* other)
+{
+  static_assert(A::TRANSFERABLE, "Difference destroys nodes of another allocator");
+
+  N* node = root_;
+  N* other_node = other->root_;
+  root_ = nullptr;
+  other->root_ = nullptr;
+  spine_depth_ = 0;
+  other->spine_depth_ = 0;
+  root_ = differenceNodes(node, other_node, maxForks());
+}
+
+template<typename N, typename K, typename H, typename A>
+void AvlTree<N, K, H, A>::eraseRange(K key_min, K key_max)
+{
+  if (key_max < key_min) {
+    return;
+  }
+
+  N* left = nullptr;
+  N* rest = nullptr;
+  N* middle = nullptr;
+  N* right = nullptr;
+  N* found = nullptr;
+
+  splitNodes(root_, key_min, &left, &rest, &found);
+  destroyBranch(found);
+  splitNodes(rest, key_max, &middle, &right, &found);
+  destroyBranch(found);
+  destroyBranch(middle);
+
+  spine_depth_ = 0;
+  root_ = joinNodes(left, right);
+}
+
+template<typename N, typename K, typename H, typename A>
+N* AvlTree<N, K, H, A>::refresh(K key)
 {
-  int rc = 0;
+  N* path[MAX_HEIGHT];
+  uint8_t depth = 0;
+  N* node = root_;
+
+  while (nullptr != node) {
+    path[depth++] = node;
+
+    if (key < node->key()) {
+      node = node->left();
+    } else if (node->key() < key) {
+      node = node->right();
+    } else {
+      break;
+    }
+  }
 
   if (nullptr == node) {
-    return rc;
+    return nullptr;
   }
 
-  rc = traverse(node->left(), o);
+  while (depth > 0) {
+    update(path[--depth]);
+  }
+  return node;
+}
 
-  if (-1 != rc) {
-    rc = o->onTraverse(node);
+template<typename N, typename K, typename H, typename A>
+uint32_t AvlTree<N, K, H, A>::rank(K key)
+{
+  uint32_t rank = 0;
+  N* node = root_;
 
-    if (-1 != rc) {
-      rc = traverse(node->right(), o);
+  while (nullptr != node) {
+    if (node->key() < key) {
+      rank += (nullptr == node->left() ? 0 : node->left()->size()) + 1;
+      node = node->right();
+    } else {
+      node = node->left();
     }
   }
-  return rc;
+  return rank;
 }
 
-template<typename N, typename K, typename H>
-int AvlTree<N, K, H>::traverse(N* node, NodeObserver<N>* o, K key_min, K key_max)
+template<typename N, typename K, typename H, typename A>
+N* AvlTree<N, K, H, A>::select(uint32_t index)
 {
-  int rc = 0;
+  N* node = root_;
 
-  if (nullptr == node) {
-    return rc;
+  while (nullptr != node) {
+    uint32_t left_size = (nullptr == node->left() ? 0 : node->left()->size());
+
+    if (index < left_size) {
+      node = node->left();
+    } else if (index > left_size) {
+      index -= left_size + 1;
+      node = node->right();
+    } else {
+      break;
+    }
+  }
+  return node;
+}
+
+template<typename N, typename K, typename H, typename A>
+template<typename V>
+uint32_t AvlTree<N, K, H, A>::aggregate(K key_min, K key_max, V* result)
+{
+  N* node = root_;
+
+  // Descend to the highest node in range. Ranges in its left and right subtrees are each
+  // bounded on one side only.
+  while (nullptr != node && (node->key() < key_min || key_max < node->key())) {
+    node = (node->key() < key_min ? node->right() : node->left());
   }
 
-  if (key_min < node->key()) {
-    rc = traverse(node->left(), o, key_min, key_max);
+  if (nullptr == node || key_max < key_min) {
+    return 0;
+  }
+
+  uint32_t count = 1;
+  V value = node->value();
+
+  // Along the left boundary, every node in range brings its right subtree along. Those ranges
+  // precede the ones seen so far.
+  for (N* n = node->left(); nullptr != n;) {
+    if (n->key() < key_min) {
+      n = n->right();
+      continue;
+    }
+
+    V part = n->value();
+    ++count;
+
+    if (nullptr != n->right()) {
+      part = N::combine(part, n->right()->aggregate());
+      count += n->right()->size();
+    }
+    value = N::combine(part, value);
+    n = n->left();
+  }
+
+  for (N* n = node->right(); nullptr != n;) {
+    if (key_max < n->key()) {
+      n = n->left();
+      continue;
+    }
+
+    V part = n->value();
+    ++count;
+
+    if (nullptr != n->left()) {
+      part = N::combine(n->left()->aggregate(), part);
+      count += n->left()->size();
+    }
+    value = N::combine(value, part);
+    n = n->right();
   }
 
-  if (-1 != rc) {
+  *result = value;
+  return count;
+}
+
+template<typename N, typename K, typename H, typename A>
+H AvlTree<N, K, H, A>::balance(N* node)
+{
+  return (nullptr == node ? 0 : height(node->left()) - height(node->right()));
+}
+
+template<typename N, typename K, typename H, typename A>
+H AvlTree<N, K, H, A>::height(N* node)
+{
+  return (nullptr == node ? 0 : node->height());
+}
+
+template<typename N, typename K, typename H, typename A>
+H AvlTree<N, K, H, A>::max(H v1, H v2)
+{
+  return (v1 > v2 ? v1 : v2);
+}
+
+template<typename N, typename K, typename H, typename A>
+int AvlTree<N, K, H, A>::traverse(N* node, NodeObserver<N>* o)
+{
+  return visit(node, [o](N* n) { return o->onTraverse(n); });
+}
+
+template<typename N, typename K, typename H, typename A>
+int AvlTree<N, K, H, A>::traverse(N* node, NodeObserver<N>* o, K key_min, K key_max)
+{
+  return visit(node, [o](N* n) { return o->onTraverse(n); }, key_min, key_max);
+}
+
+template<typename N, typename K, typename H, typename A>
+template<typename F>
+inline int AvlTree<N, K, H, A>::visit(N* node, F&& visitor)
+{
+  N* stack[MAX_HEIGHT];
+  uint8_t depth = 0;
+
+  while (true) {
+    while (nullptr != node) {
+      stack[depth++] = node;
+      node = node->left();
+    }
+
+    if (0 == depth) {
+      return 0;
+    }
+
+    node = stack[--depth];
+
+    if (-1 == visitor(node)) {
+      return -1;
+    }
+    node = node->right();
+  }
+}
+
+template<typename N, typename K, typename H, typename A>
+template<typename F>
+inline int AvlTree<N, K, H, A>::visit(N* node, F&& visitor, K key_min, K key_max)
+{
+  N* stack[MAX_HEIGHT];
+  uint8_t depth = 0;
+
+  while (true) {
+    // Descend left only while smaller keys may still be in range.
+    while (nullptr != node) {
+      stack[depth++] = node;
+      node = (key_min < node->key() ? node->left() : nullptr);
+    }
+
+    if (0 == depth) {
+      return 0;
+    }
+
+    node = stack[--depth];
+
     if (key_min <= node->key() && key_max >= node->key()) {
-      rc = o->onTraverse(node);
+      if (-1 == visitor(node)) {
+        return -1;
+      }
+    }
+    node = (key_max > node->key() ? node->right() : nullptr);
+  }
+}
+
+template<typename N, typename K, typename H, typename A>
+inline typename AvlTree<N, K, H, A>::Iterator AvlTree<N, K, H, A>::begin()
+{
+  Iterator it(root_);
+  it.pushLeft(root_);
+  return it;
+}
+
+template<typename N, typename K, typename H, typename A>
+inline typename AvlTree<N, K, H, A>::Iterator AvlTree<N, K, H, A>::end()
+{
+  return Iterator(root_);
+}
+
+template<typename N, typename K, typename H, typename A>
+inline typename AvlTree<N, K, H, A>::Iterator AvlTree<N, K, H, A>::lowerBound(K key)
+{
+  Iterator it(root_);
+  uint8_t depth = 0;
+  N* node = root_;
+
+  // Keep the path to the last node where the search went left, i.e. the smallest key >= key.
+  while (nullptr != node) {
+    it.path_[it.depth_++] = node;
+
+    if (node->key() < key) {
+      node = node->right();
+    } else {
+      depth = it.depth_;
+      node = node->left();
     }
+  }
 
-    if (-1 != rc && key_max > node->key()) {
-      rc = traverse(node->right(), o, key_min, key_max);
+  it.depth_ = depth;
+  return it;
+}
+
+template<typename N, typename K, typename H, typename A>
+inline typename AvlTree<N, K, H, A>::Iterator AvlTree<N, K, H, A>::upperBound(K key)
+{
+  Iterator it(root_);
+  uint8_t depth = 0;
+  N* node = root_;
+
+  while (nullptr != node) {
+    it.path_[it.depth_++] = node;
+
+    if (node->key() <= key) {
+      node = node->right();
+    } else {
+      depth = it.depth_;
+      node = node->left();
     }
   }
-  return rc;
+
+  it.depth_ = depth;
+  return it;
 }
 
-template<typename N, typename K, typename H>
-N* AvlTree<N, K, H>::searchMin(N* node)
+template<typename N, typename K, typename H, typename A>
+inline void AvlTree<N, K, H, A>::equalRange(K key, Iterator* first, Iterator* last)
+{
+  *first = lowerBound(key);
+  *last = *first;
+
+  if (nullptr != last->node() && last->node()->key() == key) {
+    ++(*last);
+  }
+}
+
+template<typename N, typename K, typename H, typename A>
+N* AvlTree<N, K, H, A>::searchMin(N* node)
 {
     N* current = node;
 
@@ -410,137 +1532,427 @@ N* AvlTree<N, K, H>::searchMin(N* node)
     return current;
 }
 
-template<typename N, typename K, typename H>
-N* AvlTree<N, K, H>::search(N* root, K key)
+template<typename N, typename K, typename H, typename A>
+N* AvlTree<N, K, H, A>::search(N* root, K key)
 {
-  if (nullptr == root || root->key() == key) {
-    return root;
+  while (nullptr != root && root->key() != key) {
+    root = (root->key() < key ? root->right() : root->left());
   }
-
-  if (root->key() < key) {
-    return search(root->right(), key);
-  }
-  return search(root->left(), key);
+  return root;
 }
 
 /////////////////////////////////////////////// PRIVATE ////////////////////////////////////////////
 
 //============================================= OPERATIONS =========================================
 
-template<typename N, typename K, typename H>
-inline N* AvlTree<N, K, H>::insert(N* node, K key)
+template<typename N, typename K, typename H, typename A>
+inline void AvlTree<N, K, H, A>::update(N* node)
+{
+  node->height(max(height(node->left()), height(node->right())) + 1);
+  node->augment();
+}
+
+template<typename N, typename K, typename H, typename A>
+N* AvlTree<N, K, H, A>::joinNodes(N* left, N* node, N* right)
+{
+  if (height(left) > height(right) + 1) {
+    return joinRight(left, node, right);
+  }
+  if (height(right) > height(left) + 1) {
+    return joinLeft(left, node, right);
+  }
+
+  node->left(left);
+  node->right(right);
+  update(node);
+  return node;
+}
+
+template<typename N, typename K, typename H, typename A>
+N* AvlTree<N, K, H, A>::joinRight(N* left, N* node, N* right)
+{
+  // Descend the right spine of left to a subtree that is about as high as right.
+  N* child = left->right();
+
+  if (height(child) <= height(right) + 1) {
+    node->left(child);
+    node->right(right);
+    update(node);
+
+    if (height(node) <= height(left->left()) + 1) {
+      left->right(node);
+      update(left);
+      return left;
+    }
+
+    left->right(rotateRightSubtree(node));
+    update(left);
+    return rotateLeftSubtree(left);
+  }
+
+  left->right(joinRight(child, node, right));
+  update(left);
+  return (balance(left) < -1 ? rotateLeftSubtree(left) : left);
+}
+
+template<typename N, typename K, typename H, typename A>
+N* AvlTree<N, K, H, A>::joinLeft(N* left, N* node, N* right)
+{
+  N* child = right->left();
+
+  if (height(child) <= height(left) + 1) {
+    node->left(left);
+    node->right(child);
+    update(node);
+
+    if (height(node) <= height(right->right()) + 1) {
+      right->left(node);
+      update(right);
+      return right;
+    }
+
+    right->left(rotateLeftSubtree(node));
+    update(right);
+    return rotateRightSubtree(right);
+  }
+
+  right->left(joinLeft(left, node, child));
+  update(right);
+  return (balance(right) > 1 ? rotateRightSubtree(right) : right);
+}
+
+template<typename N, typename K, typename H, typename A>
+N* AvlTree<N, K, H, A>::joinNodes(N* left, N* right)
+{
+  if (nullptr == left) {
+    return right;
+  }
+
+  N* last = nullptr;
+  left = splitLast(left, &last);
+  return joinNodes(left, last, right);
+}
+
+template<typename N, typename K, typename H, typename A>
+N* AvlTree<N, K, H, A>::splitLast(N* node, N** last)
+{
+  if (nullptr == node->right()) {
+    *last = node;
+    N* left = node->left();
+    node->left(nullptr);
+    return left;
+  }
+
+  N* right = splitLast(node->right(), last);
+  return joinNodes(node->left(), node, right);
+}
+
+template<typename N, typename K, typename H, typename A>
+void AvlTree<N, K, H, A>::splitNodes(N* node, K key, N** left, N** right, N** found)
 {
   if (nullptr == node) {
-    node = new N(key);
-    return node;
+    *left = nullptr;
+    *right = nullptr;
+    *found = nullptr;
+    return;
   }
 
+  N* node_left = node->left();
+  N* node_right = node->right();
+
   if (key < node->key()) {
-    node->left(insert(node->left(), key));
-  } else if (key > node->key()) {
-    node->right(insert(node->right(), key));
+    N* greater = nullptr;
+    splitNodes(node_left, key, left, &greater, found);
+    *right = joinNodes(greater, node, node_right);
+  } else if (node->key() < key) {
+    N* less = nullptr;
+    splitNodes(node_right, key, &less, right, found);
+    *left = joinNodes(node_left, node, less);
   } else {
-    // Invalid condition as keys are the same. No new node is inserted.
+    *left = node_left;
+    *right = node_right;
+    node->left(nullptr);
+    node->right(nullptr);
+    update(node);
+    *found = node;
+  }
+}
+
+template<typename N, typename K, typename H, typename A>
+N* AvlTree<N, K, H, A>::unionNodes(N* node, N* other, uint8_t forks)
+{
+  if (nullptr == node) {
+    return other;
+  }
+  if (nullptr == other) {
     return node;
   }
 
-  node->height(max(height(node->left()), height(node->right())) + 1);
+  N* less = nullptr;
+  N* greater = nullptr;
+  N* found = nullptr;
+  splitNodes(other, node->key(), &less, &greater, &found);
+  destroyBranch(found);
 
-  H b = balance(node);
+  N* node_left = node->left();
+  N* node_right = node->right();
+  N* left = nullptr;
+  N* right = nullptr;
+  uint8_t next = (forks > 0 ? forks - 1 : 0);
 
-  if (b > 1) {
-    if (nullptr != node->left()) {
-      if (key < node->left()->key()) {
-        node = rotateRight(node);
-      } else if (key > node->left()->key()) {
-        node->left(rotateLeft(node->left()));
-        node = rotateRight(node);
-      }
+  forkJoin(forks, height(node),
+      [&]() { left = unionNodes(node_left, less, next); },
+      [&]() { right = unionNodes(node_right, greater, next); });
+
+  return joinNodes(left, node, right);
+}
+
+template<typename N, typename K, typename H, typename A>
+N* AvlTree<N, K, H, A>::intersectionNodes(N* node, N* other, uint8_t forks)
+{
+  if (nullptr == node || nullptr == other) {
+    destroyBranch(node);
+    destroyBranch(other);
+    return nullptr;
+  }
+
+  N* less = nullptr;
+  N* greater = nullptr;
+  N* found = nullptr;
+  splitNodes(other, node->key(), &less, &greater, &found);
+
+  N* node_left = node->left();
+  N* node_right = node->right();
+  N* left = nullptr;
+  N* right = nullptr;
+  uint8_t next = (forks > 0 ? forks - 1 : 0);
+
+  forkJoin(forks, height(node),
+      [&]() { left = intersectionNodes(node_left, less, next); },
+      [&]() { right = intersectionNodes(node_right, greater, next); });
+
+  if (nullptr == found) {
+    alloc_.destroy(node);
+    return joinNodes(left, right);
+  }
+
+  alloc_.destroy(found);
+  return joinNodes(left, node, right);
+}
+
+template<typename N, typename K, typename H, typename A>
+N* AvlTree<N, K, H, A>::differenceNodes(N* node, N* other, uint8_t forks)
+{
+  if (nullptr == node || nullptr == other) {
+    destroyBranch(other);
+    return node;
+  }
+
+  N* less = nullptr;
+  N* greater = nullptr;
+  N* found = nullptr;
+  splitNodes(node, other->key(), &less, &greater, &found);
+  destroyBranch(found);
+
+  N* other_left = other->left();
+  N* other_right = other->right();
+  N* left = nullptr;
+  N* right = nullptr;
+  uint8_t next = (forks > 0 ? forks - 1 : 0);
+
+  forkJoin(forks, height(other),
+      [&]() { left = differenceNodes(less, other_left, next); },
+      [&]() { right = differenceNodes(greater, other_right, next); });
+
+  alloc_.destroy(other);
+  return joinNodes(left, right);
+}
+
+template<typename N, typename K, typename H, typename A>
+template<typename F1, typename F2>
+inline void AvlTree<N, K, H, A>::forkJoin(uint8_t forks, H height, F1&& f1, F2&& f2)
+{
+#if BTR_X86 > 0
+  if (A::THREAD_SAFE && forks > 0 && height >= FORK_HEIGHT) {
+    try {
+      std::thread thread(f1);
+      f2();
+      thread.join();
+      return;
+    } catch (const std::system_error&) {
+      // Out of threads. Fall through to running both on this thread.
     }
-  } else if (b < -1) {
-    if (nullptr != node->right()) {
-      if (key > node->right()->key()) {
-        node = rotateLeft(node);
-      } else if (key < node->right()->key()) {
-        node->right(rotateRight(node->right()));
-        node = rotateLeft(node);
-      }
+  }
+#else
+  (void)forks;
+  (void)height;
+#endif
+  f1();
+  f2();
+}
+
+template<typename N, typename K, typename H, typename A>
+inline uint8_t AvlTree<N, K, H, A>::maxForks()
+{
+  uint8_t forks = 0;
+#if BTR_X86 > 0
+  // Each level doubles the number of threads. Stop when they cover the cores.
+  for (unsigned cores = std::thread::hardware_concurrency(); cores > 1; cores >>= 1) {
+    ++forks;
+  }
+#endif
+  return forks;
+}
+
+template<typename N, typename K, typename H, typename A>
+void AvlTree<N, K, H, A>::destroyBranch(N* node)
+{
+  // Rotate left children up until the node has none, then destroy it and continue with its
+  // right child. Needs no stack.
+  //
+  while (nullptr != node) {
+    N* left = node->left();
+
+    if (nullptr != left) {
+      node->left(left->right());
+      left->right(node);
+      node = left;
+    } else {
+      N* right = node->right();
+      alloc_.destroy(node);
+      node = right;
     }
   }
+}
 
-  return node;
+template<typename N, typename K, typename H, typename A>
+N* AvlTree<N, K, H, A>::flatten(N* node, uint32_t* count)
+{
+  N* head = nullptr;
+  N* tail = nullptr;
+  *count = 0;
+
+  // Rotate left children up until the node has none. The node is then the next in key order.
+  while (nullptr != node) {
+    N* left = node->left();
+
+    if (nullptr != left) {
+      node->left(left->right());
+      left->right(node);
+      node = left;
+    } else {
+      if (nullptr == tail) {
+        head = node;
+      } else {
+        tail->right(node);
+      }
+      tail = node;
+      ++(*count);
+      node = node->right();
+    }
+  }
+  return head;
 }
 
-template<typename N, typename K, typename H>
-inline N* AvlTree<N, K, H>::erase(N* root, K key)
+template<typename N, typename K, typename H, typename A>
+N* AvlTree<N, K, H, A>::buildBalanced(N** list, uint32_t count)
 {
-  if (nullptr == root) {
+  if (0 == count) {
     return nullptr;
   }
 
-  if (key < root->key()) {
-    root->left(erase(root->left(), key));
-  } else if (key > root->key()) {
-    root->right(erase(root->right(), key));
-  } else {
-    // Erase root node
-    //
-    if ((nullptr == root->left()) || (nullptr == root->right())) {
-      N* temp = root->left() ? root->left() : root->right();
+  // The right subtree gets the extra node, so heights of siblings differ by at most one.
+  uint32_t left_count = (count - 1) / 2;
+  N* left = buildBalanced(list, left_count);
+  N* node = *list;
+  *list = node->right();
 
-      if (nullptr == temp) {
-        // No child nodes
-        temp = root;
-        root = nullptr;
-      } else {
-        // Shallow copy data members from the one child node
-        *root = *temp;
-      }
+  node->left(left);
+  node->right(buildBalanced(list, count - 1 - left_count));
+  update(node);
+  return node;
+}
+
+template<typename N, typename K, typename H, typename A>
+inline N* AvlTree<N, K, H, A>::rotateRightSubtree(N* node)
+{
+  N* left = node->left();
+  N* left_right = left->right();
 
-      delete temp;
+  left->right(node);
+  node->left(left_right);
 
-    } else {
-      // Root has both child nodes. Back up the data of root-to-delete so as to reuse its
-      // allocated memory chunk.
-      N* root_left = root->left();
-      N* root_right = root->right();
-      H height = root->height();
+  update(node);
+  update(left);
+  return left;
+}
+
+template<typename N, typename K, typename H, typename A>
+inline N* AvlTree<N, K, H, A>::rotateLeftSubtree(N* node)
+{
+  N* right = node->right();
+  N* right_left = right->left();
+
+  right->left(node);
+  node->right(right_left);
 
-      N* temp = searchMin(root->right());
+  update(node);
+  update(right);
+  return right;
+}
 
-      // Shallow-copy data and restore left/right/height.
-      *root = *temp;
-      root->left(root_left);
-      root->right(root_right);
-      root->height(height);
+template<typename N, typename K, typename H, typename A>
+inline N* AvlTree<N, K, H, A>::rebalanceInsert(N* node, K key)
+{
+  update(node);
+
+  H b = balance(node);
 
-      root->right(erase(root->right(), temp->key()));
+  if (b > 1) {
+    if (nullptr != node->left()) {
+      if (key < node->left()->key()) {
+        node = rotateRightSubtree(node);
+      } else if (key > node->left()->key()) {
+        node->left(rotateLeftSubtree(node->left()));
+        node = rotateRightSubtree(node);
+      }
+    }
+  } else if (b < -1) {
+    if (nullptr != node->right()) {
+      if (key > node->right()->key()) {
+        node = rotateLeftSubtree(node);
+      } else if (key < node->right()->key()) {
+        node->right(rotateRightSubtree(node->right()));
+        node = rotateLeftSubtree(node);
+      }
     }
   }
 
-  if (nullptr == root) {
-    return nullptr;
-  }
+  return node;
+}
 
-  root->height(max(height(root->left()), height(root->right())) + 1);
+template<typename N, typename K, typename H, typename A>
+inline N* AvlTree<N, K, H, A>::rebalanceErase(N* node)
+{
+  update(node);
 
-  H b = balance(root);
+  H b = balance(node);
 
   if (b > 1) {
-    if (balance(root->left()) < 0) {
-      root->left(rotateLeft(root->left()));
+    if (balance(node->left()) < 0) {
+      node->left(rotateLeftSubtree(node->left()));
     }
-    return rotateRight(root);
+    return rotateRightSubtree(node);
   }
 
   if (b < -1) {
-    if (balance(root->right()) > 0) {
-      root->right(rotateRight(root->right()));
+    if (balance(node->right()) > 0) {
+      node->right(rotateRightSubtree(node->right()));
     }
-    return rotateLeft(root);
+    return rotateLeftSubtree(node);
   }
 
-  return root;
+  return node;
 }
 
 } // namespace btr
@@ -0,0 +1,184 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+#ifndef _btr_AvlTreeAggregate_hpp_
+#define _btr_AvlTreeAggregate_hpp_
+
+// SYSTEM INCLUDES
+
+// PROJECT INCLUDES
+#include "utility/common/avl_tree.hpp"
+
+namespace btr
+{
+
+/**
+ * Aggregation operations for AggregateNodeBase. An operation must be associative.
+ */
+struct SumAggregate
+{
+  template<typename V>
+  static V combine(V v1, V v2)
+  {
+    return v1 + v2;
+  }
+};
+
+struct MinAggregate
+{
+  template<typename V>
+  static V combine(V v1, V v2)
+  {
+    return (v2 < v1 ? v2 : v1);
+  }
+};
+
+struct MaxAggregate
+{
+  template<typename V>
+  static V combine(V v1, V v2)
+  {
+    return (v1 < v2 ? v2 : v1);
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Base class of a node that keeps the size of its subtree and an aggregate of node values in
+ * the subtree. The tree refreshes both whenever links change, which lets AvlTree::rank,
+ * AvlTree::select and AvlTree::aggregate run in O(log n).
+ *
+ * IMPORTANT: After changing the value of a node in a tree, call AvlTree::refresh with its key.
+ *
+ * @tparam V - node value type
+ * @tparam Op - aggregation operation, e.g. SumAggregate
+ */
+template <typename N, typename K = uint16_t, typename V = int32_t, typename Op = SumAggregate,
+          typename H = int16_t>
+class AggregateNodeBase : public NodeBase<N, K, H>
+{
+public:
+
+  static const bool AUGMENTED = true;
+
+  typedef V Value;
+
+// LIFECYCLE
+
+  /**
+   * Ctor.
+   *
+   * @param key - node key
+   * @param value - node value
+   */
+  AggregateNodeBase(K key, V value = V());
+
+// OPERATIONS
+
+  V value() const;
+  void value(V value);
+
+  /**
+   * @return the number of nodes in the subtree
+   */
+  uint32_t size() const;
+
+  /**
+   * @return the aggregate of node values in the subtree
+   */
+  V aggregate() const;
+
+  /**
+   * Recompute subtree size and aggregate from the children.
+   */
+  void augment();
+
+  /**
+   * Combine two values with the aggregation operation.
+   */
+  static V combine(V v1, V v2);
+
+private:
+
+// ATTRIBUTES
+
+  V value_;
+  V aggregate_;
+  uint32_t size_;
+};
+
+/////////////////////////////////////////////// INLINE /////////////////////////////////////////////
+
+/////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
+
+//============================================= LIFECYCLE ==========================================
+
+template<typename N, typename K, typename V, typename Op, typename H>
+inline AggregateNodeBase<N, K, V, Op, H>::AggregateNodeBase(K key, V value) :
+  NodeBase<N, K, H>(key),
+  value_(value),
+  aggregate_(value),
+  size_(1)
+{
+}
+
+//============================================= OPERATIONS =========================================
+
+template<typename N, typename K, typename V, typename Op, typename H>
+inline V AggregateNodeBase<N, K, V, Op, H>::value() const
+{
+  return value_;
+}
+
+template<typename N, typename K, typename V, typename Op, typename H>
+inline void AggregateNodeBase<N, K, V, Op, H>::value(V value)
+{
+  value_ = value;
+}
+
+template<typename N, typename K, typename V, typename Op, typename H>
+inline uint32_t AggregateNodeBase<N, K, V, Op, H>::size() const
+{
+  return size_;
+}
+
+template<typename N, typename K, typename V, typename Op, typename H>
+inline V AggregateNodeBase<N, K, V, Op, H>::aggregate() const
+{
+  return aggregate_;
+}
+
+template<typename N, typename K, typename V, typename Op, typename H>
+inline void AggregateNodeBase<N, K, V, Op, H>::augment()
+{
+  N* left = this->left();
+  N* right = this->right();
+
+  size_ = 1;
+  aggregate_ = value_;
+
+  if (nullptr != left) {
+    size_ += left->size();
+    aggregate_ = Op::combine(left->aggregate(), aggregate_);
+  }
+  if (nullptr != right) {
+    size_ += right->size();
+    aggregate_ = Op::combine(aggregate_, right->aggregate());
+  }
+}
+
+template<typename N, typename K, typename V, typename Op, typename H>
+inline V AggregateNodeBase<N, K, V, Op, H>::combine(V v1, V v2)
+{
+  return Op::combine(v1, v2);
+}
+
+} // namespace btr
+
+#endif // _btr_AvlTreeAggregate_hpp_
@@ -0,0 +1,462 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+#ifndef _btr_AvlTreeImage_hpp_
+#define _btr_AvlTreeImage_hpp_
+
+// SYSTEM INCLUDES
+#include <errno.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
+#if BTR_X86 > 0
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+#endif
+
+// PROJECT INCLUDES
+#include "utility/common/buff.hpp"
+#include "utility/common/value_codec.hpp"
+
+namespace btr
+{
+
+/**
+ * The class represents a serialized AvlTree that is searched in place.
+ *
+ * write() stores tree keys in ascending order as fixed-size records holding the key, a POD
+ * payload and the indices of the left and right child in a balanced tree over the records. The
+ * image has no pointers, so it can be saved to a file or flash and used at any address: attach()
+ * validates the header and searches run directly on the records, with no allocation or insert
+ * per node. On x86, map() attaches a file through mmap, read-only or copy-on-write.
+ *
+ * Records use the byte order and alignment of the host that wrote them. attach() rejects images
+ * written with a different byte order, key size or record size.
+ *
+ * IMPORTANT: The class is shared by AVR and x86 platforms. Keep it portable.
+ *
+ * @tparam P - payload type, must be trivially copyable
+ */
+template<typename K, typename P>
+class AvlTreeImage
+{
+public:
+
+  /** Child index of a missing child. */
+  static const uint32_t NONE = 0xFFFFFFFF;
+
+  struct Record
+  {
+    K key_;
+    int16_t height_;
+    uint32_t left_;
+    uint32_t right_;
+    P payload_;
+  };
+
+#if BTR_X86 > 0
+  static_assert(std::is_trivially_copyable<P>::value, "Payload must be trivially copyable");
+#endif
+
+// LIFECYCLE
+
+  /**
+   * Create a detached image.
+   */
+  AvlTreeImage();
+  AvlTreeImage(const AvlTreeImage&) = delete;
+  AvlTreeImage& operator=(const AvlTreeImage&) = delete;
+
+  /**
+   * Unmap the image if it was mapped.
+   */
+  ~AvlTreeImage();
+
+// OPERATIONS
+
+  /**
+   * Serialize a tree at buffer's write pointer.
+   *
+   * @param tree - AvlTree or any tree providing in-order begin()/end() iterators
+   * @param buff - the buffer to write to. Its write pointer must be aligned to alignof(Record)
+   *  for the image to be attached in place
+   * @param payload - callable taking (N*, P*) that copies node data into the record
+   * @param buff_mod - how the buffer may be modified if there's not enough room, @see Buff::write
+   * @return 0 on success, otherwise -1 and errno is set to ENOMEM if the buffer can't hold the
+   *  image
+   */
+  template<typename T, typename F>
+  static int write(T& tree, Buff* buff, F&& payload, int buff_mod = Buff::MOD_ALL);
+
+  /**
+   * @return the number of bytes an image of count keys takes
+   */
+  static uint32_t imageSize(uint32_t count);
+
+  /**
+   * Use an image in memory. The memory must outlive the image object.
+   *
+   * @param data - the image, aligned to alignof(Record)
+   * @param size - the number of bytes available
+   * @param writable - true if records may be modified through mutableSearch()
+   * @return 0 on success, otherwise -1 and errno is set to EINVAL
+   */
+  int attach(const uint8_t* data, uint32_t size, bool writable = false);
+
+#if BTR_X86 > 0
+  /**
+   * Map an image file.
+   *
+   * @param path - the file
+   * @param copy_on_write - if true, records may be modified; changes stay private to the process
+   * @return 0 on success, otherwise -1 and errno is set
+   */
+  int map(const char* path, bool copy_on_write = false);
+#endif
+
+  /**
+   * Detach the image, unmapping it if it was mapped.
+   */
+  void detach();
+
+  /**
+   * @return the number of records
+   */
+  uint32_t size() const;
+
+  /**
+   * @return the record with the given index in key order
+   */
+  const Record* record(uint32_t index) const;
+
+  /**
+   * @return the record with the given key or nullptr
+   */
+  const Record* search(K key) const;
+
+  /**
+   * @return the record with the given key, or nullptr if absent or the image isn't writable
+   */
+  Record* mutableSearch(K key);
+
+  /**
+   * Visit records with keys in [key_min, key_max] in key order.
+   *
+   * @param visitor - callable taking const Record* and returning -1 to stop, 0 to continue
+   * @return -1 if the visitor stopped the traversal, 0 otherwise
+   */
+  template<typename F>
+  int visit(F&& visitor, K key_min, K key_max) const;
+
+private:
+
+  struct Header
+  {
+    uint32_t magic_;
+    uint16_t version_;
+    uint8_t key_size_;
+    uint8_t little_endian_;
+    uint32_t record_size_;
+    uint32_t count_;
+    uint32_t root_;
+  };
+
+  static const uint32_t MAGIC = 0x49545641; // "AVTI" read as little-endian bytes
+  static const uint16_t VERSION = 1;
+
+// OPERATIONS
+
+  /**
+   * @return the offset of the first record
+   */
+  static uint32_t recordsOffset();
+
+  /**
+   * Link records [first, first + count) into a balanced subtree the same way
+   * AvlTree::buildFromSorted does.
+   *
+   * @return subtree root index or NONE
+   */
+  static uint32_t link(Record* records, uint32_t first, uint32_t count);
+
+// ATTRIBUTES
+
+  Record* records_;
+  uint32_t count_;
+  uint32_t root_;
+  bool writable_;
+  void* map_;
+  size_t map_size_;
+
+}; // class AvlTreeImage
+
+/////////////////////////////////////////////// INLINE /////////////////////////////////////////////
+
+/////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
+
+//============================================= LIFECYCLE ==========================================
+
+template<typename K, typename P>
+inline AvlTreeImage<K, P>::AvlTreeImage() :
+  records_(nullptr),
+  count_(0),
+  root_(NONE),
+  writable_(false),
+  map_(nullptr),
+  map_size_(0)
+{
+}
+
+template<typename K, typename P>
+inline AvlTreeImage<K, P>::~AvlTreeImage()
+{
+  detach();
+}
+
+//============================================= OPERATIONS =========================================
+
+template<typename K, typename P>
+template<typename T, typename F>
+int AvlTreeImage<K, P>::write(T& tree, Buff* buff, F&& payload, int buff_mod)
+{
+  uint32_t count = 0;
+
+  for (auto it = tree.begin(); it != tree.end(); ++it) {
+    ++count;
+  }
+
+  uint32_t bytes = imageSize(count);
+  if (buff->remaining() < bytes && buff->shift() < bytes
+      && Buff::EXTEND == (buff_mod & Buff::EXTEND)) {
+    buff->extend(bytes, buff_mod);
+  }
+  if (buff->remaining() < bytes) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  uint8_t* image = buff->write_ptr();
+  Record* records = reinterpret_cast<Record*>(image + recordsOffset());
+  uint32_t i = 0;
+
+  // Zero the image first, so padding bytes in the file are deterministic.
+  memset(image, 0, bytes);
+
+  for (auto it = tree.begin(); it != tree.end(); ++it, ++i) {
+    records[i].key_ = it->key();
+    payload(it.node(), &records[i].payload_);
+  }
+
+  Header header;
+  header.magic_ = MAGIC;
+  header.version_ = VERSION;
+  header.key_size_ = sizeof(K);
+  header.little_endian_ = ValueCodec::isLittleEndian();
+  header.record_size_ = sizeof(Record);
+  header.count_ = count;
+  header.root_ = link(records, 0, count);
+  memcpy(image, &header, sizeof(header));
+
+  buff->write_ptr() += bytes;
+  return 0;
+}
+
+template<typename K, typename P>
+inline uint32_t AvlTreeImage<K, P>::imageSize(uint32_t count)
+{
+  return recordsOffset() + count * sizeof(Record);
+}
+
+template<typename K, typename P>
+int AvlTreeImage<K, P>::attach(const uint8_t* data, uint32_t size, bool writable)
+{
+  detach();
+
+  Header header;
+
+  if (size < recordsOffset()
+      || 0 != reinterpret_cast<uintptr_t>(data) % alignof(Record)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  memcpy(&header, data, sizeof(header));
+
+  if (MAGIC != header.magic_ || VERSION != header.version_ || sizeof(K) != header.key_size_
+      || ValueCodec::isLittleEndian() != (0 != header.little_endian_)
+      || sizeof(Record) != header.record_size_
+      || header.count_ > (size - recordsOffset()) / sizeof(Record)
+      || (NONE != header.root_ && header.root_ >= header.count_)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  records_ = reinterpret_cast<Record*>(const_cast<uint8_t*>(data) + recordsOffset());
+  count_ = header.count_;
+  root_ = header.root_;
+  writable_ = writable;
+  return 0;
+}
+
+#if BTR_X86 > 0
+template<typename K, typename P>
+int AvlTreeImage<K, P>::map(const char* path, bool copy_on_write)
+{
+  detach();
+
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0) {
+    return -1;
+  }
+
+  struct stat st;
+
+  if (0 != fstat(fd, &st) || st.st_size <= 0 || uint64_t(st.st_size) > 0xFFFFFFFF) {
+    close(fd);
+    errno = EINVAL;
+    return -1;
+  }
+
+  // A private writable mapping is copy-on-write: pages are copied when first modified.
+  int prot = (copy_on_write ? PROT_READ | PROT_WRITE : PROT_READ);
+  void* p = mmap(nullptr, st.st_size, prot, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (MAP_FAILED == p) {
+    return -1;
+  }
+
+  if (0 != attach(static_cast<uint8_t*>(p), st.st_size, copy_on_write)) {
+    munmap(p, st.st_size);
+    errno = EINVAL;
+    return -1;
+  }
+
+  map_ = p;
+  map_size_ = st.st_size;
+  return 0;
+}
+#endif
+
+template<typename K, typename P>
+inline void AvlTreeImage<K, P>::detach()
+{
+#if BTR_X86 > 0
+  if (nullptr != map_) {
+    munmap(map_, map_size_);
+  }
+#endif
+  records_ = nullptr;
+  count_ = 0;
+  root_ = NONE;
+  writable_ = false;
+  map_ = nullptr;
+  map_size_ = 0;
+}
+
+template<typename K, typename P>
+inline uint32_t AvlTreeImage<K, P>::size() const
+{
+  return count_;
+}
+
+template<typename K, typename P>
+inline const typename AvlTreeImage<K, P>::Record* AvlTreeImage<K, P>::record(
+    uint32_t index) const
+{
+  return (index < count_ ? records_ + index : nullptr);
+}
+
+template<typename K, typename P>
+inline const typename AvlTreeImage<K, P>::Record* AvlTreeImage<K, P>::search(K key) const
+{
+  uint32_t i = root_;
+
+  // The depth bound guards against corrupt child indices forming a cycle.
+  for (uint8_t depth = 0; NONE != i && i < count_ && depth < 64; depth++) {
+    const Record* r = records_ + i;
+
+    if (key < r->key_) {
+      i = r->left_;
+    } else if (r->key_ < key) {
+      i = r->right_;
+    } else {
+      return r;
+    }
+  }
+  return nullptr;
+}
+
+template<typename K, typename P>
+inline typename AvlTreeImage<K, P>::Record* AvlTreeImage<K, P>::mutableSearch(K key)
+{
+  return (writable_ ? const_cast<Record*>(search(key)) : nullptr);
+}
+
+template<typename K, typename P>
+template<typename F>
+int AvlTreeImage<K, P>::visit(F&& visitor, K key_min, K key_max) const
+{
+  // Records are in key order, so find the first one in range and scan.
+  uint32_t lower = count_;
+  uint32_t i = root_;
+
+  for (uint8_t depth = 0; NONE != i && i < count_ && depth < 64; depth++) {
+    if (records_[i].key_ < key_min) {
+      i = records_[i].right_;
+    } else {
+      lower = i;
+      i = records_[i].left_;
+    }
+  }
+
+  for (i = lower; i < count_ && !(key_max < records_[i].key_); i++) {
+    if (-1 == visitor(records_ + i)) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/////////////////////////////////////////////// PRIVATE ////////////////////////////////////////////
+
+//============================================= OPERATIONS =========================================
+
+template<typename K, typename P>
+inline uint32_t AvlTreeImage<K, P>::recordsOffset()
+{
+  return ((sizeof(Header) + alignof(Record) - 1) / alignof(Record)) * alignof(Record);
+}
+
+template<typename K, typename P>
+uint32_t AvlTreeImage<K, P>::link(Record* records, uint32_t first, uint32_t count)
+{
+  if (0 == count) {
+    return NONE;
+  }
+
+  uint32_t left_count = (count - 1) / 2;
+  uint32_t i = first + left_count;
+  Record& r = records[i];
+
+  r.left_ = link(records, first, left_count);
+  r.right_ = link(records, i + 1, count - 1 - left_count);
+
+  int16_t lh = (NONE == r.left_ ? 0 : records[r.left_].height_);
+  int16_t rh = (NONE == r.right_ ? 0 : records[r.right_].height_);
+  r.height_ = (lh > rh ? lh : rh) + 1;
+  return i;
+}
+
+} // namespace btr
+
+#endif // _btr_AvlTreeImage_hpp_
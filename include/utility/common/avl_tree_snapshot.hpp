@@ -0,0 +1,434 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+#ifndef _btr_AvlTreeSnapshot_hpp_
+#define _btr_AvlTreeSnapshot_hpp_
+
+// SYSTEM INCLUDES
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+
+#if BTR_X86 > 0 && defined(__SSE2__)
+#define BTR_AVL_SNAPSHOT_SSE2 1
+#include <emmintrin.h>
+#include <type_traits>
+#endif
+
+namespace btr
+{
+
+#if BTR_AVL_SNAPSHOT_SSE2 > 0
+/**
+ * SSE2 descent through four levels of an Eytzinger array at once. Keys are sorted in order, so
+ * the number of the 15 keys of the four levels below slot k that are less than key is the path
+ * down to slot 16k + count. Specializations cover 2- and 4-byte integer keys, other keys use the
+ * scalar loop.
+ */
+template<typename K, uint32_t W = (std::is_integral<K>::value ? sizeof(K) : 0)>
+struct EytzingerSse2
+{
+  static const bool SUPPORTED = false;
+
+  static uint32_t descend(const K* keys, uint32_t k, K key)
+  {
+    (void)keys;
+    (void)key;
+    return k;
+  }
+};
+
+template<typename K>
+struct EytzingerSse2<K, 4>
+{
+  static const bool SUPPORTED = true;
+
+  /**
+   * @param keys - keys in Eytzinger order, slots up to 8k + 7 must exist
+   * @return the slot four levels below k on the path to key
+   */
+  static uint32_t descend(const K* keys, uint32_t k, K key)
+  {
+    // SSE2 only compares signed lanes. Flipping the sign bit keeps the order of unsigned keys.
+    const int32_t bias = (std::is_signed<K>::value ? 0 : INT32_MIN);
+    __m128i needle = _mm_set1_epi32(int32_t(key) ^ bias);
+    __m128i flip = _mm_set1_epi32(bias);
+
+    __m128i l2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + 4 * k));
+    __m128i l3a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + 8 * k));
+    __m128i l3b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + 8 * k + 4));
+
+    uint32_t mask =
+      uint32_t(_mm_movemask_epi8(_mm_cmplt_epi32(_mm_xor_si128(l2, flip), needle))) |
+      (uint32_t(_mm_movemask_epi8(_mm_cmplt_epi32(_mm_xor_si128(l3a, flip), needle))) << 16);
+    uint32_t count = uint32_t(__builtin_popcount(mask)) / 4 +
+      uint32_t(__builtin_popcount(
+        uint32_t(_mm_movemask_epi8(_mm_cmplt_epi32(_mm_xor_si128(l3b, flip), needle))))) / 4 +
+      (keys[k] < key) + (keys[2 * k] < key) + (keys[2 * k + 1] < key);
+
+    return 16 * k + count;
+  }
+};
+
+template<typename K>
+struct EytzingerSse2<K, 2>
+{
+  static const bool SUPPORTED = true;
+
+  /**
+   * @see EytzingerSse2<K, 4>::descend
+   */
+  static uint32_t descend(const K* keys, uint32_t k, K key)
+  {
+    const int16_t bias = (std::is_signed<K>::value ? 0 : INT16_MIN);
+    __m128i needle = _mm_set1_epi16(int16_t(int16_t(key) ^ bias));
+    __m128i flip = _mm_set1_epi16(bias);
+
+    // Level two is four keys in the low half of the register. The upper half is ignored.
+    __m128i l2 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(keys + 4 * k));
+    __m128i l3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + 8 * k));
+
+    uint32_t mask =
+      (uint32_t(_mm_movemask_epi8(_mm_cmplt_epi16(_mm_xor_si128(l2, flip), needle))) & 0xFF) |
+      (uint32_t(_mm_movemask_epi8(_mm_cmplt_epi16(_mm_xor_si128(l3, flip), needle))) << 8);
+    uint32_t count = uint32_t(__builtin_popcount(mask)) / 2 +
+      (keys[k] < key) + (keys[2 * k] < key) + (keys[2 * k + 1] < key);
+
+    return 16 * k + count;
+  }
+};
+#endif // BTR_AVL_SNAPSHOT_SSE2 > 0
+
+/**
+ * The class represents a read-only snapshot of AvlTree keys in Eytzinger (BFS) order.
+ *
+ * Keys are stored in one contiguous array where the children of slot k are slots 2k and 2k + 1,
+ * so a search touches consecutive cache lines near the top of the tree and needs no pointer
+ * chasing. The search loop has no data-dependent branches, which lets the CPU prefetch
+ * descendants ahead of the comparison. On x86, 2- and 4-byte integer keys are compared with SSE2
+ * four levels at a time. A parallel array maps each slot to the tree node.
+ *
+ * IMPORTANT: The snapshot refers to tree nodes. Re-freeze it after the tree is modified.
+ *
+ * IMPORTANT: The class is shared by AVR and x86 platforms. Keep it portable.
+ */
+template <typename N, typename K = uint16_t>
+class AvlTreeSnapshot
+{
+public:
+
+// LIFECYCLE
+
+  /**
+   * Create an empty snapshot.
+   */
+  AvlTreeSnapshot();
+  AvlTreeSnapshot(const AvlTreeSnapshot&) = delete;
+  AvlTreeSnapshot& operator=(const AvlTreeSnapshot&) = delete;
+
+  /**
+   * Release the arrays.
+   */
+  ~AvlTreeSnapshot();
+
+// OPERATIONS
+
+  /**
+   * Replace the snapshot with the current keys of a tree.
+   *
+   * @param tree - AvlTree or any tree providing in-order begin()/end() iterators
+   * @return 0 on success, otherwise -1 and errno is set to ENOMEM. The snapshot is then empty
+   */
+  template<typename T>
+  int freeze(T& tree);
+
+  /**
+   * @return the number of keys
+   */
+  uint32_t size() const;
+
+  /**
+   * @return the node with the given key or nullptr
+   */
+  N* search(K key) const;
+
+  /**
+   * @return the node with the smallest key not less than key or nullptr
+   */
+  N* lowerBound(K key) const;
+
+  /**
+   * @return the node with the smallest key greater than key or nullptr
+   */
+  N* upperBound(K key) const;
+
+  /**
+   * Provide the range of nodes matching key, like AvlTree::equalRange(). Use visit() with the
+   * same key as both bounds to walk it.
+   *
+   * @param key - the key to look up
+   * @param first - set to lowerBound(key)
+   * @param last - set to upperBound(key)
+   */
+  void equalRange(K key, N** first, N** last) const;
+
+  /**
+   * Visit nodes in key order.
+   *
+   * @param visitor - callable taking N* and returning -1 to stop, 0 to continue
+   * @return -1 if the visitor stopped the traversal, 0 otherwise
+   */
+  template<typename F>
+  int visit(F&& visitor) const;
+
+  /**
+   * Visit nodes with keys in [key_min, key_max] in key order.
+   *
+   * @see visit(F&&)
+   */
+  template<typename F>
+  int visit(F&& visitor, K key_min, K key_max) const;
+
+private:
+
+// OPERATIONS
+
+  /**
+   * @return the slot of the smallest key not less than key or 0
+   */
+  uint32_t lowerSlot(K key) const;
+
+  /**
+   * @return the slot of the smallest key greater than key or 0
+   */
+  uint32_t upperSlot(K key) const;
+
+  /**
+   * @return the leftmost slot of the implicit tree or 0 if it's empty
+   */
+  uint32_t firstSlot() const;
+
+  /**
+   * @return the slot following slot k in key order or 0
+   */
+  uint32_t nextSlot(uint32_t k) const;
+
+  void release();
+
+// ATTRIBUTES
+
+  /** Keys in Eytzinger order starting at index 1. */
+  K* keys_;
+  /** Nodes in the same order as keys. */
+  N** nodes_;
+  uint32_t size_;
+
+}; // class AvlTreeSnapshot
+
+/////////////////////////////////////////////// INLINE /////////////////////////////////////////////
+
+/////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
+
+//============================================= LIFECYCLE ==========================================
+
+template<typename N, typename K>
+inline AvlTreeSnapshot<N, K>::AvlTreeSnapshot() :
+  keys_(nullptr),
+  nodes_(nullptr),
+  size_(0)
+{
+}
+
+template<typename N, typename K>
+inline AvlTreeSnapshot<N, K>::~AvlTreeSnapshot()
+{
+  release();
+}
+
+//============================================= OPERATIONS =========================================
+
+template<typename N, typename K>
+template<typename T>
+int AvlTreeSnapshot<N, K>::freeze(T& tree)
+{
+  release();
+
+  uint32_t count = 0;
+
+  for (auto it = tree.begin(); it != tree.end(); ++it) {
+    ++count;
+  }
+
+  if (0 == count) {
+    return 0;
+  }
+
+  keys_ = static_cast<K*>(malloc((count + 1) * sizeof(K)));
+  nodes_ = static_cast<N**>(malloc((count + 1) * sizeof(N*)));
+
+  if (nullptr == keys_ || nullptr == nodes_) {
+    release();
+    errno = ENOMEM;
+    return -1;
+  }
+
+  // Walking the implicit tree in order visits slots in key order, matching the tree iterator.
+  size_ = count;
+  uint32_t k = firstSlot();
+
+  for (auto it = tree.begin(); it != tree.end(); ++it) {
+    keys_[k] = it->key();
+    nodes_[k] = it.node();
+    k = nextSlot(k);
+  }
+  return 0;
+}
+
+template<typename N, typename K>
+inline uint32_t AvlTreeSnapshot<N, K>::size() const
+{
+  return size_;
+}
+
+template<typename N, typename K>
+inline N* AvlTreeSnapshot<N, K>::search(K key) const
+{
+  uint32_t k = lowerSlot(key);
+  return (0 != k && keys_[k] == key ? nodes_[k] : nullptr);
+}
+
+template<typename N, typename K>
+inline N* AvlTreeSnapshot<N, K>::lowerBound(K key) const
+{
+  uint32_t k = lowerSlot(key);
+  return (0 != k ? nodes_[k] : nullptr);
+}
+
+template<typename N, typename K>
+inline N* AvlTreeSnapshot<N, K>::upperBound(K key) const
+{
+  uint32_t k = upperSlot(key);
+  return (0 != k ? nodes_[k] : nullptr);
+}
+
+template<typename N, typename K>
+inline void AvlTreeSnapshot<N, K>::equalRange(K key, N** first, N** last) const
+{
+  uint32_t k = lowerSlot(key);
+  *first = (0 != k ? nodes_[k] : nullptr);
+
+  if (0 != k && keys_[k] == key) {
+    k = nextSlot(k);
+  }
+  *last = (0 != k ? nodes_[k] : nullptr);
+}
+
+template<typename N, typename K>
+template<typename F>
+inline int AvlTreeSnapshot<N, K>::visit(F&& visitor) const
+{
+  for (uint32_t k = firstSlot(); 0 != k; k = nextSlot(k)) {
+    if (-1 == visitor(nodes_[k])) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+template<typename N, typename K>
+template<typename F>
+inline int AvlTreeSnapshot<N, K>::visit(F&& visitor, K key_min, K key_max) const
+{
+  for (uint32_t k = lowerSlot(key_min); 0 != k && !(key_max < keys_[k]); k = nextSlot(k)) {
+    if (-1 == visitor(nodes_[k])) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/////////////////////////////////////////////// PRIVATE ////////////////////////////////////////////
+
+//============================================= OPERATIONS =========================================
+
+template<typename N, typename K>
+inline uint32_t AvlTreeSnapshot<N, K>::lowerSlot(K key) const
+{
+  uint32_t k = 1;
+
+#if BTR_AVL_SNAPSHOT_SSE2 > 0
+  if (EytzingerSse2<K>::SUPPORTED) {
+    while (8 * k + 7 <= size_) {
+      k = EytzingerSse2<K>::descend(keys_, k, key);
+    }
+  }
+#endif
+
+  while (k <= size_) {
+#if BTR_X86 > 0
+    // Four levels down, the 16 descendants of k share a cache line for 4-byte keys.
+    __builtin_prefetch(keys_ + 16 * k);
+#endif
+    k = 2 * k + (keys_[k] < key);
+  }
+
+  // The path went right after the last slot where the key wasn't less. Drop those trailing
+  // right turns (ones) and the final left turn.
+  return (k >> __builtin_ffsl(~k));
+}
+
+template<typename N, typename K>
+inline uint32_t AvlTreeSnapshot<N, K>::upperSlot(K key) const
+{
+  uint32_t k = lowerSlot(key);
+  return (0 != k && keys_[k] == key ? nextSlot(k) : k);
+}
+
+template<typename N, typename K>
+inline uint32_t AvlTreeSnapshot<N, K>::firstSlot() const
+{
+  uint32_t k = (0 == size_ ? 0 : 1);
+
+  while (0 != k && 2 * k <= size_) {
+    k *= 2;
+  }
+  return k;
+}
+
+template<typename N, typename K>
+inline uint32_t AvlTreeSnapshot<N, K>::nextSlot(uint32_t k) const
+{
+  if (2 * k + 1 <= size_) {
+    k = 2 * k + 1;
+
+    while (2 * k <= size_) {
+      k *= 2;
+    }
+    return k;
+  }
+
+  // Climb while coming from a right child. The next parent is the successor.
+  while (k & 1) {
+    k >>= 1;
+  }
+  return (k >> 1);
+}
+
+template<typename N, typename K>
+inline void AvlTreeSnapshot<N, K>::release()
+{
+  free(keys_);
+  free(nodes_);
+  keys_ = nullptr;
+  nodes_ = nullptr;
+  size_ = 0;
+}
+
+} // namespace btr
+
+#endif // _btr_AvlTreeSnapshot_hpp_
@@ -30,6 +30,10 @@ using namespace std;
 
 #include <inttypes.h>
 
+#if BTR_X86 > 0
+#include <sys/mman.h>
+#endif
+
 namespace btr
 {
 
@@ -55,7 +59,7 @@ namespace btr
 /**
  * The class provides raw data container and access methods to that data.
  *
- * IMPORTANT: The class is shared by AVR and x86 plaforms. Keep it portable.
+ * IMPORTANT: The class is shared by AVR and x86 platforms. Keep it portable.
  */
 class Buff
 {
@@ -69,14 +73,30 @@ public:
     MOD_ALL = EXTEND | RESERVE | MINIMAL
   };
 
+  /** Where the buffer's memory comes from. */
+  enum ALLOC {
+    /** Heap memory from malloc/realloc. */
+    ALLOC_HEAP    = 0,
+    /** x86: anonymous mapping advised to use transparent huge pages. Heap elsewhere. */
+    ALLOC_THP     = 1,
+    /** x86: explicit huge pages (MAP_HUGETLB). Falls back to ALLOC_THP if none are reserved. */
+    ALLOC_HUGETLB = 2
+  };
+
+  /** Alignment that keeps the buffer within cache lines for aligned SIMD loads. */
+  static const uint16_t CACHE_LINE = 64;
+
 // LIFECYCLE
 
   /**
    * Create a buffer object with the requested,  dynamically allocated memory.
    *
    * @param capacity - the initial buffer's capacity
+   * @param alignment - the alignment of data(), a power of two. 0 or 1 for no requirement.
+   *  Mapped memory (ALLOC_THP, ALLOC_HUGETLB) is always page-aligned.
+   * @param alloc - memory source, @see ALLOC
    */
-  Buff(uint32_t capacity = 128);
+  Buff(uint32_t capacity = 128, uint16_t alignment = 0, uint8_t alloc = ALLOC_HEAP);
 
   /**
    * Dtor.
@@ -117,6 +137,16 @@ public:
    */
   uint32_t remaining() const;
 
+  /**
+   * @return the requested alignment of data()
+   */
+  uint16_t alignment() const;
+
+  /**
+   * @return the memory source in effect, @see ALLOC
+   */
+  uint8_t alloc() const;
+
 // OPERATIONS
 
   /**
@@ -161,7 +191,8 @@ public:
 
   /**
    * Reserve memory for the buffer. The data is preserved only if the new capacity is
-   * greater than or equal to the previous size.
+   * greater than or equal to the previous size. The alignment and memory source given at
+   * construction are retained.
    *
    * IMPORTANT: This call uses expensive dynamic-memory manipulation functions. If this is
    * a concern, allocate the maximum required number of bytes when creating the buffer, and
@@ -223,6 +254,51 @@ public:
 
 private:
 
+// OPERATIONS
+
+  /**
+   * Allocate memory according to alignment_ and alloc_.
+   *
+   * @param capacity - usable bytes
+   * @param raw - the start of allocated block to pass to deallocate()
+   * @return aligned start of usable memory or nullptr
+   */
+  uint8_t* allocate(uint32_t capacity, uint8_t** raw);
+
+  /**
+   * Resize the current block preserving min(capacity_, new_capacity) bytes and the alignment.
+   *
+   * @param new_capacity - usable bytes
+   * @param raw - the start of allocated block to pass to deallocate()
+   * @return aligned start of usable memory or nullptr, in which case the current block is intact
+   */
+  uint8_t* reallocate(uint32_t new_capacity, uint8_t** raw);
+
+  /**
+   * Release the memory block.
+   *
+   * @param raw - the block start
+   * @param capacity - usable bytes the block was allocated for
+   */
+  void deallocate(uint8_t* raw, uint32_t capacity);
+
+  /**
+   * @return the first address at or after raw that satisfies alignment_
+   */
+  uint8_t* align(uint8_t* raw) const;
+
+  /**
+   * @return the number of bytes to allocate on the heap for the given usable capacity
+   */
+  uint32_t heapSize(uint32_t capacity) const;
+
+#if BTR_X86 > 0
+  /**
+   * @return the length of a mapping backing the given capacity, rounded up to huge page size
+   */
+  static size_t mappedSize(uint32_t capacity);
+#endif
+
 // ATTRIBUTES
 
   uint32_t capacity_;
@@ -230,6 +306,9 @@ private:
   uint8_t* data_;
   uint8_t* read_ptr_;
   uint8_t* write_ptr_;
+  uint8_t* raw_;
+  uint16_t alignment_;
+  uint8_t alloc_;
 
 }; // class Buff
 
@@ -239,19 +318,31 @@ private:
 
 //============================================= LIFECYCLE ==========================================
 
-inline Buff::Buff(uint32_t capacity)
+inline Buff::Buff(uint32_t capacity, uint16_t alignment, uint8_t alloc)
   :
   capacity_(capacity),
   size_(capacity),
-  data_(new uint8_t[capacity_]),
-  read_ptr_(data_),
-  write_ptr_(data_)
+  data_(nullptr),
+  read_ptr_(nullptr),
+  write_ptr_(nullptr),
+  raw_(nullptr),
+  alignment_(alignment > 1 ? alignment : 1),
+  alloc_(alloc)
 {
+  data_ = allocate(capacity_, &raw_);
+
+  if (nullptr == data_) {
+    capacity_ = 0;
+    size_ = 0;
+  }
+  read_ptr_ = data_;
+  write_ptr_ = data_;
 }
 
 inline Buff::~Buff()
 {
-  delete [] data_;
+  deallocate(raw_, capacity_);
+  raw_ = nullptr;
   data_ = nullptr;
   read_ptr_ = nullptr;
   write_ptr_ = nullptr;
@@ -314,6 +405,16 @@ inline uint32_t Buff::remaining() const
   return ((data_ + size_) - write_ptr_);
 }
 
+inline uint16_t Buff::alignment() const
+{
+  return alignment_;
+}
+
+inline uint8_t Buff::alloc() const
+{
+  return alloc_;
+}
+
 //============================================= OPERATIONS =========================================
 
 inline void Buff::reset()
@@ -401,9 +502,11 @@ inline bool Buff::reserve(uint32_t new_capacity)
 
   uint32_t read_offset = read_ptr_ - data_;
   uint32_t write_offset = write_ptr_ - data_;
-  uint8_t* data = (uint8_t*) realloc(data_, new_capacity * sizeof(uint8_t));
+  uint8_t* raw = raw_;
+  uint8_t* data = reallocate(new_capacity, &raw);
 
   if (data != nullptr) {
+    raw_ = raw;
     capacity_ = new_capacity;
     size_ = (size_ <= capacity_ ? size_ : capacity_);
 
@@ -498,6 +601,125 @@ inline bool Buff::write(const T (&vals)[COUNT], int buff_mod)
   return success;
 }
 
+/////////////////////////////////////////////// PRIVATE ////////////////////////////////////////////
+
+//============================================= OPERATIONS =========================================
+
+inline uint8_t* Buff::allocate(uint32_t capacity, uint8_t** raw)
+{
+#if BTR_X86 > 0
+  if (ALLOC_HEAP != alloc_) {
+    size_t bytes = mappedSize(capacity);
+    void* p = MAP_FAILED;
+
+    if (ALLOC_HUGETLB == alloc_) {
+      p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+    if (MAP_FAILED == p) {
+      // No explicit huge pages are reserved. Let the kernel back the mapping with transparent
+      // huge pages where it can.
+      p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+      if (MAP_FAILED == p) {
+        *raw = nullptr;
+        return nullptr;
+      }
+      madvise(p, bytes, MADV_HUGEPAGE);
+      alloc_ = ALLOC_THP;
+    }
+    *raw = static_cast<uint8_t*>(p);
+    return *raw;
+  }
+#endif
+
+  *raw = (uint8_t*) malloc(heapSize(capacity));
+  return (nullptr == *raw ? nullptr : align(*raw));
+}
+
+inline uint8_t* Buff::reallocate(uint32_t new_capacity, uint8_t** raw)
+{
+#if BTR_X86 > 0
+  if (ALLOC_HEAP != alloc_) {
+    size_t old_bytes = mappedSize(capacity_);
+    size_t new_bytes = mappedSize(new_capacity);
+
+    if (old_bytes == new_bytes) {
+      return data_;
+    }
+
+    // The kernel moves page-table entries rather than the data. Mappings stay page-aligned.
+    void* p = mremap(*raw, old_bytes, new_bytes, MREMAP_MAYMOVE);
+
+    if (MAP_FAILED == p) {
+      return nullptr;
+    }
+    *raw = static_cast<uint8_t*>(p);
+    return *raw;
+  }
+#endif
+
+  uint32_t offset = data_ - *raw;
+  uint8_t* new_raw = (uint8_t*) realloc(*raw, heapSize(new_capacity));
+
+  if (nullptr == new_raw) {
+    return nullptr;
+  }
+
+  // realloc keeps the bytes at the same offset from the block start, but the new block may have
+  // different alignment. Move the data to the aligned position.
+  //
+  uint8_t* data = align(new_raw);
+
+  if (data != new_raw + offset) {
+    uint32_t bytes = (capacity_ < new_capacity ? capacity_ : new_capacity);
+    memmove(data, new_raw + offset, bytes);
+  }
+
+  *raw = new_raw;
+  return data;
+}
+
+inline void Buff::deallocate(uint8_t* raw, uint32_t capacity)
+{
+  if (nullptr == raw) {
+    return;
+  }
+
+#if BTR_X86 > 0
+  if (ALLOC_HEAP != alloc_) {
+    munmap(raw, mappedSize(capacity));
+    return;
+  }
+#else
+  (void) capacity;
+#endif
+
+  free(raw);
+}
+
+inline uint8_t* Buff::align(uint8_t* raw) const
+{
+  uintptr_t addr = reinterpret_cast<uintptr_t>(raw);
+  uintptr_t mask = uintptr_t(alignment_) - 1;
+  return reinterpret_cast<uint8_t*>((addr + mask) & ~mask);
+}
+
+inline uint32_t Buff::heapSize(uint32_t capacity) const
+{
+  // Over-allocate so that an aligned start with capacity bytes fits in the block.
+  return ((capacity > 0 ? capacity : 1) + (alignment_ - 1));
+}
+
+#if BTR_X86 > 0
+inline size_t Buff::mappedSize(uint32_t capacity)
+{
+  const size_t huge_page = 2 * 1024 * 1024;
+  size_t bytes = (capacity > 0 ? capacity : 1);
+  return ((bytes + huge_page - 1) & ~(huge_page - 1));
+}
+#endif
+
 } // namespace btr
 
 #endif // _btr_Buff_hpp_
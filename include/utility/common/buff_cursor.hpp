@@ -0,0 +1,334 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+#ifndef _btr_BuffCursor_hpp_
+#define _btr_BuffCursor_hpp_
+
+// SYSTEM INCLUDES
+#include <errno.h>
+
+// PROJECT INCLUDES
+#include "utility/common/buff.hpp"
+#include "utility/common/value_codec.hpp"
+
+namespace btr
+{
+
+/**
+ * The class decodes a multi-field message from a buffer with a single bounds check.
+ *
+ * The constructor validates that the whole message is available. Each get() is then an unchecked
+ * load with the byte order fixed at compile time. If validation fails, the cursor reads zeros
+ * from an internal scratch area and never advances, so the caller may decode all fields
+ * unconditionally and check the outcome once with finish().
+ *
+ * IMPORTANT: The caller must not read more bytes than requested in the constructor. finish()
+ * reports such overrun, but the bytes were read by then.
+ *
+ * IMPORTANT: The class is shared by AVR and x86 platforms. Keep it portable.
+ */
+template<bool MSB = true>
+class BuffReader
+{
+public:
+
+// LIFECYCLE
+
+  /**
+   * Ctor.
+   *
+   * @param buff - the buffer to read from
+   * @param bytes - the message length to validate
+   */
+  BuffReader(Buff* buff, uint32_t bytes);
+
+// OPERATIONS
+
+  /**
+   * @return true if the requested message length is available
+   */
+  bool ok() const;
+
+  /**
+   * @return the number of bytes read so far
+   */
+  uint32_t consumed() const;
+
+  /**
+   * Decode a fixed-size integer without bounds checking.
+   *
+   * @param val - target value
+   */
+  template<typename T>
+  void get(T* val);
+
+  /**
+   * Copy raw bytes without bounds checking.
+   *
+   * @param vals - the storage for the data
+   * @param count - the number of bytes
+   */
+  void get(uint8_t* vals, uint32_t count);
+
+  /**
+   * Skip bytes without bounds checking.
+   *
+   * @param count - the number of bytes to skip
+   */
+  void skip(uint32_t count);
+
+  /**
+   * Advance buffer's read pointer by the consumed bytes if the message was valid.
+   *
+   * @return 0 on success, otherwise -1 and errno is set to ERANGE
+   */
+  int finish();
+
+private:
+
+// ATTRIBUTES
+
+  Buff* buff_;
+  const uint8_t* ptr_;
+  const uint8_t* start_;
+  const uint8_t* end_;
+  /** All ones if the message is valid, 0 otherwise. Masks the pointer increments. */
+  uint32_t mask_;
+  /** Read source when validation fails. */
+  uint8_t zeros_[sizeof(uint64_t)];
+
+}; // class BuffReader
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * The class encodes a multi-field message into a buffer with a single capacity check.
+ *
+ * The constructor reserves space for the whole message. Each put() is then an unchecked store
+ * with the byte order fixed at compile time. If the reservation fails, the cursor writes into
+ * an internal scratch area and never advances. finish() commits the message by moving buffer's
+ * write pointer.
+ *
+ * IMPORTANT: The caller must not write more bytes than requested in the constructor.
+ */
+template<bool MSB = true>
+class BuffWriter
+{
+public:
+
+// LIFECYCLE
+
+  /**
+   * Ctor.
+   *
+   * @param buff - the buffer to write to
+   * @param bytes - the message length to reserve
+   * @param buff_mod - how to gain space if the buffer is short, @see Buff::write()
+   */
+  BuffWriter(Buff* buff, uint32_t bytes, int buff_mod = Buff::MOD_ALL);
+
+// OPERATIONS
+
+  /**
+   * @return true if the requested message length was reserved
+   */
+  bool ok() const;
+
+  /**
+   * @return the number of bytes written so far
+   */
+  uint32_t written() const;
+
+  /**
+   * Encode a fixed-size integer without bounds checking.
+   *
+   * @param val - the value to encode
+   */
+  template<typename T>
+  void put(T val);
+
+  /**
+   * Copy raw bytes without bounds checking.
+   *
+   * @param vals - the data to write
+   * @param count - the number of bytes
+   */
+  void put(const uint8_t* vals, uint32_t count);
+
+  /**
+   * Move buffer's write pointer past the written bytes if the reservation succeeded.
+   *
+   * @return 0 on success, otherwise -1 and errno is set to ERANGE
+   */
+  int finish();
+
+private:
+
+// ATTRIBUTES
+
+  Buff* buff_;
+  uint8_t* ptr_;
+  uint8_t* start_;
+  uint8_t* end_;
+  /** All ones if the space is reserved, 0 otherwise. Masks the pointer increments. */
+  uint32_t mask_;
+  /** Write target when reservation fails. */
+  uint8_t sink_[sizeof(uint64_t)];
+
+}; // class BuffWriter
+
+/////////////////////////////////////////////// INLINE /////////////////////////////////////////////
+
+/////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
+
+//============================================= LIFECYCLE ==========================================
+
+template<bool MSB>
+inline BuffReader<MSB>::BuffReader(Buff* buff, uint32_t bytes)
+  :
+    buff_(buff),
+    ptr_(nullptr),
+    start_(nullptr),
+    end_(nullptr),
+    mask_(0),
+    zeros_()
+{
+  if (buff->available() >= bytes) {
+    start_ = buff->read_ptr();
+    end_ = start_ + bytes;
+    mask_ = ~uint32_t(0);
+  } else {
+    start_ = zeros_;
+    end_ = zeros_;
+  }
+  ptr_ = start_;
+}
+
+template<bool MSB>
+inline BuffWriter<MSB>::BuffWriter(Buff* buff, uint32_t bytes, int buff_mod)
+  :
+    buff_(buff),
+    ptr_(nullptr),
+    start_(nullptr),
+    end_(nullptr),
+    mask_(0),
+    sink_()
+{
+  bool success = (buff->remaining() >= bytes);
+
+  if (!success) {
+    success = (buff->shift() >= bytes);
+  }
+  if (!success && ((buff_mod & Buff::EXTEND) == Buff::EXTEND)) {
+    success = buff->extend(bytes, buff_mod | Buff::MINIMAL);
+  }
+
+  if (success) {
+    start_ = buff->write_ptr();
+    end_ = start_ + bytes;
+    mask_ = ~uint32_t(0);
+  } else {
+    start_ = sink_;
+    end_ = sink_;
+  }
+  ptr_ = start_;
+}
+
+//============================================= OPERATIONS =========================================
+
+template<bool MSB>
+inline bool BuffReader<MSB>::ok() const
+{
+  return (0 != mask_);
+}
+
+template<bool MSB>
+inline uint32_t BuffReader<MSB>::consumed() const
+{
+  return (ptr_ - start_);
+}
+
+template<bool MSB>
+template<typename T>
+inline void BuffReader<MSB>::get(T* val)
+{
+  static_assert(sizeof(T) <= sizeof(uint64_t), "Use get(vals, count) for wider values");
+
+  ValueCodec::decodeFixedInt<MSB>(ptr_, val);
+  ptr_ += (sizeof(T) & mask_);
+}
+
+template<bool MSB>
+inline void BuffReader<MSB>::get(uint8_t* vals, uint32_t count)
+{
+  count &= mask_;
+  memcpy(vals, ptr_, count);
+  ptr_ += count;
+}
+
+template<bool MSB>
+inline void BuffReader<MSB>::skip(uint32_t count)
+{
+  ptr_ += (count & mask_);
+}
+
+template<bool MSB>
+inline int BuffReader<MSB>::finish()
+{
+  if (ok() && ptr_ <= end_) {
+    buff_->advanceReadPtr(consumed());
+    return 0;
+  }
+  errno = ERANGE;
+  return -1;
+}
+
+template<bool MSB>
+inline bool BuffWriter<MSB>::ok() const
+{
+  return (0 != mask_);
+}
+
+template<bool MSB>
+inline uint32_t BuffWriter<MSB>::written() const
+{
+  return (ptr_ - start_);
+}
+
+template<bool MSB>
+template<typename T>
+inline void BuffWriter<MSB>::put(T val)
+{
+  static_assert(sizeof(T) <= sizeof(uint64_t), "Use put(vals, count) for wider values");
+
+  ValueCodec::encodeFixedInt<MSB>(ptr_, val);
+  ptr_ += (sizeof(T) & mask_);
+}
+
+template<bool MSB>
+inline void BuffWriter<MSB>::put(const uint8_t* vals, uint32_t count)
+{
+  count &= mask_;
+  memcpy(ptr_, vals, count);
+  ptr_ += count;
+}
+
+template<bool MSB>
+inline int BuffWriter<MSB>::finish()
+{
+  if (ok() && ptr_ <= end_) {
+    buff_->write_ptr() = ptr_;
+    return 0;
+  }
+  errno = ERANGE;
+  return -1;
+}
+
+} // namespace btr
+
+#endif // _btr_BuffCursor_hpp_
@@ -0,0 +1,187 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+#ifndef _btr_BuffSlice_hpp_
+#define _btr_BuffSlice_hpp_
+
+// SYSTEM INCLUDES
+
+// PROJECT INCLUDES
+#include "utility/common/buff.hpp"
+#include "utility/common/shared_ptr.hpp"
+
+namespace btr
+{
+
+/**
+ * The class represents an immutable view of a byte range within a shared Buff.
+ *
+ * Copying a slice shares the backing buffer and costs one reference-count increment, so one
+ * received frame can be handed to several consumers without copying its bytes. A consumer that
+ * needs to modify the bytes calls mutableData(), which copies the range into a private buffer
+ * only if the backing buffer is shared.
+ *
+ * IMPORTANT: The class is shared by AVR and x86 platforms. Keep it portable.
+ */
+class BuffSlice
+{
+public:
+
+// LIFECYCLE
+
+  /**
+   * Create an empty slice.
+   */
+  BuffSlice();
+
+  /**
+   * Take ownership of a dynamically allocated buffer and view its available bytes, i.e. the
+   * bytes between read and write pointers.
+   *
+   * @param buff - the buffer, deleted when the last slice referencing it is destroyed
+   */
+  explicit BuffSlice(Buff* buff);
+
+  /**
+   * View a range of a shared buffer.
+   *
+   * @param buff - the backing buffer
+   * @param offset - the range start relative to buffer's data()
+   * @param size - the range length
+   */
+  BuffSlice(const SharedPtr<Buff>& buff, uint32_t offset, uint32_t size);
+
+// OPERATIONS
+
+  /**
+   * @return the first byte of the range
+   */
+  const uint8_t* data() const;
+
+  /**
+   * @return the number of bytes in the range
+   */
+  uint32_t size() const;
+
+  /**
+   * @return the number of slices sharing the backing buffer
+   */
+  int refs() const;
+
+  /**
+   * Create a sub-range of this slice sharing the same backing buffer. The range is clipped to
+   * this slice's bounds.
+   *
+   * @param offset - the sub-range start relative to this slice's data()
+   * @param size - the sub-range length
+   * @return the new slice
+   */
+  BuffSlice slice(uint32_t offset, uint32_t size) const;
+
+  /**
+   * Provide writable access to the range. If the backing buffer is shared, the range is first
+   * copied into a buffer owned by this slice alone.
+   *
+   * @return the first byte of the range or nullptr if the range couldn't be copied
+   */
+  uint8_t* mutableData();
+
+private:
+
+// ATTRIBUTES
+
+  SharedPtr<Buff> buff_;
+  uint32_t offset_;
+  uint32_t size_;
+
+}; // class BuffSlice
+
+/////////////////////////////////////////////// INLINE /////////////////////////////////////////////
+
+/////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
+
+//============================================= LIFECYCLE ==========================================
+
+inline BuffSlice::BuffSlice()
+  :
+    buff_(),
+    offset_(0),
+    size_(0)
+{
+}
+
+inline BuffSlice::BuffSlice(Buff* buff)
+  :
+    buff_(buff),
+    offset_(buff->consumed()),
+    size_(buff->available())
+{
+}
+
+inline BuffSlice::BuffSlice(const SharedPtr<Buff>& buff, uint32_t offset, uint32_t size)
+  :
+    buff_(buff),
+    offset_(offset),
+    size_(size)
+{
+}
+
+//============================================= OPERATIONS =========================================
+
+inline const uint8_t* BuffSlice::data() const
+{
+  const Buff* buff = buff_.get();
+  return (nullptr == buff ? nullptr : buff->data() + offset_);
+}
+
+inline uint32_t BuffSlice::size() const
+{
+  return size_;
+}
+
+inline int BuffSlice::refs() const
+{
+  return buff_.count();
+}
+
+inline BuffSlice BuffSlice::slice(uint32_t offset, uint32_t size) const
+{
+  if (offset > size_) {
+    offset = size_;
+  }
+  if (size > (size_ - offset)) {
+    size = size_ - offset;
+  }
+  return BuffSlice(buff_, offset_ + offset, size);
+}
+
+inline uint8_t* BuffSlice::mutableData()
+{
+  if (nullptr == buff_.get()) {
+    return nullptr;
+  }
+
+  if (buff_.count() > 1) {
+    Buff* copy = new Buff(size_ > 0 ? size_ : 1);
+
+    if (nullptr == copy || nullptr == copy->data()) {
+      delete copy;
+      return nullptr;
+    }
+
+    memcpy(copy->data(), data(), size_);
+    copy->write_ptr() += size_;
+    buff_ = SharedPtr<Buff>(copy);
+    offset_ = 0;
+  }
+  return (buff_.get()->data() + offset_);
+}
+
+} // namespace btr
+
+#endif // _btr_BuffSlice_hpp_
@@ -194,9 +194,7 @@ protected:
 template<typename T>
 inline uint32_t I2C::write(uint8_t addr, uint8_t reg, T value)
 {
-  if (sizeof(T) > 1 && ValueCodec::isLittleEndian()) {
-    ValueCodec::swap(&value);
-  }
+  ValueCodec::swap<true>(&value);
 
   const uint8_t* buff = reinterpret_cast<uint8_t*>(&value);
   return write(addr, reg, buff, sizeof(T));
@@ -208,7 +206,7 @@ inline uint32_t I2C::read(uint8_t addr, uint8_t reg, T* val)
   int rc = I2C::read(addr, reg, buff_, sizeof(T));
 
   if (is_ok(rc)) {
-    ValueCodec::decodeFixedInt(buff_, val, sizeof(T), true);
+    ValueCodec::decodeFixedInt<true>(buff_, val);
   }
   return rc;
 }
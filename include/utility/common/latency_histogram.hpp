@@ -0,0 +1,464 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+#ifndef _btr_LatencyHistogram_hpp_
+#define _btr_LatencyHistogram_hpp_
+
+// SYSTEM INCLUDES
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+
+// PROJECT INCLUDES
+#include "utility/common/buff.hpp"
+#include "utility/common/value_codec.hpp"
+
+namespace btr
+{
+
+/**
+ * The class records a distribution of latencies, e.g. in microseconds or CPU ticks, in log-linear
+ * buckets like HdrHistogram. Values below 2^P have a bucket each. Above that, every power of two
+ * range is split into 2^P buckets, so a bucket is at most 2^-P of its values wide. The bucket is
+ * found from the position of the highest set bit, so record() takes O(1) without loops or
+ * divisions, and the histogram takes a fixed array of BUCKETS counters.
+ *
+ * percentile() reports the highest value of the bucket the requested rank falls in, so it may
+ * exceed the exact value by 2^-P of it, but never by more than the largest recorded value.
+ *
+ * Histograms with the same parameters can be merged, e.g. per-thread histograms on x86, and
+ * serialized to a Buff in LSB order with ValueCodec. Only non-empty buckets are written.
+ *
+ * IMPORTANT: The class is shared by AVR and x86 platforms. Keep it portable.
+ *
+ * @tparam T - unsigned integer value type
+ * @tparam P - log2 of the number of buckets per power of two, i.e. the precision
+ */
+template<typename T = uint32_t, uint8_t P = 4>
+class LatencyHistogram
+{
+public:
+
+  static_assert(T(-1) > T(0), "Values must be unsigned");
+  static_assert(P >= 1 && P <= 10 && P < 8 * sizeof(T), "Precision is out of range");
+
+  /** The number of buckets. */
+  static const uint32_t BUCKETS = (8 * sizeof(T) - P + 1) << P;
+
+// LIFECYCLE
+
+  /**
+   * Ctor.
+   */
+  LatencyHistogram();
+
+// OPERATIONS
+
+  /**
+   * Forget all values.
+   */
+  void reset();
+
+  /**
+   * Record a value.
+   *
+   * @param val - the value to record
+   * @param count - the number of times to record it. A bucket counts up to 2^32 - 1 values.
+   */
+  void record(T val, uint32_t count = 1);
+
+  /**
+   * Add all values of another histogram to this one.
+   *
+   * @param other - the histogram to add
+   */
+  void merge(const LatencyHistogram& other);
+
+  /**
+   * @return the number of recorded values
+   */
+  uint64_t count() const;
+
+  /**
+   * @return the smallest recorded value. The histogram must not be empty.
+   */
+  T min() const;
+
+  /**
+   * @return the largest recorded value. The histogram must not be empty.
+   */
+  T max() const;
+
+  /**
+   * @return the exact mean of the recorded values, 0 if the histogram is empty
+   */
+  float mean() const;
+
+  /**
+   * Estimate a percentile in O(BUCKETS).
+   *
+   * @param q - the rank of the value as a fraction of count(), e.g. 0.99 for p99
+   * @return the highest value of the bucket holding the rank, T() if the histogram is empty
+   */
+  T percentile(float q) const;
+
+  /**
+   * @return the number of recorded values in the bucket holding the given value
+   */
+  uint32_t countAt(T val) const;
+
+  /**
+   * @return the number of bytes serialize() writes
+   */
+  uint32_t serializedSize() const;
+
+  /**
+   * Write the histogram to a buffer.
+   *
+   * @param buff - the buffer to write to
+   * @param buff_mod - how the buffer may be modified if there's not enough room, @see Buff::write
+   * @return 0 on success, otherwise -1 and errno is set to ENOMEM
+   */
+  int serialize(Buff* buff, int buff_mod = Buff::MOD_ALL) const;
+
+  /**
+   * Replace the histogram with one read from a buffer.
+   *
+   * @param buff - the buffer to read from
+   * @return 0 on success, otherwise -1, the histogram is empty and errno is set to ERANGE if the
+   *  data is short or EINVAL if it is invalid or was written with different parameters
+   */
+  int deserialize(Buff* buff);
+
+private:
+
+// OPERATIONS
+
+  /**
+   * @return the bucket of a value
+   */
+  static uint32_t index(T val);
+
+  /**
+   * @return the lowest value of a bucket
+   */
+  static T lowest(uint32_t index);
+
+  /**
+   * @return the highest value of a bucket
+   */
+  static T highest(uint32_t index);
+
+  /**
+   * @return the number of non-empty buckets
+   */
+  uint32_t used() const;
+
+// ATTRIBUTES
+
+  uint32_t counts_[BUCKETS];
+  uint64_t count_;
+  uint64_t sum_;
+  T min_;
+  T max_;
+
+}; // class LatencyHistogram
+
+/////////////////////////////////////////////// INLINE /////////////////////////////////////////////
+
+/////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
+
+//============================================= LIFECYCLE ==========================================
+
+template<typename T, uint8_t P>
+inline LatencyHistogram<T, P>::LatencyHistogram()
+{
+  reset();
+}
+
+//============================================= OPERATIONS =========================================
+
+template<typename T, uint8_t P>
+inline void LatencyHistogram<T, P>::reset()
+{
+  memset(counts_, 0, sizeof(counts_));
+  count_ = 0;
+  sum_ = 0;
+  min_ = T();
+  max_ = T();
+}
+
+template<typename T, uint8_t P>
+inline void LatencyHistogram<T, P>::record(T val, uint32_t count)
+{
+  if (0 == count) {
+    return;
+  }
+  if (0 == count_ || val < min_) {
+    min_ = val;
+  }
+  if (0 == count_ || max_ < val) {
+    max_ = val;
+  }
+
+  counts_[index(val)] += count;
+  count_ += count;
+  sum_ += uint64_t(val) * count;
+}
+
+template<typename T, uint8_t P>
+void LatencyHistogram<T, P>::merge(const LatencyHistogram& other)
+{
+  if (this == &other || 0 == other.count_) {
+    return;
+  }
+
+  if (0 == count_ || other.min_ < min_) {
+    min_ = other.min_;
+  }
+  if (0 == count_ || max_ < other.max_) {
+    max_ = other.max_;
+  }
+
+  for (uint32_t i = 0; i < BUCKETS; i++) {
+    counts_[i] += other.counts_[i];
+  }
+
+  count_ += other.count_;
+  sum_ += other.sum_;
+}
+
+template<typename T, uint8_t P>
+inline uint64_t LatencyHistogram<T, P>::count() const
+{
+  return count_;
+}
+
+template<typename T, uint8_t P>
+inline T LatencyHistogram<T, P>::min() const
+{
+  return min_;
+}
+
+template<typename T, uint8_t P>
+inline T LatencyHistogram<T, P>::max() const
+{
+  return max_;
+}
+
+template<typename T, uint8_t P>
+inline float LatencyHistogram<T, P>::mean() const
+{
+  return (0 == count_ ? 0.0f : float(double(sum_) / double(count_)));
+}
+
+template<typename T, uint8_t P>
+T LatencyHistogram<T, P>::percentile(float q) const
+{
+  if (0 == count_) {
+    return T();
+  }
+  if (q <= 0) {
+    return min_;
+  }
+  if (q >= 1) {
+    return max_;
+  }
+
+  double target = double(q) * double(count_);
+  uint64_t cumulative = 0;
+  uint32_t last = index(max_);
+
+  for (uint32_t i = index(min_); i < last; i++) {
+    cumulative += counts_[i];
+
+    if (0 != counts_[i] && double(cumulative) >= target) {
+      return highest(i);
+    }
+  }
+  return max_;
+}
+
+template<typename T, uint8_t P>
+inline uint32_t LatencyHistogram<T, P>::countAt(T val) const
+{
+  return counts_[index(val)];
+}
+
+template<typename T, uint8_t P>
+inline uint32_t LatencyHistogram<T, P>::serializedSize() const
+{
+  return 4 + 2 * sizeof(uint64_t) + 2 * sizeof(T) + used() * (sizeof(uint16_t) + sizeof(uint32_t));
+}
+
+template<typename T, uint8_t P>
+int LatencyHistogram<T, P>::serialize(Buff* buff, int buff_mod) const
+{
+  uint32_t bytes = serializedSize();
+
+  if (buff->remaining() < bytes && buff->shift() < bytes
+      && Buff::EXTEND == (buff_mod & Buff::EXTEND)) {
+    buff->extend(bytes, buff_mod);
+  }
+  if (buff->remaining() < bytes) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  uint8_t* p = buff->write_ptr();
+
+  p[0] = sizeof(T);
+  p[1] = P;
+  ValueCodec::encodeFixedInt<false>(p + 2, uint16_t(used()));
+  p += 4;
+  ValueCodec::encodeFixedInt<false>(p, count_);
+  p += sizeof(count_);
+  ValueCodec::encodeFixedInt<false>(p, sum_);
+  p += sizeof(sum_);
+  ValueCodec::encodeFixedInt<false>(p, min_);
+  p += sizeof(T);
+  ValueCodec::encodeFixedInt<false>(p, max_);
+  p += sizeof(T);
+
+  for (uint32_t i = 0; i < BUCKETS; i++) {
+    if (0 != counts_[i]) {
+      ValueCodec::encodeFixedInt<false>(p, uint16_t(i));
+      p += sizeof(uint16_t);
+      ValueCodec::encodeFixedInt<false>(p, counts_[i]);
+      p += sizeof(uint32_t);
+    }
+  }
+
+  buff->write_ptr() += bytes;
+  return 0;
+}
+
+template<typename T, uint8_t P>
+int LatencyHistogram<T, P>::deserialize(Buff* buff)
+{
+  reset();
+
+  uint8_t t_size = 0;
+  uint8_t precision = 0;
+  uint16_t buckets = 0;
+  uint64_t count = 0;
+  uint64_t sum = 0;
+  T min_val = T();
+  T max_val = T();
+
+  if (0 != ValueCodec::decodeFixedInt<false>(buff, &t_size)
+      || 0 != ValueCodec::decodeFixedInt<false>(buff, &precision)
+      || 0 != ValueCodec::decodeFixedInt<false>(buff, &buckets)
+      || 0 != ValueCodec::decodeFixedInt<false>(buff, &count)
+      || 0 != ValueCodec::decodeFixedInt<false>(buff, &sum)
+      || 0 != ValueCodec::decodeFixedInt<false>(buff, &min_val)
+      || 0 != ValueCodec::decodeFixedInt<false>(buff, &max_val)) {
+    return -1;
+  }
+
+  if (sizeof(T) != t_size || P != precision || buckets > BUCKETS) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (buff->available() < buckets * (sizeof(uint16_t) + sizeof(uint32_t))) {
+    errno = ERANGE;
+    return -1;
+  }
+
+  // Buckets must be in order, and their counts must add up to the total.
+  uint64_t total = 0;
+  uint32_t next = 0;
+
+  for (uint16_t i = 0; i < buckets; i++) {
+    uint16_t bucket = 0;
+    uint32_t bucket_count = 0;
+    ValueCodec::decodeFixedInt<false>(buff, &bucket);
+    ValueCodec::decodeFixedInt<false>(buff, &bucket_count);
+
+    if (bucket < next || bucket >= BUCKETS || 0 == bucket_count) {
+      reset();
+      errno = EINVAL;
+      return -1;
+    }
+
+    counts_[bucket] = bucket_count;
+    total += bucket_count;
+    next = bucket + 1;
+  }
+
+  if (total != count || (0 != count && (max_val < min_val || 0 == counts_[index(min_val)]
+      || 0 == counts_[index(max_val)]))) {
+    reset();
+    errno = EINVAL;
+    return -1;
+  }
+
+  count_ = count;
+  sum_ = sum;
+  min_ = min_val;
+  max_ = max_val;
+  return 0;
+}
+
+/////////////////////////////////////////////// PRIVATE ////////////////////////////////////////////
+
+//============================================= OPERATIONS =========================================
+
+template<typename T, uint8_t P>
+inline uint32_t LatencyHistogram<T, P>::index(T val)
+{
+  if (val < (T(1) << P)) {
+    return uint32_t(val);
+  }
+
+  // The highest set bit selects the power of two range, and the next P bits the bucket in it.
+  // unsigned long is at least 32 bits wide on both platforms.
+  uint8_t msb = (sizeof(T) <= sizeof(unsigned long)
+      ? uint8_t(8 * sizeof(unsigned long) - 1 - __builtin_clzl((unsigned long) val))
+      : uint8_t(63 - __builtin_clzll((unsigned long long) val)));
+  uint8_t shift = msb - P;
+
+  return ((uint32_t(shift) + 1) << P) | uint32_t((val >> shift) & ((T(1) << P) - 1));
+}
+
+template<typename T, uint8_t P>
+inline T LatencyHistogram<T, P>::lowest(uint32_t index)
+{
+  uint32_t range = index >> P;
+
+  if (0 == range) {
+    return T(index);
+  }
+  return T((T(1) << P) | T(index & ((uint32_t(1) << P) - 1))) << (range - 1);
+}
+
+template<typename T, uint8_t P>
+inline T LatencyHistogram<T, P>::highest(uint32_t index)
+{
+  uint32_t range = index >> P;
+
+  if (0 == range) {
+    return T(index);
+  }
+  return lowest(index) + ((T(1) << (range - 1)) - 1);
+}
+
+template<typename T, uint8_t P>
+inline uint32_t LatencyHistogram<T, P>::used() const
+{
+  uint32_t result = 0;
+
+  for (uint32_t i = 0; i < BUCKETS; i++) {
+    result += (0 != counts_[i] ? 1 : 0);
+  }
+  return result;
+}
+
+} // namespace btr
+
+#endif // _btr_LatencyHistogram_hpp_
@@ -0,0 +1,467 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+#ifndef _btr_MultiValueTracker_hpp_
+#define _btr_MultiValueTracker_hpp_
+
+// SYSTEM INCLUDES
+#include <inttypes.h>
+#include <string.h>
+
+#if BTR_X86 > 0 && (defined(__x86_64__) || defined(__i386__))
+#define BTR_MULTI_VALUE_AVX2 1
+#include <immintrin.h>
+#endif
+
+// PROJECT INCLUDES
+
+namespace btr
+{
+
+/**
+ * Kernels that aggregate every channel of channel-interleaved rows: value c of row r is at
+ * rows[r * channels + c]. The scalar templates work for any type, and the loops over channels are
+ * left for the compiler to vectorize. On x86, int16_t rows summed into int32_t use AVX2 if the CPU
+ * supports it.
+ */
+struct MultiValueKernels
+{
+  /**
+   * Sum the values of each channel.
+   *
+   * @param rows - the rows
+   * @param count - the number of rows, at least one
+   * @param channels - the number of values in a row
+   * @param sums - the sums, one per channel
+   */
+  template<typename T, typename A>
+  static void sum(const T* rows, uint32_t count, uint32_t channels, A* sums);
+
+  /**
+   * Find the minimum value of each channel.
+   *
+   * @param out - the minimums, one per channel
+   */
+  template<typename T>
+  static void min(const T* rows, uint32_t count, uint32_t channels, T* out);
+
+  /**
+   * Find the maximum value of each channel.
+   *
+   * @param out - the maximums, one per channel
+   */
+  template<typename T>
+  static void max(const T* rows, uint32_t count, uint32_t channels, T* out);
+
+#if BTR_MULTI_VALUE_AVX2 > 0
+  /**
+   * @return true if the AVX2 kernels may be used
+   */
+  static bool avx2();
+
+  /**
+   * The kernels for int16_t values, which use AVX2 if the CPU supports it.
+   */
+  static void sum(const int16_t* rows, uint32_t count, uint32_t channels, int32_t* sums);
+  static void min(const int16_t* rows, uint32_t count, uint32_t channels, int16_t* out);
+  static void max(const int16_t* rows, uint32_t count, uint32_t channels, int16_t* out);
+
+  /**
+   * The AVX2 kernels, 16 channels at a time. The remaining channels are aggregated one by one.
+   */
+  __attribute__((target("avx2")))
+  static void sumAvx2(const int16_t* rows, uint32_t count, uint32_t channels, int32_t* sums);
+
+  __attribute__((target("avx2")))
+  static void minAvx2(const int16_t* rows, uint32_t count, uint32_t channels, int16_t* out);
+
+  __attribute__((target("avx2")))
+  static void maxAvx2(const int16_t* rows, uint32_t count, uint32_t channels, int16_t* out);
+#endif // BTR_MULTI_VALUE_AVX2 > 0
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * The class keeps track of the last W values of C channels, e.g. ADC inputs sampled together,
+ * like C instances of ValueTracker. Values are stored channel-interleaved, so push() copies a
+ * whole row, and mean, minimum and maximum of every channel are computed in one pass over the
+ * window by MultiValueKernels.
+ *
+ * IMPORTANT: The class is shared by AVR and x86 platforms. Keep it portable.
+ *
+ * @tparam C - the number of channels
+ * @tparam W - the number of tracked values per channel
+ * @tparam A - the type of the per-channel sums, e.g. float for floating point values
+ */
+template<typename T, uint16_t C, uint32_t W = 5, typename A = int32_t>
+class MultiValueTracker
+{
+public:
+
+  static_assert(C > 0, "Tracker must have at least one channel");
+  static_assert(W > 1, "Window must hold at least two values");
+
+// LIFECYCLE
+
+  /**
+   * Ctor.
+   */
+  MultiValueTracker();
+
+// OPERATIONS
+
+  /**
+   * Set all samples of all channels to the given value.
+   */
+  void reset(T val = 0);
+
+  /**
+   * Add new value to every channel.
+   *
+   * @param vals - C values, one per channel
+   */
+  void push(const T* vals);
+
+  /**
+   * @return the count of tracked values per channel
+   */
+  uint32_t count() const;
+
+  /**
+   * @return the value of a channel at given position. Positions start at 0 with the oldest value.
+   */
+  T value(uint16_t channel, uint32_t pos) const;
+
+  /**
+   * @return the last pushed value of a channel
+   */
+  T last(uint16_t channel) const;
+
+  /**
+   * @param out - the last pushed values, one per channel
+   */
+  void last(T* out) const;
+
+  /**
+   * @param out - deltas between the last and one-before last values, one per channel
+   */
+  void delta(T* out) const;
+
+  /**
+   * @param out - the mean values, one per channel
+   */
+  void mean(T* out) const;
+
+  /**
+   * @param out - the minimum values, one per channel
+   */
+  void min(T* out) const;
+
+  /**
+   * @param out - the maximum values, one per channel
+   */
+  void max(T* out) const;
+
+private:
+
+// OPERATIONS
+
+  /**
+   * @return index reduced to [0, W). The index must be less than 2 * W.
+   */
+  static uint32_t wrap(uint32_t index);
+
+  /**
+   * @return the row at the given position
+   */
+  const T* row(uint32_t pos) const;
+
+// ATTRIBUTES
+
+  T vals_[W * C];
+  uint32_t pos_;
+
+}; // class MultiValueTracker
+
+/////////////////////////////////////////////// INLINE /////////////////////////////////////////////
+
+/////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
+
+//============================================= OPERATIONS =========================================
+
+template<typename T, typename A>
+inline void MultiValueKernels::sum(const T* rows, uint32_t count, uint32_t channels, A* sums)
+{
+  for (uint32_t c = 0; c < channels; c++) {
+    sums[c] = A(rows[c]);
+  }
+  for (uint32_t r = 1; r < count; r++) {
+    const T* row = rows + r * channels;
+
+    for (uint32_t c = 0; c < channels; c++) {
+      sums[c] += A(row[c]);
+    }
+  }
+}
+
+template<typename T>
+inline void MultiValueKernels::min(const T* rows, uint32_t count, uint32_t channels, T* out)
+{
+  memcpy(out, rows, channels * sizeof(T));
+
+  for (uint32_t r = 1; r < count; r++) {
+    const T* row = rows + r * channels;
+
+    for (uint32_t c = 0; c < channels; c++) {
+      out[c] = (row[c] < out[c] ? row[c] : out[c]);
+    }
+  }
+}
+
+template<typename T>
+inline void MultiValueKernels::max(const T* rows, uint32_t count, uint32_t channels, T* out)
+{
+  memcpy(out, rows, channels * sizeof(T));
+
+  for (uint32_t r = 1; r < count; r++) {
+    const T* row = rows + r * channels;
+
+    for (uint32_t c = 0; c < channels; c++) {
+      out[c] = (out[c] < row[c] ? row[c] : out[c]);
+    }
+  }
+}
+
+#if BTR_MULTI_VALUE_AVX2 > 0
+inline bool MultiValueKernels::avx2()
+{
+  static const bool supported = __builtin_cpu_supports("avx2");
+  return supported;
+}
+
+inline void MultiValueKernels::sum(const int16_t* rows, uint32_t count, uint32_t channels,
+  int32_t* sums)
+{
+  if (avx2()) {
+    sumAvx2(rows, count, channels, sums);
+  } else {
+    sum<int16_t, int32_t>(rows, count, channels, sums);
+  }
+}
+
+inline void MultiValueKernels::min(const int16_t* rows, uint32_t count, uint32_t channels,
+  int16_t* out)
+{
+  if (avx2()) {
+    minAvx2(rows, count, channels, out);
+  } else {
+    min<int16_t>(rows, count, channels, out);
+  }
+}
+
+inline void MultiValueKernels::max(const int16_t* rows, uint32_t count, uint32_t channels,
+  int16_t* out)
+{
+  if (avx2()) {
+    maxAvx2(rows, count, channels, out);
+  } else {
+    max<int16_t>(rows, count, channels, out);
+  }
+}
+
+__attribute__((target("avx2")))
+inline void MultiValueKernels::sumAvx2(const int16_t* rows, uint32_t count, uint32_t channels,
+  int32_t* sums)
+{
+  uint32_t c = 0;
+
+  // 16 channels at a time, widened to two vectors of 8 sums.
+  for (; c + 16 <= channels; c += 16) {
+    __m256i lo = _mm256_setzero_si256();
+    __m256i hi = _mm256_setzero_si256();
+
+    for (uint32_t r = 0; r < count; r++) {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows + r * channels + c));
+      lo = _mm256_add_epi32(lo, _mm256_cvtepi16_epi32(_mm256_castsi256_si128(v)));
+      hi = _mm256_add_epi32(hi, _mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1)));
+    }
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(sums + c), lo);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(sums + c + 8), hi);
+  }
+
+  for (; c < channels; c++) {
+    int32_t total = 0;
+
+    for (uint32_t r = 0; r < count; r++) {
+      total += rows[r * channels + c];
+    }
+    sums[c] = total;
+  }
+}
+
+__attribute__((target("avx2")))
+inline void MultiValueKernels::minAvx2(const int16_t* rows, uint32_t count, uint32_t channels,
+  int16_t* out)
+{
+  uint32_t c = 0;
+
+  for (; c + 16 <= channels; c += 16) {
+    __m256i m = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows + c));
+
+    for (uint32_t r = 1; r < count; r++) {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows + r * channels + c));
+      m = _mm256_min_epi16(m, v);
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + c), m);
+  }
+
+  for (; c < channels; c++) {
+    int16_t m = rows[c];
+
+    for (uint32_t r = 1; r < count; r++) {
+      m = (rows[r * channels + c] < m ? rows[r * channels + c] : m);
+    }
+    out[c] = m;
+  }
+}
+
+__attribute__((target("avx2")))
+inline void MultiValueKernels::maxAvx2(const int16_t* rows, uint32_t count, uint32_t channels,
+  int16_t* out)
+{
+  uint32_t c = 0;
+
+  for (; c + 16 <= channels; c += 16) {
+    __m256i m = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows + c));
+
+    for (uint32_t r = 1; r < count; r++) {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows + r * channels + c));
+      m = _mm256_max_epi16(m, v);
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + c), m);
+  }
+
+  for (; c < channels; c++) {
+    int16_t m = rows[c];
+
+    for (uint32_t r = 1; r < count; r++) {
+      m = (m < rows[r * channels + c] ? rows[r * channels + c] : m);
+    }
+    out[c] = m;
+  }
+}
+#endif // BTR_MULTI_VALUE_AVX2 > 0
+
+//============================================= LIFECYCLE ==========================================
+
+template<typename T, uint16_t C, uint32_t W, typename A>
+inline MultiValueTracker<T, C, W, A>::MultiValueTracker()
+  :
+    vals_(),
+    pos_(0)
+{
+}
+
+//============================================= OPERATIONS =========================================
+
+template<typename T, uint16_t C, uint32_t W, typename A>
+inline void MultiValueTracker<T, C, W, A>::reset(T val)
+{
+  for (uint32_t i = 0; i < W * C; i++) {
+    vals_[i] = val;
+  }
+  pos_ = 0;
+}
+
+template<typename T, uint16_t C, uint32_t W, typename A>
+inline void MultiValueTracker<T, C, W, A>::push(const T* vals)
+{
+  memcpy(vals_ + pos_ * C, vals, C * sizeof(T));
+  pos_ = wrap(pos_ + 1);
+}
+
+template<typename T, uint16_t C, uint32_t W, typename A>
+inline uint32_t MultiValueTracker<T, C, W, A>::count() const
+{
+  return W;
+}
+
+template<typename T, uint16_t C, uint32_t W, typename A>
+inline T MultiValueTracker<T, C, W, A>::value(uint16_t channel, uint32_t pos) const
+{
+  // The oldest row is at the write position.
+  return row(wrap(pos_ + pos))[channel];
+}
+
+template<typename T, uint16_t C, uint32_t W, typename A>
+inline T MultiValueTracker<T, C, W, A>::last(uint16_t channel) const
+{
+  return row(wrap(pos_ + W - 1))[channel];
+}
+
+template<typename T, uint16_t C, uint32_t W, typename A>
+inline void MultiValueTracker<T, C, W, A>::last(T* out) const
+{
+  memcpy(out, row(wrap(pos_ + W - 1)), C * sizeof(T));
+}
+
+template<typename T, uint16_t C, uint32_t W, typename A>
+inline void MultiValueTracker<T, C, W, A>::delta(T* out) const
+{
+  const T* upper = row(wrap(pos_ + W - 1));
+  const T* lower = row(wrap(pos_ + W - 2));
+
+  for (uint16_t c = 0; c < C; c++) {
+    out[c] = upper[c] - lower[c];
+  }
+}
+
+template<typename T, uint16_t C, uint32_t W, typename A>
+inline void MultiValueTracker<T, C, W, A>::mean(T* out) const
+{
+  A sums[C];
+  MultiValueKernels::sum(vals_, W, C, sums);
+
+  for (uint16_t c = 0; c < C; c++) {
+    out[c] = T(sums[c] / A(W));
+  }
+}
+
+template<typename T, uint16_t C, uint32_t W, typename A>
+inline void MultiValueTracker<T, C, W, A>::min(T* out) const
+{
+  MultiValueKernels::min(vals_, W, C, out);
+}
+
+template<typename T, uint16_t C, uint32_t W, typename A>
+inline void MultiValueTracker<T, C, W, A>::max(T* out) const
+{
+  MultiValueKernels::max(vals_, W, C, out);
+}
+
+/////////////////////////////////////////////// PRIVATE ////////////////////////////////////////////
+
+//============================================= OPERATIONS =========================================
+
+template<typename T, uint16_t C, uint32_t W, typename A>
+inline uint32_t MultiValueTracker<T, C, W, A>::wrap(uint32_t index)
+{
+  return (0 == (W & (W - 1)) ? (index & (W - 1)) : (index >= W ? index - W : index));
+}
+
+template<typename T, uint16_t C, uint32_t W, typename A>
+inline const T* MultiValueTracker<T, C, W, A>::row(uint32_t pos) const
+{
+  return vals_ + pos * C;
+}
+
+} // namespace btr
+
+#endif // _btr_MultiValueTracker_hpp_
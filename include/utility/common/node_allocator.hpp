@@ -0,0 +1,333 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+#ifndef _btr_NodeAllocator_hpp_
+#define _btr_NodeAllocator_hpp_
+
+// SYSTEM INCLUDES
+#include <stddef.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#if BTR_AVR > 0
+// avr-libc doesn't provide <new>. Declare placement new for constructing nodes in a slab.
+inline void* operator new(size_t, void* ptr) { return ptr; }
+#else
+#include <new>
+#endif
+
+namespace btr
+{
+
+/**
+ * The class allocates tree nodes one at a time with new/delete. It is the default node
+ * allocator of AvlTree.
+ *
+ * Every node allocator implements:
+ *  N* create(K key) - construct a node or return nullptr if memory is exhausted
+ *  void destroy(N* node) - destruct a node and release its memory
+ *  THREAD_SAFE - true if create and destroy may be called concurrently
+ *  TRANSFERABLE - true if a node created by one allocator instance may be destroyed by another,
+ *    which lets trees exchange nodes
+ */
+template<typename N>
+class HeapNodeAllocator
+{
+public:
+
+  static const bool THREAD_SAFE = true;
+  static const bool TRANSFERABLE = true;
+
+// OPERATIONS
+
+  template<typename K>
+  N* create(K key);
+
+  void destroy(N* node);
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * The class allocates tree nodes from a fixed-capacity slab embedded in the allocator object.
+ * Freed nodes are kept in an intrusive free list. Intended for MCUs where heap fragmentation is
+ * a concern: the slab can be placed in static memory along with the tree.
+ *
+ * @tparam C - the maximum number of nodes
+ */
+template<typename N, uint32_t C>
+class StaticNodeAllocator
+{
+public:
+
+  static const bool THREAD_SAFE = false;
+  static const bool TRANSFERABLE = false;
+
+// LIFECYCLE
+
+  StaticNodeAllocator();
+  StaticNodeAllocator(const StaticNodeAllocator&) = delete;
+  StaticNodeAllocator& operator=(const StaticNodeAllocator&) = delete;
+
+// OPERATIONS
+
+  template<typename K>
+  N* create(K key);
+
+  void destroy(N* node);
+
+  /**
+   * @return the number of nodes the allocator can hold
+   */
+  uint32_t capacity() const;
+
+  /**
+   * @return the number of allocated nodes
+   */
+  uint32_t count() const;
+
+private:
+
+  /** Overlays a free slot. */
+  struct FreeSlot
+  {
+    FreeSlot* next_;
+  };
+
+  static_assert(sizeof(N) >= sizeof(FreeSlot), "Node is too small for a free-list link");
+
+// ATTRIBUTES
+
+  alignas(N) uint8_t slab_[C * sizeof(N)];
+  FreeSlot* free_;
+  /** Slots at this index and above have never been allocated. */
+  uint32_t next_;
+  uint32_t count_;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * The class allocates tree nodes from slabs of S nodes. A new slab is allocated from the heap
+ * when the existing ones are full, and all slabs are released when the allocator is destroyed.
+ * Freed nodes are kept in an intrusive free list, so high-churn insert/erase workloads reuse
+ * memory without calling the system allocator. Intended for x86.
+ *
+ * @tparam S - the number of nodes per slab
+ */
+template<typename N, uint32_t S = 256>
+class PoolNodeAllocator
+{
+public:
+
+  static const bool THREAD_SAFE = false;
+  static const bool TRANSFERABLE = false;
+
+// LIFECYCLE
+
+  PoolNodeAllocator();
+  PoolNodeAllocator(const PoolNodeAllocator&) = delete;
+  PoolNodeAllocator& operator=(const PoolNodeAllocator&) = delete;
+
+  /**
+   * Release all slabs. Nodes must have been destroyed by then.
+   */
+  ~PoolNodeAllocator();
+
+// OPERATIONS
+
+  template<typename K>
+  N* create(K key);
+
+  void destroy(N* node);
+
+  /**
+   * @return the number of nodes the allocated slabs can hold
+   */
+  uint32_t capacity() const;
+
+  /**
+   * @return the number of allocated nodes
+   */
+  uint32_t count() const;
+
+private:
+
+  /** Overlays a free slot. */
+  struct FreeSlot
+  {
+    FreeSlot* next_;
+  };
+
+  /** Slab header followed by node storage. */
+  struct Slab
+  {
+    Slab* next_;
+    alignas(N) uint8_t nodes_[S * sizeof(N)];
+  };
+
+  static_assert(sizeof(N) >= sizeof(FreeSlot), "Node is too small for a free-list link");
+
+// ATTRIBUTES
+
+  Slab* slabs_;
+  FreeSlot* free_;
+  /** Slots at this index and above in the newest slab have never been allocated. */
+  uint32_t next_;
+  uint32_t capacity_;
+  uint32_t count_;
+};
+
+/////////////////////////////////////////////// INLINE /////////////////////////////////////////////
+
+/////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
+
+//============================================= LIFECYCLE ==========================================
+
+template<typename N, uint32_t C>
+inline StaticNodeAllocator<N, C>::StaticNodeAllocator() :
+  free_(nullptr),
+  next_(0),
+  count_(0)
+{
+}
+
+template<typename N, uint32_t S>
+inline PoolNodeAllocator<N, S>::PoolNodeAllocator() :
+  slabs_(nullptr),
+  free_(nullptr),
+  next_(S),
+  capacity_(0),
+  count_(0)
+{
+}
+
+template<typename N, uint32_t S>
+inline PoolNodeAllocator<N, S>::~PoolNodeAllocator()
+{
+  while (nullptr != slabs_) {
+    Slab* next = slabs_->next_;
+    free(slabs_);
+    slabs_ = next;
+  }
+}
+
+//============================================= OPERATIONS =========================================
+
+template<typename N>
+template<typename K>
+inline N* HeapNodeAllocator<N>::create(K key)
+{
+  return new N(key);
+}
+
+template<typename N>
+inline void HeapNodeAllocator<N>::destroy(N* node)
+{
+  delete node;
+}
+
+template<typename N, uint32_t C>
+template<typename K>
+inline N* StaticNodeAllocator<N, C>::create(K key)
+{
+  void* slot = nullptr;
+
+  if (nullptr != free_) {
+    slot = free_;
+    free_ = free_->next_;
+  } else if (next_ < C) {
+    slot = slab_ + (next_ * sizeof(N));
+    ++next_;
+  } else {
+    return nullptr;
+  }
+
+  ++count_;
+  return new (slot) N(key);
+}
+
+template<typename N, uint32_t C>
+inline void StaticNodeAllocator<N, C>::destroy(N* node)
+{
+  node->~N();
+
+  FreeSlot* slot = reinterpret_cast<FreeSlot*>(node);
+  slot->next_ = free_;
+  free_ = slot;
+  --count_;
+}
+
+template<typename N, uint32_t C>
+inline uint32_t StaticNodeAllocator<N, C>::capacity() const
+{
+  return C;
+}
+
+template<typename N, uint32_t C>
+inline uint32_t StaticNodeAllocator<N, C>::count() const
+{
+  return count_;
+}
+
+template<typename N, uint32_t S>
+template<typename K>
+inline N* PoolNodeAllocator<N, S>::create(K key)
+{
+  void* slot = nullptr;
+
+  if (nullptr != free_) {
+    slot = free_;
+    free_ = free_->next_;
+  } else {
+    if (next_ == S) {
+      Slab* slab = static_cast<Slab*>(malloc(sizeof(Slab)));
+
+      if (nullptr == slab) {
+        return nullptr;
+      }
+
+      slab->next_ = slabs_;
+      slabs_ = slab;
+      next_ = 0;
+      capacity_ += S;
+    }
+    slot = slabs_->nodes_ + (next_ * sizeof(N));
+    ++next_;
+  }
+
+  ++count_;
+  return new (slot) N(key);
+}
+
+template<typename N, uint32_t S>
+inline void PoolNodeAllocator<N, S>::destroy(N* node)
+{
+  node->~N();
+
+  FreeSlot* slot = reinterpret_cast<FreeSlot*>(node);
+  slot->next_ = free_;
+  free_ = slot;
+  --count_;
+}
+
+template<typename N, uint32_t S>
+inline uint32_t PoolNodeAllocator<N, S>::capacity() const
+{
+  return capacity_;
+}
+
+template<typename N, uint32_t S>
+inline uint32_t PoolNodeAllocator<N, S>::count() const
+{
+  return count_;
+}
+
+} // namespace btr
+
+#endif // _btr_NodeAllocator_hpp_
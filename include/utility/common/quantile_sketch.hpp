@@ -0,0 +1,785 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+#ifndef _btr_QuantileSketch_hpp_
+#define _btr_QuantileSketch_hpp_
+
+// SYSTEM INCLUDES
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+
+// PROJECT INCLUDES
+#include "utility/common/buff.hpp"
+#include "utility/common/sorters.hpp"
+#include "utility/common/value_codec.hpp"
+
+namespace btr
+{
+
+/**
+ * The class estimates quantiles of a stream of values in fixed memory. It is a KLL sketch
+ * (Karnin, Lang, Liberty): values are kept in a stack of levels, where a value at level h stands
+ * for 2^h stream values. A full level is sorted and every other value, starting at a random
+ * offset, moves up a level while the rest is dropped. Level capacities shrink geometrically from
+ * the top, so all levels fit in an array of about 3 * K values however long the stream is.
+ *
+ * The rank error of quantile() is about 1.7% for K = 200 and grows as 1/K for smaller K. Until K
+ * values are pushed, results are exact.
+ *
+ * Sketches with the same parameters can be merged, e.g. per-thread sketches on x86, and
+ * serialized to a Buff in LSB order with ValueCodec.
+ *
+ * IMPORTANT: The class is shared by AVR and x86 platforms. Keep it portable.
+ *
+ * @tparam T - value type
+ * @tparam K - the capacity of the top level, controls accuracy
+ * @tparam L - the maximum number of levels. The sketch holds about K * 2^(L - 1) values with the
+ *  stated accuracy; after that the top level is thinned in place and the error grows slowly.
+ */
+template<typename T, uint16_t K = 200, uint8_t L = 30>
+class QuantileSketch
+{
+public:
+
+  static_assert(K >= 8, "K is too small");
+  static_assert(L >= 2 && L <= 32, "Sketch must have from 2 to 32 levels");
+
+  /** The number of values the sketch stores at most. */
+  static const uint32_t CAPACITY = 3 * uint32_t(K) + 5 * uint32_t(L);
+
+// LIFECYCLE
+
+  /**
+   * Ctor.
+   */
+  QuantileSketch();
+
+// OPERATIONS
+
+  /**
+   * Forget all values.
+   */
+  void reset();
+
+  /**
+   * Add a value.
+   *
+   * @param val - the value to add
+   */
+  void push(T val);
+
+  /**
+   * Add all values of another sketch to this one.
+   *
+   * @param other - a different sketch, not modified
+   */
+  void merge(const QuantileSketch& other);
+
+  /**
+   * @return the number of values pushed, including merged ones
+   */
+  uint64_t count() const;
+
+  /**
+   * @return the number of values stored
+   */
+  uint32_t retained() const;
+
+  /**
+   * @return the smallest value pushed. The sketch must not be empty.
+   */
+  T min() const;
+
+  /**
+   * @return the largest value pushed. The sketch must not be empty.
+   */
+  T max() const;
+
+  /**
+   * Estimate a quantile. Sorts the bottom level on the first call after a push, otherwise O(n)
+   * in the number of stored values.
+   *
+   * @param q - the rank of the value as a fraction of count(), e.g. 0.99 for p99
+   * @return the estimated value, T() if the sketch is empty
+   */
+  T quantile(float q) const;
+
+  /**
+   * @return the estimated number of pushed values not greater than val
+   */
+  uint64_t rank(T val) const;
+
+  /**
+   * @return the number of bytes serialize() writes
+   */
+  uint32_t serializedSize() const;
+
+  /**
+   * Write the sketch to a buffer.
+   *
+   * @param buff - the buffer to write to
+   * @param buff_mod - how the buffer may be modified if there's not enough room, @see Buff::write
+   * @return 0 on success, otherwise -1 and errno is set to ENOMEM
+   */
+  int serialize(Buff* buff, int buff_mod = Buff::MOD_ALL) const;
+
+  /**
+   * Replace the sketch with one read from a buffer.
+   *
+   * @param buff - the buffer to read from
+   * @return 0 on success, otherwise -1, the sketch is empty and errno is set to ERANGE if the data
+   *  is short or EINVAL if it is invalid or was written with different parameters
+   */
+  int deserialize(Buff* buff);
+
+private:
+
+// OPERATIONS
+
+  /**
+   * @return the number of values at a level
+   */
+  uint32_t size(uint8_t level) const;
+
+  /**
+   * @return the capacity of a level
+   */
+  uint32_t capacity(uint8_t level) const;
+
+  /**
+   * @return log2 of the weight of values at a level
+   */
+  uint8_t exponent(uint8_t level) const;
+
+  /**
+   * @return the sum of capacities of the given number of levels
+   */
+  uint32_t totalCapacity(uint8_t levels) const;
+
+  /**
+   * @return the sum of weights of the stored values
+   */
+  uint64_t weight() const;
+
+  /**
+   * Add a value to the bottom level, compressing the sketch if it is full.
+   */
+  void add(T val);
+
+  /**
+   * Add a value of weight 2^exp, keeping levels sorted.
+   */
+  void add(T val, uint8_t exp);
+
+  /**
+   * Free space by compacting the lowest level that reached its capacity.
+   */
+  void compress();
+
+  /**
+   * Add an empty top level.
+   */
+  void addLevel();
+
+  /**
+   * Move every other value of a level, or fewer if the next level is the thinned top, to the next
+   * level, and drop the rest. An odd value out of pairs stays at the level.
+   */
+  void compact(uint8_t level);
+
+  /**
+   * Drop every other value of the top level when no level can be added.
+   */
+  void thinTop();
+
+  /**
+   * Move the bottom levels up by the given number of slots, up to the given level.
+   */
+  void shiftUp(uint8_t level, uint32_t begin, uint32_t slots);
+
+  /**
+   * Sort the bottom level if it was modified.
+   */
+  void sortBottom() const;
+
+  /**
+   * @return a pseudo-random number
+   */
+  uint32_t random();
+
+// ATTRIBUTES
+
+  /**
+   * Levels grow down from the end of the array: level h occupies [levels_[h], levels_[h + 1]),
+   * and [0, levels_[0]) is free. Levels above the bottom one are sorted. The bottom level is
+   * sorted lazily by const queries, so it is mutable.
+   */
+  mutable T items_[CAPACITY];
+  uint32_t levels_[L + 1];
+
+  /** Level capacities by depth from the top. */
+  uint32_t caps_[L];
+
+  uint64_t n_;
+  T min_;
+  T max_;
+  uint32_t base_;
+  uint32_t rng_;
+  uint8_t num_levels_;
+  uint8_t top_shift_;
+  mutable bool bottom_sorted_;
+
+}; // class QuantileSketch
+
+/////////////////////////////////////////////// INLINE /////////////////////////////////////////////
+
+/////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
+
+//============================================= LIFECYCLE ==========================================
+
+template<typename T, uint16_t K, uint8_t L>
+inline QuantileSketch<T, K, L>::QuantileSketch()
+{
+  // Each level below has 2/3 of the capacity of the level above, rounded up, but at least 2.
+  uint32_t cap = K;
+
+  for (uint8_t depth = 0; depth < L; depth++) {
+    caps_[depth] = (cap > 2 ? cap : 2);
+    cap = (cap * 2 + 2) / 3;
+  }
+
+  reset();
+}
+
+//============================================= OPERATIONS =========================================
+
+template<typename T, uint16_t K, uint8_t L>
+inline void QuantileSketch<T, K, L>::reset()
+{
+  n_ = 0;
+  min_ = T();
+  max_ = T();
+  rng_ = 0x9E3779B9;
+  num_levels_ = 1;
+  top_shift_ = 0;
+  levels_[0] = CAPACITY;
+  levels_[1] = CAPACITY;
+  base_ = CAPACITY - totalCapacity(1);
+  bottom_sorted_ = true;
+}
+
+template<typename T, uint16_t K, uint8_t L>
+inline void QuantileSketch<T, K, L>::push(T val)
+{
+  if (0 == n_ || val < min_) {
+    min_ = val;
+  }
+  if (0 == n_ || max_ < val) {
+    max_ = val;
+  }
+
+  ++n_;
+  add(val);
+}
+
+template<typename T, uint16_t K, uint8_t L>
+void QuantileSketch<T, K, L>::merge(const QuantileSketch& other)
+{
+  if (this == &other || 0 == other.n_) {
+    return;
+  }
+
+  if (0 == n_ || other.min_ < min_) {
+    min_ = other.min_;
+  }
+  if (0 == n_ || max_ < other.max_) {
+    max_ = other.max_;
+  }
+
+  // Add heavy values first, so that they raise the top level before the light ones fill it.
+  for (uint8_t level = other.num_levels_; level-- > 0;) {
+    uint8_t exp = other.exponent(level);
+
+    for (uint32_t i = other.levels_[level]; i < other.levels_[level + 1]; i++) {
+      add(other.items_[i], exp);
+    }
+  }
+
+  n_ += other.n_;
+}
+
+template<typename T, uint16_t K, uint8_t L>
+inline uint64_t QuantileSketch<T, K, L>::count() const
+{
+  return n_;
+}
+
+template<typename T, uint16_t K, uint8_t L>
+inline uint32_t QuantileSketch<T, K, L>::retained() const
+{
+  return CAPACITY - levels_[0];
+}
+
+template<typename T, uint16_t K, uint8_t L>
+inline T QuantileSketch<T, K, L>::min() const
+{
+  return min_;
+}
+
+template<typename T, uint16_t K, uint8_t L>
+inline T QuantileSketch<T, K, L>::max() const
+{
+  return max_;
+}
+
+template<typename T, uint16_t K, uint8_t L>
+T QuantileSketch<T, K, L>::quantile(float q) const
+{
+  if (0 == n_) {
+    return T();
+  }
+  if (q <= 0) {
+    return min_;
+  }
+  if (q >= 1) {
+    return max_;
+  }
+
+  sortBottom();
+
+  // Merge the sorted levels until the cumulative weight reaches the requested rank.
+  float target = q * float(weight());
+  uint64_t cumulative = 0;
+  uint32_t pos[L];
+
+  for (uint8_t level = 0; level < num_levels_; level++) {
+    pos[level] = levels_[level];
+  }
+
+  while (true) {
+    uint8_t next = num_levels_;
+
+    for (uint8_t level = 0; level < num_levels_; level++) {
+      if (pos[level] < levels_[level + 1]
+          && (num_levels_ == next || items_[pos[level]] < items_[pos[next]])) {
+        next = level;
+      }
+    }
+
+    if (num_levels_ == next) {
+      return max_;
+    }
+
+    cumulative += uint64_t(1) << exponent(next);
+
+    if (float(cumulative) >= target) {
+      return items_[pos[next]];
+    }
+    ++pos[next];
+  }
+}
+
+template<typename T, uint16_t K, uint8_t L>
+uint64_t QuantileSketch<T, K, L>::rank(T val) const
+{
+  uint64_t result = 0;
+
+  for (uint8_t level = 0; level < num_levels_; level++) {
+    uint32_t count = 0;
+
+    for (uint32_t i = levels_[level]; i < levels_[level + 1]; i++) {
+      count += (val < items_[i] ? 0 : 1);
+    }
+    result += uint64_t(count) << exponent(level);
+  }
+
+  // The stored weight only tracks count() on average. Scale it, so that ranks agree with
+  // quantile(), which works on fractions of the stored weight.
+  uint64_t total = weight();
+  return (result == total ? n_ : uint64_t(double(result) * double(n_) / double(total)));
+}
+
+template<typename T, uint16_t K, uint8_t L>
+inline uint32_t QuantileSketch<T, K, L>::serializedSize() const
+{
+  return 6 + sizeof(n_) + 2 * sizeof(T) + num_levels_ * sizeof(uint32_t) + retained() * sizeof(T);
+}
+
+template<typename T, uint16_t K, uint8_t L>
+int QuantileSketch<T, K, L>::serialize(Buff* buff, int buff_mod) const
+{
+  uint32_t bytes = serializedSize();
+
+  if (buff->remaining() < bytes && buff->shift() < bytes
+      && Buff::EXTEND == (buff_mod & Buff::EXTEND)) {
+    buff->extend(bytes, buff_mod);
+  }
+  if (buff->remaining() < bytes) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  uint8_t* p = buff->write_ptr();
+
+  ValueCodec::encodeFixedInt<false>(p, K);
+  p[2] = L;
+  p[3] = sizeof(T);
+  p[4] = num_levels_;
+  p[5] = top_shift_;
+  p += 6;
+  ValueCodec::encodeFixedInt<false>(p, n_);
+  p += sizeof(n_);
+  ValueCodec::encodeFixedInt<false>(p, min_);
+  p += sizeof(T);
+  ValueCodec::encodeFixedInt<false>(p, max_);
+  p += sizeof(T);
+
+  for (uint8_t level = 0; level < num_levels_; level++) {
+    ValueCodec::encodeFixedInt<false>(p, size(level));
+    p += sizeof(uint32_t);
+  }
+  for (uint32_t i = levels_[0]; i < CAPACITY; i++) {
+    ValueCodec::encodeFixedInt<false>(p, items_[i]);
+    p += sizeof(T);
+  }
+
+  buff->write_ptr() += bytes;
+  return 0;
+}
+
+template<typename T, uint16_t K, uint8_t L>
+int QuantileSketch<T, K, L>::deserialize(Buff* buff)
+{
+  reset();
+
+  uint16_t k = 0;
+  uint8_t l = 0;
+  uint8_t t_size = 0;
+  uint8_t num_levels = 0;
+  uint8_t top_shift = 0;
+  uint64_t n = 0;
+  T min_val = T();
+  T max_val = T();
+
+  if (0 != ValueCodec::decodeFixedInt<false>(buff, &k)
+      || 0 != ValueCodec::decodeFixedInt<false>(buff, &l)
+      || 0 != ValueCodec::decodeFixedInt<false>(buff, &t_size)
+      || 0 != ValueCodec::decodeFixedInt<false>(buff, &num_levels)
+      || 0 != ValueCodec::decodeFixedInt<false>(buff, &top_shift)
+      || 0 != ValueCodec::decodeFixedInt<false>(buff, &n)
+      || 0 != ValueCodec::decodeFixedInt<false>(buff, &min_val)
+      || 0 != ValueCodec::decodeFixedInt<false>(buff, &max_val)) {
+    return -1;
+  }
+
+  // Only a sketch with all levels may have a thinned top level.
+  if (K != k || L != l || sizeof(T) != t_size || 0 == num_levels || num_levels > L
+      || (0 != top_shift && L != num_levels)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  uint32_t sizes[L];
+  uint32_t total = 0;
+
+  for (uint8_t level = 0; level < num_levels; level++) {
+    if (0 != ValueCodec::decodeFixedInt<false>(buff, sizes + level)) {
+      return -1;
+    }
+    total += sizes[level];
+  }
+
+  uint32_t capacity = totalCapacity(num_levels);
+
+  if (total > capacity) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (buff->available() < total * sizeof(T)) {
+    errno = ERANGE;
+    return -1;
+  }
+
+  num_levels_ = num_levels;
+  top_shift_ = top_shift;
+  base_ = CAPACITY - capacity;
+  levels_[num_levels_] = CAPACITY;
+
+  for (uint8_t level = num_levels_; level-- > 0;) {
+    levels_[level] = levels_[level + 1] - sizes[level];
+  }
+  for (uint32_t i = levels_[0]; i < CAPACITY; i++) {
+    ValueCodec::decodeFixedInt<false>(buff, items_ + i);
+  }
+  // Levels above the bottom one must be sorted.
+  for (uint8_t level = 1; level < num_levels_; level++) {
+    for (uint32_t i = levels_[level] + 1; i < levels_[level + 1]; i++) {
+      if (items_[i] < items_[i - 1]) {
+        reset();
+        errno = EINVAL;
+        return -1;
+      }
+    }
+  }
+
+  n_ = n;
+  min_ = min_val;
+  max_ = max_val;
+  bottom_sorted_ = false;
+  return 0;
+}
+
+/////////////////////////////////////////////// PRIVATE ////////////////////////////////////////////
+
+//============================================= OPERATIONS =========================================
+
+template<typename T, uint16_t K, uint8_t L>
+inline uint32_t QuantileSketch<T, K, L>::size(uint8_t level) const
+{
+  return levels_[level + 1] - levels_[level];
+}
+
+template<typename T, uint16_t K, uint8_t L>
+inline uint32_t QuantileSketch<T, K, L>::capacity(uint8_t level) const
+{
+  return caps_[num_levels_ - 1 - level];
+}
+
+template<typename T, uint16_t K, uint8_t L>
+inline uint8_t QuantileSketch<T, K, L>::exponent(uint8_t level) const
+{
+  return level + (level + 1 == num_levels_ ? top_shift_ : 0);
+}
+
+template<typename T, uint16_t K, uint8_t L>
+inline uint32_t QuantileSketch<T, K, L>::totalCapacity(uint8_t levels) const
+{
+  uint32_t total = 0;
+
+  for (uint8_t depth = 0; depth < levels; depth++) {
+    total += caps_[depth];
+  }
+  return total;
+}
+
+template<typename T, uint16_t K, uint8_t L>
+inline uint64_t QuantileSketch<T, K, L>::weight() const
+{
+  uint64_t total = 0;
+
+  for (uint8_t level = 0; level < num_levels_; level++) {
+    total += uint64_t(size(level)) << exponent(level);
+  }
+  return total;
+}
+
+template<typename T, uint16_t K, uint8_t L>
+inline void QuantileSketch<T, K, L>::add(T val)
+{
+  if (levels_[0] == base_) {
+    compress();
+  }
+
+  --levels_[0];
+  items_[levels_[0]] = val;
+  bottom_sorted_ = false;
+}
+
+template<typename T, uint16_t K, uint8_t L>
+void QuantileSketch<T, K, L>::add(T val, uint8_t exp)
+{
+  if (0 == exp) {
+    add(val);
+    return;
+  }
+
+  if (levels_[0] == base_) {
+    compress();
+  }
+
+  // Both adding a level and thinning the top free space, so there is room for the value.
+  while (exp >= num_levels_ && num_levels_ < L) {
+    addLevel();
+  }
+
+  uint8_t level = exp;
+
+  if (exp + 1 >= num_levels_) {
+    level = num_levels_ - 1;
+
+    while (exp > exponent(level)) {
+      thinTop();
+    }
+
+    // The top level is heavier: keep the value with the probability of the weight ratio.
+    uint32_t ratio_mask = (uint32_t(1) << (exponent(level) - exp)) - 1;
+
+    if (0 != (random() & ratio_mask)) {
+      return;
+    }
+  }
+
+  // Insert keeping the level sorted, moving the values below the insertion point down a slot.
+  uint32_t pos = levels_[level];
+
+  while (pos < levels_[level + 1] && !(val < items_[pos])) {
+    ++pos;
+  }
+
+  memmove(items_ + levels_[0] - 1, items_ + levels_[0], (pos - levels_[0]) * sizeof(T));
+  items_[pos - 1] = val;
+
+  for (uint8_t i = 0; i <= level; i++) {
+    --levels_[i];
+  }
+}
+
+template<typename T, uint16_t K, uint8_t L>
+void QuantileSketch<T, K, L>::compress()
+{
+  // The levels fill the array, so at least one of them reached its capacity.
+  uint8_t level = 0;
+
+  while (level + 1 < num_levels_ && size(level) < capacity(level)) {
+    ++level;
+  }
+
+  if (level + 1 == num_levels_) {
+    if (num_levels_ == L) {
+      thinTop();
+      return;
+    }
+    addLevel();
+  }
+  compact(level);
+}
+
+template<typename T, uint16_t K, uint8_t L>
+inline void QuantileSketch<T, K, L>::addLevel()
+{
+  ++num_levels_;
+  levels_[num_levels_] = CAPACITY;
+  base_ -= caps_[num_levels_ - 1];
+}
+
+template<typename T, uint16_t K, uint8_t L>
+void QuantileSketch<T, K, L>::compact(uint8_t level)
+{
+  uint32_t raw_beg = levels_[level];
+  uint32_t raw_lim = levels_[level + 1];
+  uint32_t raw_pop = raw_lim - raw_beg;
+  uint32_t pop_above = levels_[level + 2] - raw_lim;
+
+  // Every stride-th value from a random offset moves up, so each one does with the probability of
+  // the weight ratio. The stride is 2, or more if the next level is the thinned top. With stride
+  // 2, an odd value stays at this level, so exactly half of the others move.
+  uint32_t stride = (level + 2 == num_levels_ ? uint32_t(2) << top_shift_ : 2);
+  uint32_t keep = (2 == stride ? raw_pop % 2 : 0);
+  uint32_t adj_beg = raw_beg + keep;
+  uint32_t adj_pop = raw_pop - keep;
+  uint32_t offset = random() & (stride - 1);
+  uint32_t out_pop = (adj_pop + stride - 1 - offset) / stride;
+
+  if (0 == level) {
+    Sorters::heapSort(items_ + adj_beg, adj_pop);
+  }
+
+  for (uint32_t j = 0; j < out_pop; j++) {
+    items_[adj_beg + j] = items_[adj_beg + j * stride + offset];
+  }
+
+  // Merge the picked values with the next level into the slots ending at its end. At most half of
+  // the values are picked, so the output never overtakes unread picked values, and the unread
+  // values of the next level are already in place once the picked ones run out.
+  uint32_t a = adj_beg;
+  uint32_t a_lim = adj_beg + out_pop;
+  uint32_t b = raw_lim;
+  uint32_t b_lim = raw_lim + pop_above;
+  uint32_t d = raw_lim - out_pop;
+
+  while (a < a_lim) {
+    if (b < b_lim && items_[b] < items_[a]) {
+      items_[d++] = items_[b++];
+    } else {
+      items_[d++] = items_[a++];
+    }
+  }
+
+  levels_[level + 1] = raw_lim - out_pop;
+
+  // The odd value moves up next to the next level.
+  uint32_t new_beg = levels_[level + 1] - keep;
+
+  if (0 != keep) {
+    items_[new_beg] = items_[raw_beg];
+  }
+
+  levels_[level] = new_beg;
+  shiftUp(level, raw_beg, new_beg - raw_beg);
+}
+
+template<typename T, uint16_t K, uint8_t L>
+void QuantileSketch<T, K, L>::thinTop()
+{
+  uint8_t level = num_levels_ - 1;
+  uint32_t raw_beg = levels_[level];
+  uint32_t raw_pop = CAPACITY - raw_beg;
+  uint32_t offset = (raw_pop > 1 ? random() & 1 : 0);
+  uint32_t out_pop = (raw_pop + 1 - offset) / 2;
+
+  for (uint32_t j = out_pop; j-- > 0;) {
+    items_[CAPACITY - out_pop + j] = items_[raw_beg + 2 * j + offset];
+  }
+
+  levels_[level] = CAPACITY - out_pop;
+
+  // Beyond this, the weight of the top values wouldn't fit 64 bits. Dropping values without
+  // adjusting the weight biases the results, but takes over 2^60 values.
+  if (top_shift_ < 30) {
+    ++top_shift_;
+  }
+  shiftUp(level, raw_beg, levels_[level] - raw_beg);
+}
+
+template<typename T, uint16_t K, uint8_t L>
+inline void QuantileSketch<T, K, L>::shiftUp(uint8_t level, uint32_t begin, uint32_t slots)
+{
+  if (0 == level || 0 == slots) {
+    return;
+  }
+
+  memmove(items_ + levels_[0] + slots, items_ + levels_[0], (begin - levels_[0]) * sizeof(T));
+
+  for (uint8_t i = 0; i < level; i++) {
+    levels_[i] += slots;
+  }
+}
+
+template<typename T, uint16_t K, uint8_t L>
+inline void QuantileSketch<T, K, L>::sortBottom() const
+{
+  if (!bottom_sorted_) {
+    Sorters::heapSort(items_ + levels_[0], size(0));
+    bottom_sorted_ = true;
+  }
+}
+
+template<typename T, uint16_t K, uint8_t L>
+inline uint32_t QuantileSketch<T, K, L>::random()
+{
+  // xorshift32
+  rng_ ^= rng_ << 13;
+  rng_ ^= rng_ >> 17;
+  rng_ ^= rng_ << 5;
+  return rng_;
+}
+
+} // namespace btr
+
+#endif // _btr_QuantileSketch_hpp_
@@ -0,0 +1,312 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+#ifndef _btr_RollupStore_hpp_
+#define _btr_RollupStore_hpp_
+
+// SYSTEM INCLUDES
+#include <inttypes.h>
+
+// PROJECT INCLUDES
+
+namespace btr
+{
+
+/**
+ * The class keeps downsampled aggregates of a time series at several resolutions, e.g. 1-second,
+ * 1-minute and 1-hour buckets of a sensor channel. Each level is a ring of the last B buckets
+ * that received values, and a bucket holds the count, minimum, maximum and sum of the values in
+ * [start, start + width). A push updates the newest bucket of every level, so it takes O(L), and
+ * divides only when a bucket is opened.
+ *
+ * query() aggregates a time range from the coarsest level whose buckets fit the range, so a long
+ * range takes few buckets while a short one keeps full resolution.
+ *
+ * Bucket starts are multiples of the level width. Timestamps must not decrease; their
+ * differences are compared, so the millisecond counter may wrap around, although the bucket
+ * straddling the wrap is shorter.
+ *
+ * IMPORTANT: The class is shared by AVR and x86 platforms. Keep it portable.
+ *
+ * @tparam L - the number of levels
+ * @tparam B - the number of buckets per level
+ * @tparam A - the type of sums and means, e.g. float
+ */
+template<typename T, uint8_t L = 3, uint16_t B = 60, typename A = float>
+class RollupStore
+{
+public:
+
+  static_assert(L > 0, "Store must have at least one level");
+  static_assert(B > 0, "Level must hold at least one bucket");
+
+  /** Aggregate of the values in a time range. */
+  struct Bucket
+  {
+    /**
+     * @return the mean of the values, 0 if there are none
+     */
+    A mean() const
+    {
+      return (count_ > 0 ? sum_ / A(count_) : A(0));
+    }
+
+    uint32_t start_;
+    uint32_t count_;
+    T min_;
+    T max_;
+    A sum_;
+  };
+
+// LIFECYCLE
+
+  /**
+   * Ctor.
+   *
+   * @param widths_ms - L bucket widths in milliseconds from the finest level, each a multiple
+   *  of the previous one
+   */
+  RollupStore(const uint32_t* widths_ms);
+
+// OPERATIONS
+
+  /**
+   * Remove all buckets.
+   */
+  void reset();
+
+  /**
+   * Add a value to every level.
+   *
+   * @param val - the value to add
+   * @param now_ms - the time of the value in milliseconds
+   */
+  void push(T val, uint32_t now_ms);
+
+  /**
+   * Aggregate the values in a time range.
+   *
+   * The range is answered from the coarsest level that still holds its start and whose buckets
+   * don't cross its ends, i.e. both ends are multiples of the width or the end is after the last
+   * value. Otherwise it is answered from the finest level that holds its start, so buckets
+   * crossing the ends are counted if they start in the range.
+   *
+   * @param from_ms - the start of the range
+   * @param to_ms - the end of the range, excluded
+   * @param out - the aggregate, with from_ms as its start
+   * @return the level used
+   */
+  uint8_t query(uint32_t from_ms, uint32_t to_ms, Bucket* out) const;
+
+  /**
+   * @return the width of a level's buckets in milliseconds
+   */
+  uint32_t width(uint8_t level) const;
+
+  /**
+   * @return the number of buckets at a level
+   */
+  uint16_t size(uint8_t level) const;
+
+  /**
+   * @param level - the level
+   * @param age - 0 for the newest bucket, up to size(level) - 1 for the oldest
+   * @return the bucket, nullptr if there's no bucket of that age
+   */
+  const Bucket* bucket(uint8_t level, uint16_t age) const;
+
+private:
+
+  struct Level
+  {
+    Bucket buckets_[B];
+    uint32_t width_;
+    uint16_t head_;
+    uint16_t size_;
+  };
+
+// OPERATIONS
+
+  /**
+   * @return true if time a comes before time b
+   */
+  static bool before(uint32_t a, uint32_t b);
+
+  /**
+   * @return true if a level holds the buckets from the given time on
+   */
+  bool covers(uint8_t level, uint32_t from_ms) const;
+
+// ATTRIBUTES
+
+  Level levels_[L];
+  uint32_t last_ms_;
+
+}; // class RollupStore
+
+////////////////////////////////////////////////////////////////////////////////
+// INLINE OPERATIONS
+////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////// PUBLIC ///////////////////////////////////
+
+//=================================== LIFECYCLE ================================
+
+template<typename T, uint8_t L, uint16_t B, typename A>
+inline RollupStore<T,L,B,A>::RollupStore(const uint32_t* widths_ms)
+  :
+    levels_(),
+    last_ms_(0)
+{
+  for (uint8_t i = 0; i < L; i++) {
+    levels_[i].width_ = widths_ms[i];
+  }
+}
+
+//=================================== OPERATIONS ===============================
+
+template<typename T, uint8_t L, uint16_t B, typename A>
+inline void RollupStore<T,L,B,A>::reset()
+{
+  for (uint8_t i = 0; i < L; i++) {
+    levels_[i].head_ = 0;
+    levels_[i].size_ = 0;
+  }
+  last_ms_ = 0;
+}
+
+template<typename T, uint8_t L, uint16_t B, typename A>
+inline void RollupStore<T,L,B,A>::push(T val, uint32_t now_ms)
+{
+  for (uint8_t i = 0; i < L; i++) {
+    Level& level = levels_[i];
+    Bucket* bucket = level.buckets_ + level.head_;
+
+    if (level.size_ > 0 && now_ms - bucket->start_ < level.width_) {
+      bucket->count_ += 1;
+      bucket->min_ = (val < bucket->min_ ? val : bucket->min_);
+      bucket->max_ = (bucket->max_ < val ? val : bucket->max_);
+      bucket->sum_ += A(val);
+      continue;
+    }
+
+    // Open a bucket, dropping the oldest one if the ring is full.
+    if (level.size_ > 0) {
+      level.head_ = (level.head_ + 1 == B ? 0 : level.head_ + 1);
+      bucket = level.buckets_ + level.head_;
+    }
+    level.size_ += (level.size_ < B ? 1 : 0);
+
+    bucket->start_ = now_ms - now_ms % level.width_;
+    bucket->count_ = 1;
+    bucket->min_ = val;
+    bucket->max_ = val;
+    bucket->sum_ = A(val);
+  }
+
+  last_ms_ = now_ms;
+}
+
+template<typename T, uint8_t L, uint16_t B, typename A>
+uint8_t RollupStore<T,L,B,A>::query(uint32_t from_ms, uint32_t to_ms, Bucket* out) const
+{
+  uint8_t found = L;
+
+  for (uint8_t i = L; i-- > 0 && L == found;) {
+    const Level& level = levels_[i];
+
+    if (covers(i, from_ms) && 0 == from_ms % level.width_
+        && (0 == to_ms % level.width_ || before(last_ms_, to_ms))) {
+      found = i;
+    }
+  }
+  for (uint8_t i = 0; i < L && L == found; i++) {
+    if (covers(i, from_ms)) {
+      found = i;
+    }
+  }
+  if (L == found) {
+    // Nothing holds the start, so the coarsest level holds the most of the range.
+    found = L - 1;
+  }
+
+  out->start_ = from_ms;
+  out->count_ = 0;
+  out->min_ = T();
+  out->max_ = T();
+  out->sum_ = A(0);
+
+  // Walk from the newest bucket back to the start of the range.
+  for (uint16_t age = 0; age < levels_[found].size_; age++) {
+    const Bucket* bucket = this->bucket(found, age);
+
+    if (before(bucket->start_, from_ms)) {
+      break;
+    }
+    if (!before(bucket->start_, to_ms)) {
+      continue;
+    }
+
+    if (0 == out->count_ || bucket->min_ < out->min_) {
+      out->min_ = bucket->min_;
+    }
+    if (0 == out->count_ || out->max_ < bucket->max_) {
+      out->max_ = bucket->max_;
+    }
+    out->count_ += bucket->count_;
+    out->sum_ += bucket->sum_;
+  }
+  return found;
+}
+
+template<typename T, uint8_t L, uint16_t B, typename A>
+inline uint32_t RollupStore<T,L,B,A>::width(uint8_t level) const
+{
+  return levels_[level].width_;
+}
+
+template<typename T, uint8_t L, uint16_t B, typename A>
+inline uint16_t RollupStore<T,L,B,A>::size(uint8_t level) const
+{
+  return levels_[level].size_;
+}
+
+template<typename T, uint8_t L, uint16_t B, typename A>
+inline const typename RollupStore<T,L,B,A>::Bucket* RollupStore<T,L,B,A>::bucket(uint8_t level,
+  uint16_t age) const
+{
+  const Level& lvl = levels_[level];
+
+  if (age >= lvl.size_) {
+    return nullptr;
+  }
+  return lvl.buckets_ + (lvl.head_ >= age ? lvl.head_ - age : lvl.head_ + B - age);
+}
+
+///////////////////////////////////// PRIVATE //////////////////////////////////
+
+//=================================== OPERATIONS ===============================
+
+template<typename T, uint8_t L, uint16_t B, typename A>
+inline bool RollupStore<T,L,B,A>::before(uint32_t a, uint32_t b)
+{
+  return (int32_t(a - b) < 0);
+}
+
+template<typename T, uint8_t L, uint16_t B, typename A>
+inline bool RollupStore<T,L,B,A>::covers(uint8_t level, uint32_t from_ms) const
+{
+  uint16_t size = levels_[level].size_;
+
+  // Only a full ring may have dropped buckets before its oldest one.
+  return (size > 0 && (size < B || !before(from_ms, bucket(level, size - 1)->start_)));
+}
+
+} // namespace btr
+
+#endif // _btr_RollupStore_hpp_
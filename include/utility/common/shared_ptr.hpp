@@ -11,6 +11,9 @@
 
 // SYSTEM INCLUDES
 #include <stdlib.h>
+#if BTR_X86 > 0
+#include <atomic>
+#endif
 
 // PROJECT INCLUDES
 #include "utility/common/spin_lock.hpp"
@@ -19,7 +22,8 @@ namespace btr
 {
 
 /**
- * Provide a reference count.
+ * Provide a reference count. On x86, the count is a lock-free atomic so that sharing a pointer
+ * costs one atomic increment.
  */
 class RefCounter
 {
@@ -53,8 +57,12 @@ private:
 
 // ATTRIBUTES
 
+#if BTR_X86 > 0
+  std::atomic<int> count_;
+#else
   SpinLock lock_;
   int count_;
+#endif
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -112,6 +120,10 @@ public:
    */
   PtrType* get();
 
+  /**
+   */
+  const PtrType* get() const;
+
   /**
    * @return the count
    */
@@ -137,11 +149,18 @@ private:
 
 //============================================= LIFECYCLE ==========================================
 
+#if BTR_X86 > 0
+inline RefCounter::RefCounter() :
+  count_(1)
+{
+}
+#else
 inline RefCounter::RefCounter() :
   lock_(),
   count_(1)
 {
 }
+#endif
 
 template<typename PtrType>
 inline SharedPtr<PtrType>::SharedPtr() :
@@ -208,22 +227,35 @@ inline SharedPtr<PtrType>::~SharedPtr()
 
 inline void RefCounter::increment()
 {
+#if BTR_X86 > 0
+  count_.fetch_add(1, std::memory_order_relaxed);
+#else
   lock_.lock();
   ++count_;
   lock_.unlock();
+#endif
 }
 
 inline int RefCounter::decrement()
 {
+#if BTR_X86 > 0
+  // Acquire-release so that the thread releasing the last reference sees all writes to the object.
+  return (count_.fetch_sub(1, std::memory_order_acq_rel) - 1);
+#else
   lock_.lock();
-  --count_;
+  int count = --count_;
   lock_.unlock();
-  return count_;
+  return count;
+#endif
 }
 
 inline int RefCounter::count() const
 {
+#if BTR_X86 > 0
+  return count_.load(std::memory_order_acquire);
+#else
   return count_;
+#endif
 }
 
 template<typename PtrType>
@@ -244,6 +276,12 @@ PtrType* SharedPtr<PtrType>::get()
   return ptr_;
 }
 
+template<typename PtrType>
+const PtrType* SharedPtr<PtrType>::get() const
+{
+  return ptr_;
+}
+
 template<typename PtrType>
 int SharedPtr<PtrType>::count() const
 {
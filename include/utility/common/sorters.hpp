@@ -40,6 +40,26 @@ public:
   template<typename T>
   static void insertionSort(T* arr, uint32_t size);
 
+  /**
+   * Sort array in-place using heap sort. Unlike insertionSort, it runs in O(n log n) for any
+   * input, and unlike quicksort, it needs no recursion or extra memory.
+   *
+   * @param arr - elements to sort
+   * @param size - the number of elements
+   */
+  template<typename T>
+  static void heapSort(T* arr, uint32_t size);
+
+private:
+
+  // OPERATIONS
+
+  /**
+   * Move element at index i down a max-heap of size elements until its children are smaller.
+   */
+  template<typename T>
+  static void siftDown(T* arr, uint32_t i, uint32_t size);
+
 }; // class Sorters
 
 /////////////////////////////////////////////// INLINE /////////////////////////////////////////////
@@ -63,6 +83,48 @@ inline void Sorters::insertionSort(T* arr, uint32_t size)
   }
 }
 
+template<typename T>
+inline void Sorters::heapSort(T* arr, uint32_t size)
+{
+  if (size < 2) {
+    return;
+  }
+
+  for (uint32_t i = size / 2; i > 0; i--) {
+    siftDown(arr, i - 1, size);
+  }
+
+  for (uint32_t end = size - 1; end > 0; end--) {
+    T tmp = arr[0];
+    arr[0] = arr[end];
+    arr[end] = tmp;
+    siftDown(arr, 0, end);
+  }
+}
+
+/////////////////////////////////////////////// PRIVATE ////////////////////////////////////////////
+
+//============================================= OPERATIONS =========================================
+
+template<typename T>
+inline void Sorters::siftDown(T* arr, uint32_t i, uint32_t size)
+{
+  T val = arr[i];
+
+  // The first child index is computed in 64 bits, so it can't wrap for large arrays.
+  for (uint64_t child = 2 * uint64_t(i) + 1; child < size; child = 2 * uint64_t(i) + 1) {
+    if (child + 1 < size && arr[child] < arr[child + 1]) {
+      ++child;
+    }
+    if (!(val < arr[child])) {
+      break;
+    }
+    arr[i] = arr[child];
+    i = child;
+  }
+  arr[i] = val;
+}
+
 } // namespace btr
 
 #endif // _btr_Sorters_hpp_
@@ -0,0 +1,866 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+#ifndef _btr_StatTrackers_hpp_
+#define _btr_StatTrackers_hpp_
+
+// SYSTEM INCLUDES
+#include <inttypes.h>
+#include <math.h>
+
+// PROJECT INCLUDES
+#include "utility/common/defines.hpp"
+#include "utility/common/time.hpp"
+
+namespace btr
+{
+
+/**
+ * The class keeps the mean and variance of the last S values with Welford's update, which
+ * stays numerically stable for values far from zero. Each push is O(1). Unlike ValueTracker,
+ * the window starts empty and grows up to S values.
+ *
+ * Rounding errors of the incremental update are dropped once per S pushes by recomputing both
+ * statistics from the window.
+ *
+ * IMPORTANT: The class is shared by AVR and x86 platforms. Keep it portable.
+ *
+ * @tparam S - the number of tracked values
+ * @tparam R - floating point type of the results
+ */
+template<typename T, uint32_t S = 16, typename R = float>
+class VarianceTracker
+{
+public:
+
+  static_assert(S > 1, "Window must hold at least two values");
+
+// LIFECYCLE
+
+  /**
+   * Ctor.
+   */
+  VarianceTracker();
+
+// OPERATIONS
+
+  /**
+   * Remove all values.
+   */
+  void reset();
+
+  /**
+   * Add new value, dropping the oldest one if the window is full.
+   *
+   * @param val - the value to add
+   */
+  void push(T val);
+
+  /**
+   * @return the number of values in the window
+   */
+  uint32_t count() const;
+
+  /**
+   * @return the mean of the values in the window
+   */
+  R mean() const;
+
+  /**
+   * @return the sample variance of the values in the window, 0 if there are less than two
+   */
+  R variance() const;
+
+  /**
+   * @return the sample standard deviation
+   */
+  R stddev() const;
+
+private:
+
+// OPERATIONS
+
+  /**
+   * Recompute the mean and the sum of squared deviations from the window.
+   */
+  void recompute();
+
+// ATTRIBUTES
+
+  T vals_[S];
+  R mean_;
+  R m2_;
+  uint32_t pos_;
+  uint32_t count_;
+
+}; // class VarianceTracker
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * The class keeps an exponential moving average and exponentially weighted variance of the
+ * values. It takes O(1) memory and time regardless of the smoothing period.
+ *
+ * @tparam R - floating point type of the results
+ */
+template<typename R = float>
+class EmaTracker
+{
+public:
+
+// LIFECYCLE
+
+  /**
+   * Ctor.
+   *
+   * @param alpha - the weight of a new value, in (0, 1]
+   */
+  EmaTracker(R alpha);
+
+// OPERATIONS
+
+  /**
+   * @return the weight that gives an average with the same center of mass as a simple moving
+   *  average of the given number of values
+   */
+  static R alphaForPeriod(uint32_t period);
+
+  /**
+   * Forget all values.
+   */
+  void reset();
+
+  /**
+   * Add new value. The first value initializes the average.
+   *
+   * @param val - the value to add
+   */
+  void push(R val);
+
+  /**
+   * @return the weight of a new value
+   */
+  R alpha() const;
+
+  /**
+   * @return true if at least one value was pushed
+   */
+  bool ready() const;
+
+  /**
+   * @return the moving average
+   */
+  R mean() const;
+
+  /**
+   * @return the exponentially weighted variance
+   */
+  R variance() const;
+
+  /**
+   * @return the square root of the variance
+   */
+  R stddev() const;
+
+private:
+
+// ATTRIBUTES
+
+  R alpha_;
+  R mean_;
+  R var_;
+  bool ready_;
+
+}; // class EmaTracker
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * The class keeps the minimum and maximum of the last S values. Two monotonic queues hold the
+ * values that can still become the minimum or the maximum, so a push is amortized O(1) and both
+ * queries are O(1). Like VarianceTracker, the window starts empty.
+ *
+ * @tparam S - the number of tracked values
+ */
+template<typename T, uint32_t S = 16>
+class MinMaxTracker
+{
+public:
+
+  static_assert(S > 0, "Window must hold at least one value");
+
+// LIFECYCLE
+
+  /**
+   * Ctor.
+   */
+  MinMaxTracker();
+
+// OPERATIONS
+
+  /**
+   * Remove all values.
+   */
+  void reset();
+
+  /**
+   * Add new value, dropping the oldest one if the window is full.
+   *
+   * @param val - the value to add
+   */
+  void push(T val);
+
+  /**
+   * @return the number of values in the window
+   */
+  uint32_t count() const;
+
+  /**
+   * @return the minimum value in the window. The window must not be empty.
+   */
+  T min() const;
+
+  /**
+   * @return the maximum value in the window. The window must not be empty.
+   */
+  T max() const;
+
+private:
+
+  /** Ring of values ordered by push sequence, each later one greater (or less) than before. */
+  struct Queue
+  {
+    T vals_[S];
+    uint32_t seqs_[S];
+    uint32_t head_;
+    uint32_t size_;
+  };
+
+// OPERATIONS
+
+  /**
+   * @return index reduced to [0, S). The index must be less than 2 * S.
+   */
+  static uint32_t wrap(uint32_t index);
+
+  /**
+   * Push a value to a queue, dropping values it supersedes and values that left the window.
+   *
+   * @param keep - keep(queued, val) returns true if the queued value may still be reported
+   *  after val is pushed
+   */
+  template<typename F>
+  void push(Queue* queue, T val, F keep);
+
+// ATTRIBUTES
+
+  Queue min_;
+  Queue max_;
+  uint32_t seq_;
+  uint32_t count_;
+
+}; // class MinMaxTracker
+
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * The class keeps statistics of values pushed within the last window_ms milliseconds, for sensors
+ * sampled at irregular rates. Timestamps come from the caller or, on MCUs, from Time::millis().
+ * Expired values are dropped from the oldest end, so a push is amortized O(1). The mean comes from
+ * a running sum, and the minimum and maximum from monotonic queues like in MinMaxTracker.
+ *
+ * Memory is fixed: the window holds S values at most, and pushing to a full window drops the
+ * oldest value even if it hasn't expired yet.
+ *
+ * @tparam S - the maximum number of values in the window
+ * @tparam R - floating point type of the results
+ */
+template<typename T, uint32_t S = 32, typename R = float>
+class TimeWindowTracker
+{
+public:
+
+  static_assert(S > 1, "Window must hold at least two values");
+
+// LIFECYCLE
+
+  /**
+   * Ctor.
+   *
+   * @param window_ms - the window length in milliseconds
+   */
+  TimeWindowTracker(uint32_t window_ms);
+
+// OPERATIONS
+
+  /**
+   * Remove all values.
+   */
+  void reset();
+
+  /**
+   * Drop expired values and add a new one. Timestamps must not decrease, but may wrap around.
+   *
+   * @param val - the value to add
+   * @param now_ms - the time of the value in milliseconds
+   */
+  void push(T val, uint32_t now_ms);
+
+  /**
+   * Drop values older than the window as of the given time, so that queries cover it.
+   *
+   * @param now_ms - the current time in milliseconds
+   */
+  void expire(uint32_t now_ms);
+
+#if BTR_ESP32 > 0 || BTR_STM32 > 0 || BTR_AVR > 0
+  /**
+   * Add a new value at the current time.
+   *
+   * @param val - the value to add
+   */
+  void push(T val);
+
+  /**
+   * Drop values older than the window as of the current time.
+   */
+  void expire();
+#endif // BTR_ESP32 > 0 || BTR_STM32 > 0 || BTR_AVR > 0
+
+  /**
+   * @return the window length in milliseconds
+   */
+  uint32_t window() const;
+
+  /**
+   * @return the number of values in the window
+   */
+  uint32_t count() const;
+
+  /**
+   * @return the mean of the values in the window, 0 if it is empty
+   */
+  R mean() const;
+
+  /**
+   * @return the minimum value in the window. The window must not be empty.
+   */
+  T min() const;
+
+  /**
+   * @return the maximum value in the window. The window must not be empty.
+   */
+  T max() const;
+
+  /**
+   * @return the newest value in the window. The window must not be empty.
+   */
+  T last() const;
+
+  /**
+   * @return the number of values per second between the oldest and the newest value, 0 if they
+   *  have the same timestamp
+   */
+  R rate() const;
+
+  /**
+   * @return the change of value per second between the oldest and the newest value, 0 if they
+   *  have the same timestamp
+   */
+  R slope() const;
+
+private:
+
+  struct Sample
+  {
+    uint32_t time_;
+    T val_;
+  };
+
+  /** Ring of sample positions ordered by push time, each later value greater (or less). */
+  struct Queue
+  {
+    uint32_t pos_[S];
+    uint32_t head_;
+    uint32_t size_;
+  };
+
+// OPERATIONS
+
+  /**
+   * @return index reduced to [0, S). The index must be less than 2 * S.
+   */
+  static uint32_t wrap(uint32_t index);
+
+  /**
+   * Drop the oldest value.
+   */
+  void drop();
+
+  /**
+   * Append the newest sample to a queue, dropping the samples it supersedes.
+   *
+   * @param keep - keep(queued, val) returns true if the queued value may still be reported
+   *  after val is pushed
+   */
+  template<typename F>
+  void push(Queue* queue, uint32_t pos, F keep);
+
+  /**
+   * Recompute the sum of the values.
+   */
+  void resum();
+
+// ATTRIBUTES
+
+  Sample samples_[S];
+  Queue min_;
+  Queue max_;
+  R sum_;
+  uint32_t window_ms_;
+  uint32_t head_;
+  uint32_t count_;
+  uint32_t drops_;
+
+}; // class TimeWindowTracker
+
+////////////////////////////////////////////////////////////////////////////////
+// INLINE OPERATIONS
+////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////// PUBLIC ///////////////////////////////////
+
+//=================================== LIFECYCLE ================================
+
+template<typename T, uint32_t S, typename R>
+inline VarianceTracker<T,S,R>::VarianceTracker()
+  :
+    vals_(),
+    mean_(0),
+    m2_(0),
+    pos_(0),
+    count_(0)
+{
+}
+
+template<typename R>
+inline EmaTracker<R>::EmaTracker(R alpha)
+  :
+    alpha_(alpha),
+    mean_(0),
+    var_(0),
+    ready_(false)
+{
+}
+
+template<typename T, uint32_t S>
+inline MinMaxTracker<T,S>::MinMaxTracker()
+  :
+    min_(),
+    max_(),
+    seq_(0),
+    count_(0)
+{
+}
+
+template<typename T, uint32_t S, typename R>
+inline TimeWindowTracker<T,S,R>::TimeWindowTracker(uint32_t window_ms)
+  :
+    samples_(),
+    min_(),
+    max_(),
+    sum_(0),
+    window_ms_(window_ms),
+    head_(0),
+    count_(0),
+    drops_(0)
+{
+}
+
+//=================================== OPERATIONS ===============================
+
+template<typename T, uint32_t S, typename R>
+inline void VarianceTracker<T,S,R>::reset()
+{
+  mean_ = 0;
+  m2_ = 0;
+  pos_ = 0;
+  count_ = 0;
+}
+
+template<typename T, uint32_t S, typename R>
+inline void VarianceTracker<T,S,R>::push(T val)
+{
+  R x = R(val);
+
+  if (count_ < S) {
+    ++count_;
+    R diff = x - mean_;
+    mean_ += diff / count_;
+    m2_ += diff * (x - mean_);
+  } else {
+    // Replace the oldest value: the mean moves by the difference over S, and the sum of
+    // squared deviations by the product of the changes relative to both means.
+    R old = R(vals_[pos_]);
+    R old_mean = mean_;
+    mean_ += (x - old) / S;
+    m2_ += (x - old) * (x - mean_ + old - old_mean);
+  }
+
+  vals_[pos_] = val;
+  pos_ = (pos_ + 1 == S ? 0 : pos_ + 1);
+
+  if (0 == pos_) {
+    recompute();
+  }
+}
+
+template<typename T, uint32_t S, typename R>
+inline uint32_t VarianceTracker<T,S,R>::count() const
+{
+  return count_;
+}
+
+template<typename T, uint32_t S, typename R>
+inline R VarianceTracker<T,S,R>::mean() const
+{
+  return mean_;
+}
+
+template<typename T, uint32_t S, typename R>
+inline R VarianceTracker<T,S,R>::variance() const
+{
+  // Cancellation may leave a tiny negative remainder when all values are equal.
+  return (count_ > 1 && m2_ > 0 ? m2_ / (count_ - 1) : R(0));
+}
+
+template<typename T, uint32_t S, typename R>
+inline R VarianceTracker<T,S,R>::stddev() const
+{
+  return sqrt(variance());
+}
+
+template<typename R>
+inline R EmaTracker<R>::alphaForPeriod(uint32_t period)
+{
+  return R(2) / (R(period) + 1);
+}
+
+template<typename R>
+inline void EmaTracker<R>::reset()
+{
+  mean_ = 0;
+  var_ = 0;
+  ready_ = false;
+}
+
+template<typename R>
+inline void EmaTracker<R>::push(R val)
+{
+  if (!ready_) {
+    mean_ = val;
+    var_ = 0;
+    ready_ = true;
+    return;
+  }
+
+  R diff = val - mean_;
+  R incr = alpha_ * diff;
+  mean_ += incr;
+  var_ = (1 - alpha_) * (var_ + diff * incr);
+}
+
+template<typename R>
+inline R EmaTracker<R>::alpha() const
+{
+  return alpha_;
+}
+
+template<typename R>
+inline bool EmaTracker<R>::ready() const
+{
+  return ready_;
+}
+
+template<typename R>
+inline R EmaTracker<R>::mean() const
+{
+  return mean_;
+}
+
+template<typename R>
+inline R EmaTracker<R>::variance() const
+{
+  return var_;
+}
+
+template<typename R>
+inline R EmaTracker<R>::stddev() const
+{
+  return sqrt(var_);
+}
+
+template<typename T, uint32_t S>
+inline void MinMaxTracker<T,S>::reset()
+{
+  min_.size_ = 0;
+  max_.size_ = 0;
+  count_ = 0;
+}
+
+template<typename T, uint32_t S>
+inline void MinMaxTracker<T,S>::push(T val)
+{
+  ++seq_;
+  count_ += (count_ < S ? 1 : 0);
+  push(&min_, val, [](T queued, T v) { return queued < v; });
+  push(&max_, val, [](T queued, T v) { return v < queued; });
+}
+
+template<typename T, uint32_t S>
+inline uint32_t MinMaxTracker<T,S>::count() const
+{
+  return count_;
+}
+
+template<typename T, uint32_t S>
+inline T MinMaxTracker<T,S>::min() const
+{
+  return min_.vals_[min_.head_];
+}
+
+template<typename T, uint32_t S>
+inline T MinMaxTracker<T,S>::max() const
+{
+  return max_.vals_[max_.head_];
+}
+
+template<typename T, uint32_t S, typename R>
+inline void TimeWindowTracker<T,S,R>::reset()
+{
+  min_.size_ = 0;
+  max_.size_ = 0;
+  sum_ = 0;
+  count_ = 0;
+  drops_ = 0;
+}
+
+template<typename T, uint32_t S, typename R>
+inline void TimeWindowTracker<T,S,R>::push(T val, uint32_t now_ms)
+{
+  expire(now_ms);
+
+  if (S == count_) {
+    drop();
+  }
+
+  uint32_t pos = wrap(head_ + count_);
+  samples_[pos].time_ = now_ms;
+  samples_[pos].val_ = val;
+  ++count_;
+  sum_ += R(val);
+
+  push(&min_, pos, [](T queued, T v) { return queued < v; });
+  push(&max_, pos, [](T queued, T v) { return v < queued; });
+}
+
+template<typename T, uint32_t S, typename R>
+inline void TimeWindowTracker<T,S,R>::expire(uint32_t now_ms)
+{
+  // Only the age is compared, so timestamps may wrap around.
+  while (count_ > 0 && now_ms - samples_[head_].time_ >= window_ms_) {
+    drop();
+  }
+}
+
+#if BTR_ESP32 > 0 || BTR_STM32 > 0 || BTR_AVR > 0
+template<typename T, uint32_t S, typename R>
+inline void TimeWindowTracker<T,S,R>::push(T val)
+{
+  push(val, MILLIS());
+}
+
+template<typename T, uint32_t S, typename R>
+inline void TimeWindowTracker<T,S,R>::expire()
+{
+  expire(MILLIS());
+}
+#endif // BTR_ESP32 > 0 || BTR_STM32 > 0 || BTR_AVR > 0
+
+template<typename T, uint32_t S, typename R>
+inline uint32_t TimeWindowTracker<T,S,R>::window() const
+{
+  return window_ms_;
+}
+
+template<typename T, uint32_t S, typename R>
+inline uint32_t TimeWindowTracker<T,S,R>::count() const
+{
+  return count_;
+}
+
+template<typename T, uint32_t S, typename R>
+inline R TimeWindowTracker<T,S,R>::mean() const
+{
+  return (count_ > 0 ? sum_ / count_ : R(0));
+}
+
+template<typename T, uint32_t S, typename R>
+inline T TimeWindowTracker<T,S,R>::min() const
+{
+  return samples_[min_.pos_[min_.head_]].val_;
+}
+
+template<typename T, uint32_t S, typename R>
+inline T TimeWindowTracker<T,S,R>::max() const
+{
+  return samples_[max_.pos_[max_.head_]].val_;
+}
+
+template<typename T, uint32_t S, typename R>
+inline T TimeWindowTracker<T,S,R>::last() const
+{
+  return samples_[wrap(head_ + count_ - 1)].val_;
+}
+
+template<typename T, uint32_t S, typename R>
+inline R TimeWindowTracker<T,S,R>::rate() const
+{
+  if (count_ < 2) {
+    return R(0);
+  }
+
+  uint32_t span = samples_[wrap(head_ + count_ - 1)].time_ - samples_[head_].time_;
+  return (span > 0 ? R(count_ - 1) * 1000 / span : R(0));
+}
+
+template<typename T, uint32_t S, typename R>
+inline R TimeWindowTracker<T,S,R>::slope() const
+{
+  if (count_ < 2) {
+    return R(0);
+  }
+
+  const Sample& first = samples_[head_];
+  const Sample& newest = samples_[wrap(head_ + count_ - 1)];
+  uint32_t span = newest.time_ - first.time_;
+  return (span > 0 ? (R(newest.val_) - R(first.val_)) * 1000 / span : R(0));
+}
+
+///////////////////////////////////// PRIVATE //////////////////////////////////
+
+//=================================== OPERATIONS ===============================
+
+template<typename T, uint32_t S, typename R>
+inline void VarianceTracker<T,S,R>::recompute()
+{
+  R sum = 0;
+
+  for (uint32_t i = 0; i < S; i++) {
+    sum += R(vals_[i]);
+  }
+
+  R mean = sum / S;
+  R m2 = 0;
+
+  for (uint32_t i = 0; i < S; i++) {
+    R diff = R(vals_[i]) - mean;
+    m2 += diff * diff;
+  }
+
+  mean_ = mean;
+  m2_ = m2;
+}
+
+template<typename T, uint32_t S>
+inline uint32_t MinMaxTracker<T,S>::wrap(uint32_t index)
+{
+  return (0 == (S & (S - 1)) ? (index & (S - 1)) : (index >= S ? index - S : index));
+}
+
+template<typename T, uint32_t S>
+template<typename F>
+inline void MinMaxTracker<T,S>::push(Queue* queue, T val, F keep)
+{
+  // Values pushed S or more pushes ago left the window. Sequence numbers may wrap around, so
+  // only their difference is compared.
+  if (queue->size_ > 0 && seq_ - queue->seqs_[queue->head_] >= S) {
+    queue->head_ = wrap(queue->head_ + 1);
+    --queue->size_;
+  }
+
+  while (queue->size_ > 0
+      && !keep(queue->vals_[wrap(queue->head_ + queue->size_ - 1)], val)) {
+    --queue->size_;
+  }
+
+  uint32_t tail = wrap(queue->head_ + queue->size_);
+  queue->vals_[tail] = val;
+  queue->seqs_[tail] = seq_;
+  ++queue->size_;
+}
+
+template<typename T, uint32_t S, typename R>
+inline uint32_t TimeWindowTracker<T,S,R>::wrap(uint32_t index)
+{
+  return (0 == (S & (S - 1)) ? (index & (S - 1)) : (index >= S ? index - S : index));
+}
+
+template<typename T, uint32_t S, typename R>
+inline void TimeWindowTracker<T,S,R>::drop()
+{
+  // The queues refer to the oldest value only at their heads.
+  if (min_.size_ > 0 && min_.pos_[min_.head_] == head_) {
+    min_.head_ = wrap(min_.head_ + 1);
+    --min_.size_;
+  }
+  if (max_.size_ > 0 && max_.pos_[max_.head_] == head_) {
+    max_.head_ = wrap(max_.head_ + 1);
+    --max_.size_;
+  }
+
+  sum_ -= R(samples_[head_].val_);
+  head_ = wrap(head_ + 1);
+  --count_;
+
+  // Rounding errors of the running sum are dropped once per S values.
+  if (++drops_ == S) {
+    drops_ = 0;
+    resum();
+  }
+}
+
+template<typename T, uint32_t S, typename R>
+template<typename F>
+inline void TimeWindowTracker<T,S,R>::push(Queue* queue, uint32_t pos, F keep)
+{
+  T val = samples_[pos].val_;
+
+  while (queue->size_ > 0
+      && !keep(samples_[queue->pos_[wrap(queue->head_ + queue->size_ - 1)]].val_, val)) {
+    --queue->size_;
+  }
+
+  queue->pos_[wrap(queue->head_ + queue->size_)] = pos;
+  ++queue->size_;
+}
+
+template<typename T, uint32_t S, typename R>
+inline void TimeWindowTracker<T,S,R>::resum()
+{
+  R sum = 0;
+
+  for (uint32_t i = 0; i < count_; i++) {
+    sum += R(samples_[wrap(head_ + i)].val_);
+  }
+  sum_ = sum;
+}
+
+} // namespace btr
+
+#endif // _btr_StatTrackers_hpp_
@@ -26,7 +26,7 @@ namespace btr
 /**
  * The class converts between raw bytes and C++ types.
  *
- * IMPORTANT: The class is shared by AVR and x86 plaforms. Keep it portable.
+ * IMPORTANT: The class is shared by AVR and x86 platforms. Keep it portable.
  */
 class ValueCodec
 {
@@ -95,6 +95,19 @@ public:
   template<typename T>
   static void decodeFixedInt(const uint8_t* buff, T* val, uint32_t bytes, bool msb);
 
+  /**
+   * Extract an integer of type T occupying sizeof(T) bytes. The byte order is resolved at compile
+   * time, so the call reduces to a load and, if needed, a single byte-swap instruction.
+   *
+   * IMPORTANT: This function doesn't check for buffer size
+   *
+   * @param buff - data container
+   * @param val - target value
+   * @tparam MSB - the data is in most-significant byte order
+   */
+  template<bool MSB, typename T>
+  static void decodeFixedInt(const uint8_t* buff, T* val);
+
   /**
    * Check buffer and source/target sizes, then call toFixedInt()
    *
@@ -107,6 +120,17 @@ public:
   template<typename T>
   static int decodeFixedInt(Buff* buff, T* val, uint32_t bytes, bool msb);
 
+  /**
+   * Check buffer size, then call decodeFixedInt<MSB>()
+   *
+   * @param buff - buffer to decode the value from
+   * @param val - target value
+   * @tparam MSB - the data is in most-significant byte order
+   * @return the values returned by check()
+   */
+  template<bool MSB, typename T>
+  static int decodeFixedInt(Buff* buff, T* val);
+
   /**
    * Encode a fixed-size integer into a raw buffer.
    *
@@ -127,6 +151,26 @@ public:
   template<typename T>
   static void encodeFixedInt(uint8_t* buff, T val, bool msb);
 
+  /**
+   * Encode a fixed-size integer into a raw buffer with the byte order resolved at compile time.
+   *
+   * @param buff - buffer object to store encoded value
+   * @param val - the value to encode
+   * @tparam MSB - if true, encode in MSB order, otherwise in LSB
+   */
+  template<bool MSB, typename T>
+  static void encodeFixedInt(Buff* buff, T val);
+
+  /**
+   * Encode a fixed-size integer into a raw buffer with the byte order resolved at compile time.
+   *
+   * @param buff - character array to store encoded value
+   * @param val - the value to encode
+   * @tparam MSB - if true, encode in MSB order, otherwise in LSB
+   */
+  template<bool MSB, typename T>
+  static void encodeFixedInt(uint8_t* buff, T val);
+
 #if BTR_FLOAT_ENABLED > 0
 
   /**
@@ -207,9 +251,9 @@ public:
   static int check(Buff* buff, uint32_t target_size, uint32_t source_size);
 
   /**
-   * @return true if this host is little endian
+   * @return true if this host is little endian. The value is known at compile time.
    */
-  static bool isLittleEndian();
+  static constexpr bool isLittleEndian();
 
   /**
    * Convert a value between MSB and LSB host order considering the target and host order.
@@ -220,6 +264,16 @@ public:
   template<typename T>
   static void swap(T* val, bool msb);
 
+  /**
+   * Convert a value between MSB and LSB host order considering the target and host order. The
+   * call compiles to nothing when the target order matches the host.
+   *
+   * @param val - numeric value
+   * @tparam MSB - target order
+   */
+  template<bool MSB, typename T>
+  static void swap(T* val);
+
   /**
    * Convert a value between MSB and LSB host order.
    *
@@ -228,6 +282,29 @@ public:
   template<typename T>
   static void swap(T* val);
 
+private:
+
+  /** Tag type to select byte-swap implementation by value width. */
+  template<uint32_t BYTES>
+  struct Width {};
+
+// OPERATIONS
+
+  template<typename T>
+  static void swapBytes(T* val, Width<1>);
+
+  template<typename T>
+  static void swapBytes(T* val, Width<2>);
+
+  template<typename T>
+  static void swapBytes(T* val, Width<4>);
+
+  template<typename T>
+  static void swapBytes(T* val, Width<8>);
+
+  template<typename T, uint32_t BYTES>
+  static void swapBytes(T* val, Width<BYTES>);
+
 }; // class ValueCodec
 
 /////////////////////////////////////////////// INLINE /////////////////////////////////////////////
@@ -315,6 +392,12 @@ inline void ValueCodec::decodeVarIntNBits(
 template<typename T>
 inline void ValueCodec::decodeFixedInt(const uint8_t* buff, T* val, uint32_t bytes, bool msb)
 {
+  if (bytes == sizeof(T)) {
+    memcpy(val, buff, sizeof(T));
+    swap(val, msb);
+    return;
+  }
+
   *val = 0;
 
   if (msb) {
@@ -342,6 +425,25 @@ inline int ValueCodec::decodeFixedInt(Buff* buff, T* val, uint32_t bytes, bool m
   return rc;
 }
 
+template<bool MSB, typename T>
+inline void ValueCodec::decodeFixedInt(const uint8_t* buff, T* val)
+{
+  memcpy(val, buff, sizeof(T));
+  swap<MSB>(val);
+}
+
+template<bool MSB, typename T>
+inline int ValueCodec::decodeFixedInt(Buff* buff, T* val)
+{
+  int rc = check(buff, sizeof(T), sizeof(T));
+
+  if (0 == rc) {
+    decodeFixedInt<MSB>(buff->read_ptr(), val);
+    buff->advanceReadPtr(sizeof(T));
+  }
+  return rc;
+}
+
 template<typename T>
 inline void ValueCodec::encodeFixedInt(Buff* buff, T val, bool msb)
 {
@@ -357,6 +459,20 @@ inline void ValueCodec::encodeFixedInt(uint8_t* buff, T val, bool msb)
   memcpy(buff, val_bytes, sizeof(T));
 }
 
+template<bool MSB, typename T>
+inline void ValueCodec::encodeFixedInt(Buff* buff, T val)
+{
+  swap<MSB>(&val);
+  buff->write(val);
+}
+
+template<bool MSB, typename T>
+inline void ValueCodec::encodeFixedInt(uint8_t* buff, T val)
+{
+  swap<MSB>(&val);
+  memcpy(buff, &val, sizeof(T));
+}
+
 #if BTR_FLOAT_ENABLED > 0
 
 inline int ValueCodec::encodeFloatToInt(
@@ -458,32 +574,81 @@ inline int ValueCodec::check(Buff* buff, uint32_t target_size, uint32_t source_s
   return rc;
 }
 
-inline bool ValueCodec::isLittleEndian()
+constexpr bool ValueCodec::isLittleEndian()
 {
-  int16_t val = 0x0001;
-  char* ptr = (char*) &val;
-  return (ptr[0] == 1);
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__)
+  return (__BYTE_ORDER__ != __ORDER_BIG_ENDIAN__);
+#else
+  // AVR, ARM Cortex-M and x86 targets are all little endian.
+  return true;
+#endif
 }
 
 template<typename T>
 inline void ValueCodec::swap(T* val, bool msb)
 {
-  if (isLittleEndian()) {
-    if (msb) {
-      swap(val);
-    }
-  } else {
-    if (!msb) {
-      swap(val);
-    }
+  // Swap when the target order differs from the host's: MSB on little endian or LSB on big.
+  //
+  if (msb == isLittleEndian()) {
+    swap(val);
+  }
+}
+
+template<bool MSB, typename T>
+inline void ValueCodec::swap(T* val)
+{
+  if (MSB == isLittleEndian()) {
+    swap(val);
   }
 }
 
 template<typename T>
 inline void ValueCodec::swap(T* val)
+{
+  swapBytes(val, Width<sizeof(T)>());
+}
+
+/////////////////////////////////////////////// PRIVATE ////////////////////////////////////////////
+
+//============================================= OPERATIONS =========================================
+
+template<typename T>
+inline void ValueCodec::swapBytes(T*, Width<1>)
+{
+}
+
+template<typename T>
+inline void ValueCodec::swapBytes(T* val, Width<2>)
+{
+  uint16_t v;
+  memcpy(&v, val, sizeof(v));
+  v = __builtin_bswap16(v);
+  memcpy(val, &v, sizeof(v));
+}
+
+template<typename T>
+inline void ValueCodec::swapBytes(T* val, Width<4>)
+{
+  uint32_t v;
+  memcpy(&v, val, sizeof(v));
+  v = __builtin_bswap32(v);
+  memcpy(val, &v, sizeof(v));
+}
+
+template<typename T>
+inline void ValueCodec::swapBytes(T* val, Width<8>)
+{
+  uint64_t v;
+  memcpy(&v, val, sizeof(v));
+  v = __builtin_bswap64(v);
+  memcpy(val, &v, sizeof(v));
+}
+
+template<typename T, uint32_t BYTES>
+inline void ValueCodec::swapBytes(T* val, Width<BYTES>)
 {
   uint8_t* bytes = reinterpret_cast<uint8_t*>(val);
-  int j = sizeof(T) - 1;
+  int j = BYTES - 1;
 
   for (int i = 0; i < j; i++, j--) {
     uint8_t tmp = bytes[i];
@@ -10,22 +10,132 @@
 #define _btr_ValueTracker_hpp_
 
 // SYSTEM INCLUDES
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
 
 // PROJECT INCLUDES
-#include "utility/common/sorters.hpp"
 
 namespace btr
 {
 
+/**
+ * Storage of ValueTracker values and their sorted copy. By default both arrays are members of
+ * the tracker.
+ */
+template<typename T, uint32_t S, bool HEAP>
+struct ValueTrackerStorage
+{
+  bool valid() const
+  {
+    return true;
+  }
+
+  T vals_[S];
+  T sorted_[S];
+};
+
+/**
+ * Storage allocated on the heap, for windows too large for the stack or a static object.
+ */
+template<typename T, uint32_t S>
+struct ValueTrackerStorage<T, S, true>
+{
+  ValueTrackerStorage() :
+    vals_(static_cast<T*>(calloc(size_t(2) * S, sizeof(T)))),
+    sorted_(nullptr == vals_ ? nullptr : vals_ + S)
+  {
+  }
+
+  ValueTrackerStorage(const ValueTrackerStorage&) = delete;
+  ValueTrackerStorage& operator=(const ValueTrackerStorage&) = delete;
+
+  ~ValueTrackerStorage()
+  {
+    free(vals_);
+  }
+
+  bool valid() const
+  {
+    return (nullptr != vals_);
+  }
+
+  T* vals_;
+  T* sorted_;
+};
+
+/**
+ * The default type of the ValueTracker running sum: wide enough for 65535 values of an integer
+ * type up to 32 bits, and T itself for other types.
+ */
+template<typename T>
+struct ValueTrackerSum
+{
+  typedef T type;
+};
+
+template<>
+struct ValueTrackerSum<int8_t>
+{
+  typedef int32_t type;
+};
+
+template<>
+struct ValueTrackerSum<uint8_t>
+{
+  typedef uint32_t type;
+};
+
+template<>
+struct ValueTrackerSum<int16_t>
+{
+  typedef int32_t type;
+};
+
+template<>
+struct ValueTrackerSum<uint16_t>
+{
+  typedef uint32_t type;
+};
+
+template<>
+struct ValueTrackerSum<int32_t>
+{
+  typedef int64_t type;
+};
+
+template<>
+struct ValueTrackerSum<uint32_t>
+{
+  typedef uint64_t type;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
 /**
  * The class keeps track of numeric values so as to calculate the delta, mean or median between
- * them. 
+ * them.
+ *
+ * push() keeps a running sum and a sorted copy of the values, so mean() and median() take O(1).
+ * The sum is recomputed from the values once per S pushes, so that rounding errors of floating
+ * point types don't accumulate.
+ *
+ * The write position stays within [0, S), so positions are correct after any number of pushes.
+ * For a power of two S, wrapping is a mask.
+ *
+ * @tparam S - the number of tracked values
+ * @tparam HEAP - if true, values are allocated on the heap. If the allocation fails, count()
+ *  returns 0, push() does nothing and the other queries return 0.
+ * @tparam A - the running sum type. It must hold the sum of S values
  */
-template<typename T, uint8_t S = 5>
+template<typename T, uint32_t S = 5, bool HEAP = false,
+         typename A = typename ValueTrackerSum<T>::type>
 class ValueTracker
 {
 public:
 
+  static_assert(S > 0, "Window must hold at least one value");
+
 // LIFECYCLE
 
   /**
@@ -55,9 +165,9 @@ public:
   void push(T val);
 
   /**
-   * @return the count of tracked values 
+   * @return the count of tracked values
    */
-  uint8_t count() const;
+  uint32_t count() const;
 
   /**
    * @return the last pushed value
@@ -67,7 +177,7 @@ public:
   /**
    * @return the value at given requested position. Positions start at 0.
    */
-  T value(uint8_t requested_pos) const;
+  T value(uint32_t requested_pos) const;
 
   /**
    * @return delta between last and one-before last values
@@ -81,7 +191,7 @@ public:
    * @param lower_pos - the second value position
    * @return the delta as in (upper value - lower value)
    */
-  T delta(uint8_t upper_pos, uint8_t lower_pos) const;
+  T delta(uint32_t upper_pos, uint32_t lower_pos) const;
 
   /**
    * @return the median value
@@ -89,16 +199,35 @@ public:
   T median() const;
 
   /**
-   * @return the median value
+   * @return the mean value
    */
   T mean() const;
 
 private:
 
+// OPERATIONS
+
+  /**
+   * @return index reduced to [0, S). The index must be less than 2 * S.
+   */
+  static uint32_t wrap(uint32_t index);
+
+  /**
+   * @return the index of the first sorted value not less than val, or greater than val if upper
+   *  is true
+   */
+  uint32_t bound(T val, bool upper) const;
+
+  /**
+   * Recompute the sum of the values.
+   */
+  void resum();
+
 // ATTRIBUTES
 
-  T vals_[S];
-  uint8_t pos_;
+  ValueTrackerStorage<T, S, HEAP> storage_;
+  A sum_;
+  uint32_t pos_;
   uint8_t id_;
 
 }; // class ValueTracker
@@ -111,10 +240,11 @@ private:
 
 //=================================== LIFECYCLE ================================
 
-template<typename T, uint8_t S>
-inline ValueTracker<T,S>::ValueTracker(uint8_t id)
+template<typename T, uint32_t S, bool HEAP, typename A>
+inline ValueTracker<T,S,HEAP,A>::ValueTracker(uint8_t id)
   :
-    vals_(),
+    storage_(),
+    sum_(0),
     pos_(0),
     id_(id)
 {
@@ -122,89 +252,156 @@ inline ValueTracker<T,S>::ValueTracker(uint8_t id)
 
 //=================================== OPERATIONS ===============================
 
-template<typename T, uint8_t S>
-inline uint8_t ValueTracker<T,S>::id() const
+template<typename T, uint32_t S, bool HEAP, typename A>
+inline uint8_t ValueTracker<T,S,HEAP,A>::id() const
 {
   return id_;
 }
 
-template<typename T, uint8_t S>
-inline void ValueTracker<T,S>::reset(T val)
+template<typename T, uint32_t S, bool HEAP, typename A>
+inline void ValueTracker<T,S,HEAP,A>::reset(T val)
 {
-  for (uint8_t i = 0; i < S; i++) {
-    vals_[i] = val;
+  if (!storage_.valid()) {
+    return;
+  }
+
+  for (uint32_t i = 0; i < S; i++) {
+    storage_.vals_[i] = val;
+    storage_.sorted_[i] = val;
   }
+  resum();
 }
 
-template<typename T, uint8_t S>
-inline void ValueTracker<T,S>::push(T val)
+template<typename T, uint32_t S, bool HEAP, typename A>
+inline void ValueTracker<T,S,HEAP,A>::push(T val)
 {
-  vals_[pos_ % S] = val;
-  ++pos_;
+  if (!storage_.valid()) {
+    return;
+  }
+
+  T* sorted = storage_.sorted_;
+  T old = storage_.vals_[pos_];
+
+  // Move the sorted values between the old and the new value's positions by one.
+  uint32_t from = bound(old, false);
+  uint32_t to;
+
+  if (old < val) {
+    to = bound(val, true) - 1;
+    memmove(sorted + from, sorted + from + 1, (to - from) * sizeof(T));
+  } else {
+    to = bound(val, false);
+    memmove(sorted + to + 1, sorted + to, (from - to) * sizeof(T));
+  }
+  sorted[to] = val;
+
+  storage_.vals_[pos_] = val;
+  pos_ = wrap(pos_ + 1);
+
+  if (0 == pos_) {
+    resum();
+  } else {
+    sum_ = sum_ - A(old) + A(val);
+  }
 }
 
-template<typename T, uint8_t S>
-inline uint8_t ValueTracker<T,S>::count() const
+template<typename T, uint32_t S, bool HEAP, typename A>
+inline uint32_t ValueTracker<T,S,HEAP,A>::count() const
 {
-  return S;
+  return (storage_.valid() ? S : 0);
 }
 
-template<typename T, uint8_t S>
-inline T ValueTracker<T,S>::last() const
+template<typename T, uint32_t S, bool HEAP, typename A>
+inline T ValueTracker<T,S,HEAP,A>::last() const
 {
   // Assume that at least one value was pushed.
   //
-  return vals_[(pos_ - 1) % S];
+  return (storage_.valid() ? storage_.vals_[wrap(pos_ + S - 1)] : T(0));
 }
 
-template<typename T, uint8_t S>
-inline T ValueTracker<T,S>::value(uint8_t requested_pos) const
+template<typename T, uint32_t S, bool HEAP, typename A>
+inline T ValueTracker<T,S,HEAP,A>::value(uint32_t requested_pos) const
 {
-  uint16_t index = (pos_ - 1) - ((S - 1) - requested_pos);
-  return vals_[index % S];
+  // The oldest value is at the write position.
+  return (storage_.valid() ? storage_.vals_[wrap(pos_ + requested_pos)] : T(0));
 }
 
-template<typename T, uint8_t S>
-inline T ValueTracker<T,S>::delta() const
+template<typename T, uint32_t S, bool HEAP, typename A>
+inline T ValueTracker<T,S,HEAP,A>::delta() const
 {
   return delta(S - 1, S - 2);
 }
 
-template<typename T, uint8_t S>
-inline T ValueTracker<T,S>::delta(uint8_t upper_pos, uint8_t lower_pos) const
+template<typename T, uint32_t S, bool HEAP, typename A>
+inline T ValueTracker<T,S,HEAP,A>::delta(uint32_t upper_pos, uint32_t lower_pos) const
 {
   T upper_val = value(upper_pos);
   T lower_val = value(lower_pos);
   return (upper_val - lower_val);
 }
 
-template<typename T, uint8_t S>
-inline T ValueTracker<T,S>::median() const
+template<typename T, uint32_t S, bool HEAP, typename A>
+inline T ValueTracker<T,S,HEAP,A>::median() const
 {
-  T arr[S] = { 0 };
-  memcpy(arr, vals_, sizeof(T) * S);
-
-  Sorters::insertionSort(arr, S);
-
+  const T* sorted = storage_.sorted_;
   T result;
 
-  if ((S % 2) != 0) {
-    result = arr[S / 2];
+  if (!storage_.valid()) {
+    result = 0;
+  } else if ((S % 2) != 0) {
+    result = sorted[S / 2];
   } else {
-    result = (arr[S / 2] + arr[(S / 2) - 1]) / 2;
+    result = (sorted[S / 2] + sorted[(S / 2) - 1]) / 2;
   }
   return result;
 }
 
-template<typename T, uint8_t S>
-inline T ValueTracker<T,S>::mean() const
+template<typename T, uint32_t S, bool HEAP, typename A>
+inline T ValueTracker<T,S,HEAP,A>::mean() const
+{
+  return T(sum_ / A(S));
+}
+
+///////////////////////////////////// PRIVATE //////////////////////////////////
+
+//=================================== OPERATIONS ===============================
+
+template<typename T, uint32_t S, bool HEAP, typename A>
+inline uint32_t ValueTracker<T,S,HEAP,A>::wrap(uint32_t index)
+{
+  return (0 == (S & (S - 1)) ? (index & (S - 1)) : (index >= S ? index - S : index));
+}
+
+template<typename T, uint32_t S, bool HEAP, typename A>
+inline uint32_t ValueTracker<T,S,HEAP,A>::bound(T val, bool upper) const
+{
+  const T* sorted = storage_.sorted_;
+  uint32_t first = 0;
+  uint32_t count = S;
+
+  while (count > 0) {
+    uint32_t step = count / 2;
+    uint32_t i = first + step;
+
+    if (sorted[i] < val || (upper && !(val < sorted[i]))) {
+      first = i + 1;
+      count -= step + 1;
+    } else {
+      count = step;
+    }
+  }
+  return first;
+}
+
+template<typename T, uint32_t S, bool HEAP, typename A>
+inline void ValueTracker<T,S,HEAP,A>::resum()
 {
-  T sum = 0;
+  A sum = 0;
 
-  for (uint8_t i = 0; i < S; i++) {
-    sum += vals_[i];
+  for (uint32_t i = 0; i < S; i++) {
+    sum += A(storage_.vals_[i]);
   }
-  return sum / S;
+  sum_ = sum;
 }
 
 } // namespace btr
@@ -0,0 +1,652 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+#ifndef _btr_WavlTree_hpp_
+#define _btr_WavlTree_hpp_
+
+// SYSTEM INCLUDES
+#include <inttypes.h>
+
+// PROJECT INCLUDES
+#include "utility/common/avl_tree.hpp"
+
+namespace btr
+{
+
+/**
+ * The class represents a weak AVL (WAVL) tree, a sibling of AvlTree for write-heavy bursts.
+ *
+ * Nodes are the same NodeBase nodes as in AvlTree, with the height field holding a rank instead
+ * of the height. Null children have rank 0 and leaves rank 1. The rank of a node exceeds the rank
+ * of each child by 1 or 2, so unlike in AvlTree a node may have two children two ranks lower.
+ * That slack lets erase stop where AvlTree keeps rotating up to the root: both insert and erase
+ * do at most two rotations, and the rank changes on the way up are amortized O(1) per update.
+ *
+ * Without erases the tree is exactly an AVL tree. With erases its height stays below
+ * 2 * log2(n + 1), so insert, erase and traversal fit their path stacks of MAX_HEIGHT nodes for
+ * up to 2^(MAX_HEIGHT / 2) nodes, far more than memory holds on MCU targets.
+ *
+ * Nodes are created and destroyed through allocator A, @see node_allocator.hpp.
+ *
+ * WARNING: make sure H is SIGNED integer
+ */
+template <typename N, typename K = uint16_t, typename H = int16_t,
+          typename A = HeapNodeAllocator<N>>
+class WavlTree
+{
+public:
+
+  /** Upper bound of the tree height, @see AvlTree::MAX_HEIGHT */
+  static const uint8_t MAX_HEIGHT = AvlTreeIterator<N>::MAX_DEPTH;
+
+  typedef AvlTreeIterator<N> Iterator;
+
+// LIFECYCLE
+
+  /**
+   * Ctor.
+   */
+  WavlTree();
+
+  /**
+   * Erase all branches on destruction.
+   */
+  ~WavlTree();
+
+// OPERATIONS
+
+  N* root();
+  void root(N* root);
+
+  /**
+   * @return the node allocator
+   */
+  A& allocator();
+
+  /**
+   * Insert a key. An existing key or an exhausted allocator leaves the tree unchanged.
+   *
+   * @return the tree root
+   */
+  N* insert(K key);
+
+  N* search(K key);
+
+  /**
+   * Erase a key.
+   *
+   * @return the tree root
+   */
+  N* erase(K key);
+
+  void eraseBranch(N* node);
+
+  /**
+   * @return the rank of a node, 0 for nullptr
+   */
+  static H height(N* node);
+
+  static int traverse(N* node, NodeObserver<N>* o);
+  static int traverse(N* node, NodeObserver<N>* o, K key_min, K key_max);
+  static N* searchMin(N* node);
+  static N* search(N* root, K key);
+
+  /**
+   * @see AvlTree::visit(N*, F&&)
+   */
+  template<typename F>
+  static int visit(N* node, F&& visitor);
+
+  /**
+   * @see AvlTree::visit(N*, F&&, K, K)
+   */
+  template<typename F>
+  static int visit(N* node, F&& visitor, K key_min, K key_max);
+
+  /**
+   * @return an iterator at the smallest key
+   */
+  Iterator begin();
+
+  /**
+   * @return an iterator past the largest key
+   */
+  Iterator end();
+
+  /**
+   * @return an iterator at the first key not less than key, or end()
+   */
+  Iterator lowerBound(K key);
+
+  /**
+   * @return an iterator at the first key greater than key, or end()
+   */
+  Iterator upperBound(K key);
+
+  /**
+   * @see AvlTree::equalRange
+   */
+  void equalRange(K key, Iterator* first, Iterator* last);
+
+private:
+
+  /** Static operations that don't depend on the balance rule. */
+  typedef AvlTree<N, K, H, A> Base;
+
+// OPERATIONS
+
+  /**
+   * Rotate a subtree right and refresh augmented data. Ranks are left to the caller.
+   *
+   * @return new subtree root
+   */
+  static N* rotateRightSubtree(N* node);
+
+  /**
+   * Rotate a subtree left and refresh augmented data. Ranks are left to the caller.
+   *
+   * @return new subtree root
+   */
+  static N* rotateLeftSubtree(N* node);
+
+  /**
+   * Restore the rank rule when child has the rank of node and its sibling is two ranks lower.
+   *
+   * @return new subtree root
+   */
+  static N* rebalanceInsert(N* node, N* child);
+
+  /**
+   * Restore the rank rule when a child of node is three ranks lower, its sibling is one rank
+   * lower and the sibling has a child one rank lower.
+   *
+   * @param right - true if the low child is on the right
+   * @return new subtree root
+   */
+  static N* rebalanceErase(N* node, bool right);
+
+  /**
+   * Destroy a subtree without touching the root.
+   */
+  void destroyBranch(N* node);
+
+// ATTRIBUTES
+
+  A alloc_;
+  N* root_;
+
+}; // class WavlTree
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                              INLINE
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
+
+//============================================= LIFECYCLE ==========================================
+
+template<typename N, typename K, typename H, typename A>
+inline WavlTree<N, K, H, A>::WavlTree() :
+  alloc_(),
+  root_(nullptr)
+{
+}
+
+template<typename N, typename K, typename H, typename A>
+inline WavlTree<N, K, H, A>::~WavlTree()
+{
+  eraseBranch(root_);
+}
+
+//============================================= OPERATIONS =========================================
+
+template<typename N, typename K, typename H, typename A>
+inline N* WavlTree<N, K, H, A>::root()
+{
+  return root_;
+}
+
+template<typename N, typename K, typename H, typename A>
+inline void WavlTree<N, K, H, A>::root(N* root)
+{
+  root_ = root;
+}
+
+template<typename N, typename K, typename H, typename A>
+inline A& WavlTree<N, K, H, A>::allocator()
+{
+  return alloc_;
+}
+
+template<typename N, typename K, typename H, typename A>
+inline N* WavlTree<N, K, H, A>::insert(K key)
+{
+  N* path[MAX_HEIGHT];
+  uint8_t depth = 0;
+  N* node = root_;
+
+  while (nullptr != node) {
+    if (key < node->key()) {
+      path[depth++] = node;
+      node = node->left();
+    } else if (key > node->key()) {
+      path[depth++] = node;
+      node = node->right();
+    } else {
+      return root_;
+    }
+  }
+
+  // Returns nullptr if the allocator is exhausted, leaving the tree unchanged.
+  N* child = alloc_.create(key);
+
+  if (nullptr == child) {
+    return root_;
+  }
+
+  // The new leaf has rank 1. Promote ancestors while the child has the rank of its parent and
+  // the sibling is one rank lower. A sibling two ranks lower takes a rotation, which ends the
+  // walk. The remaining ancestors only need their augmented data refreshed.
+  //
+  while (depth > 0) {
+    node = path[depth - 1];
+
+    if (key < node->key()) {
+      node->left(child);
+    } else {
+      node->right(child);
+    }
+
+    if (height(node) != height(child)) {
+      break;
+    }
+
+    N* sibling = (node->left() == child ? node->right() : node->left());
+    --depth;
+
+    if (height(node) - height(sibling) == 1) {
+      node->height(height(node) + 1);
+      node->augment();
+      child = node;
+      continue;
+    }
+
+    child = rebalanceInsert(node, child);
+
+    if (0 == depth) {
+      root_ = child;
+    } else if (key < path[depth - 1]->key()) {
+      path[depth - 1]->left(child);
+    } else {
+      path[depth - 1]->right(child);
+    }
+    break;
+  }
+
+  if (0 == depth) {
+    root_ = (nullptr == root_ ? child : root_);
+    return root_;
+  }
+
+  while (N::AUGMENTED && depth > 0) {
+    path[--depth]->augment();
+  }
+  return root_;
+}
+
+template<typename N, typename K, typename H, typename A>
+inline N* WavlTree<N, K, H, A>::search(K key)
+{
+  return search(root_, key);
+}
+
+template<typename N, typename K, typename H, typename A>
+inline N* WavlTree<N, K, H, A>::erase(K key)
+{
+  N* path[MAX_HEIGHT];
+  bool went_right[MAX_HEIGHT];
+  uint8_t depth = 0;
+  N* node = root_;
+
+  while (nullptr != node && key != node->key()) {
+    path[depth] = node;
+    went_right[depth] = (key > node->key());
+    node = (went_right[depth] ? node->right() : node->left());
+    ++depth;
+  }
+
+  if (nullptr == node) {
+    return root_;
+  }
+
+  if (nullptr != node->left() && nullptr != node->right()) {
+    // Like in AvlTree, the successor takes the place and the rank of the node, so no node data
+    // is moved, and the successor's right child takes the successor's place.
+    //
+    uint8_t node_depth = depth;
+    path[depth] = nullptr;
+    went_right[depth] = true;
+    ++depth;
+
+    N* successor = node->right();
+
+    while (nullptr != successor->left()) {
+      path[depth] = successor;
+      went_right[depth] = false;
+      ++depth;
+      successor = successor->left();
+    }
+
+    N* child = successor->right();
+
+    successor->left(node->left());
+    successor->right(node->right());
+    successor->height(node->height());
+    path[node_depth] = successor;
+
+    if (0 == node_depth) {
+      root_ = successor;
+    } else if (went_right[node_depth - 1]) {
+      path[node_depth - 1]->right(successor);
+    } else {
+      path[node_depth - 1]->left(successor);
+    }
+
+    alloc_.destroy(node);
+    node = child;
+  } else {
+    N* child = (nullptr != node->left() ? node->left() : node->right());
+    alloc_.destroy(node);
+    node = child;
+  }
+
+  // The removed node had at most a leaf below it, so its replacement is two or three ranks below
+  // the parent. Demote ancestors while a child is three ranks lower and the sibling can't lend a
+  // rank, then rotate at most once. Leaves left with rank 2 are demoted too.
+  //
+  bool balanced = false;
+
+  while (depth > 0) {
+    N* parent = path[--depth];
+
+    if (went_right[depth]) {
+      parent->right(node);
+    } else {
+      parent->left(node);
+    }
+
+    if (balanced) {
+      if (!N::AUGMENTED) {
+        return root_;
+      }
+      parent->augment();
+      node = parent;
+      continue;
+    }
+
+    H rank = height(parent);
+    N* sibling = (went_right[depth] ? parent->left() : parent->right());
+
+    if (nullptr == node && nullptr == sibling) {
+      parent->height(1);
+      balanced = (2 != rank);
+    } else if (rank - height(node) < 3) {
+      balanced = true;
+    } else if (rank - height(sibling) == 2) {
+      parent->height(rank - 1);
+    } else if (height(sibling) - height(sibling->left()) == 2
+        && height(sibling) - height(sibling->right()) == 2) {
+      parent->height(rank - 1);
+      sibling->height(height(sibling) - 1);
+    } else {
+      node = rebalanceErase(parent, went_right[depth]);
+      balanced = true;
+      continue;
+    }
+
+    parent->augment();
+    node = parent;
+  }
+
+  root_ = node;
+  return node;
+}
+
+template<typename N, typename K, typename H, typename A>
+void WavlTree<N, K, H, A>::eraseBranch(N* node)
+{
+  if (root_ == node) {
+    root_ = nullptr;
+  }
+  destroyBranch(node);
+}
+
+template<typename N, typename K, typename H, typename A>
+inline H WavlTree<N, K, H, A>::height(N* node)
+{
+  return (nullptr == node ? 0 : node->height());
+}
+
+template<typename N, typename K, typename H, typename A>
+inline int WavlTree<N, K, H, A>::traverse(N* node, NodeObserver<N>* o)
+{
+  return Base::traverse(node, o);
+}
+
+template<typename N, typename K, typename H, typename A>
+inline int WavlTree<N, K, H, A>::traverse(N* node, NodeObserver<N>* o, K key_min, K key_max)
+{
+  return Base::traverse(node, o, key_min, key_max);
+}
+
+template<typename N, typename K, typename H, typename A>
+inline N* WavlTree<N, K, H, A>::searchMin(N* node)
+{
+  return Base::searchMin(node);
+}
+
+template<typename N, typename K, typename H, typename A>
+inline N* WavlTree<N, K, H, A>::search(N* root, K key)
+{
+  return Base::search(root, key);
+}
+
+template<typename N, typename K, typename H, typename A>
+template<typename F>
+inline int WavlTree<N, K, H, A>::visit(N* node, F&& visitor)
+{
+  return Base::visit(node, visitor);
+}
+
+template<typename N, typename K, typename H, typename A>
+template<typename F>
+inline int WavlTree<N, K, H, A>::visit(N* node, F&& visitor, K key_min, K key_max)
+{
+  return Base::visit(node, visitor, key_min, key_max);
+}
+
+template<typename N, typename K, typename H, typename A>
+inline typename WavlTree<N, K, H, A>::Iterator WavlTree<N, K, H, A>::begin()
+{
+  Iterator it(root_);
+  it.pushLeft(root_);
+  return it;
+}
+
+template<typename N, typename K, typename H, typename A>
+inline typename WavlTree<N, K, H, A>::Iterator WavlTree<N, K, H, A>::end()
+{
+  return Iterator(root_);
+}
+
+template<typename N, typename K, typename H, typename A>
+inline typename WavlTree<N, K, H, A>::Iterator WavlTree<N, K, H, A>::lowerBound(K key)
+{
+  Iterator it(root_);
+  uint8_t depth = 0;
+  N* node = root_;
+
+  while (nullptr != node) {
+    it.path_[it.depth_++] = node;
+
+    if (node->key() < key) {
+      node = node->right();
+    } else {
+      depth = it.depth_;
+      node = node->left();
+    }
+  }
+
+  it.depth_ = depth;
+  return it;
+}
+
+template<typename N, typename K, typename H, typename A>
+inline typename WavlTree<N, K, H, A>::Iterator WavlTree<N, K, H, A>::upperBound(K key)
+{
+  Iterator it(root_);
+  uint8_t depth = 0;
+  N* node = root_;
+
+  while (nullptr != node) {
+    it.path_[it.depth_++] = node;
+
+    if (node->key() <= key) {
+      node = node->right();
+    } else {
+      depth = it.depth_;
+      node = node->left();
+    }
+  }
+
+  it.depth_ = depth;
+  return it;
+}
+
+template<typename N, typename K, typename H, typename A>
+inline void WavlTree<N, K, H, A>::equalRange(K key, Iterator* first, Iterator* last)
+{
+  *first = lowerBound(key);
+  *last = *first;
+
+  if (nullptr != last->node() && last->node()->key() == key) {
+    ++(*last);
+  }
+}
+
+/////////////////////////////////////////////// PRIVATE ////////////////////////////////////////////
+
+//============================================= OPERATIONS =========================================
+
+template<typename N, typename K, typename H, typename A>
+inline N* WavlTree<N, K, H, A>::rotateRightSubtree(N* node)
+{
+  N* left = node->left();
+
+  node->left(left->right());
+  left->right(node);
+
+  node->augment();
+  left->augment();
+  return left;
+}
+
+template<typename N, typename K, typename H, typename A>
+inline N* WavlTree<N, K, H, A>::rotateLeftSubtree(N* node)
+{
+  N* right = node->right();
+
+  node->right(right->left());
+  right->left(node);
+
+  node->augment();
+  right->augment();
+  return right;
+}
+
+template<typename N, typename K, typename H, typename A>
+inline N* WavlTree<N, K, H, A>::rebalanceInsert(N* node, N* child)
+{
+  // The child was just promoted or inserted, so one of its children is one rank lower and the
+  // other two. If the inner one is two ranks lower, a single rotation lifts the child.
+  // Otherwise a double rotation lifts the inner grandchild.
+  //
+  bool left = (node->left() == child);
+  N* inner = (left ? child->right() : child->left());
+
+  node->height(height(node) - 1);
+
+  if (height(child) - height(inner) == 2) {
+    return (left ? rotateRightSubtree(node) : rotateLeftSubtree(node));
+  }
+
+  child->height(height(child) - 1);
+  inner->height(height(inner) + 1);
+
+  if (left) {
+    node->left(rotateLeftSubtree(child));
+    return rotateRightSubtree(node);
+  }
+
+  node->right(rotateRightSubtree(child));
+  return rotateLeftSubtree(node);
+}
+
+template<typename N, typename K, typename H, typename A>
+inline N* WavlTree<N, K, H, A>::rebalanceErase(N* node, bool right)
+{
+  N* sibling = (right ? node->left() : node->right());
+  N* outer = (right ? sibling->left() : sibling->right());
+  N* inner = (right ? sibling->right() : sibling->left());
+  H rank = height(node);
+
+  if (height(sibling) - height(outer) == 1) {
+    // The sibling rises a rank above the node. A node left without children becomes a leaf.
+    sibling->height(rank);
+    node->height(nullptr == inner && rank == 3 ? 1 : rank - 1);
+    return (right ? rotateRightSubtree(node) : rotateLeftSubtree(node));
+  }
+
+  // The inner grandchild takes the rank of the node, which sinks two ranks.
+  inner->height(rank);
+  sibling->height(height(sibling) - 1);
+  node->height(rank - 2);
+
+  if (right) {
+    node->left(rotateLeftSubtree(sibling));
+    return rotateRightSubtree(node);
+  }
+
+  node->right(rotateRightSubtree(sibling));
+  return rotateLeftSubtree(node);
+}
+
+template<typename N, typename K, typename H, typename A>
+void WavlTree<N, K, H, A>::destroyBranch(N* node)
+{
+  // Rotate left children up until the node has none, then destroy it and continue with its
+  // right child. Needs no stack.
+  //
+  while (nullptr != node) {
+    N* left = node->left();
+
+    if (nullptr != left) {
+      node->left(left->right());
+      left->right(node);
+      node = left;
+    } else {
+      N* right = node->right();
+      alloc_.destroy(node);
+      node = right;
+    }
+  }
+}
+
+} // namespace btr
+
+#endif // _btr_WavlTree_hpp_
@@ -0,0 +1,559 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+#ifndef _btr_ConcurrentAvlTree_hpp_
+#define _btr_ConcurrentAvlTree_hpp_
+
+// SYSTEM INCLUDES
+#include <errno.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+// PROJECT INCLUDES
+#include "utility/common/avl_tree.hpp"
+
+namespace btr
+{
+
+/**
+ * The class wraps a node allocator and defers destroying nodes until no reader can reach them.
+ * Destroyed nodes are tagged with the current write epoch, and reclaim() releases the nodes
+ * tagged before the oldest epoch a reader is still in.
+ *
+ * Only the writer calls the allocator, so it isn't thread-safe.
+ */
+template<typename N, typename A = HeapNodeAllocator<N>>
+class RetiringNodeAllocator
+{
+public:
+
+  static const bool THREAD_SAFE = false;
+  static const bool TRANSFERABLE = false;
+
+// LIFECYCLE
+
+  RetiringNodeAllocator();
+  RetiringNodeAllocator(const RetiringNodeAllocator&) = delete;
+  RetiringNodeAllocator& operator=(const RetiringNodeAllocator&) = delete;
+
+  /**
+   * Release all retired nodes. No reader may be active by then.
+   */
+  ~RetiringNodeAllocator();
+
+// OPERATIONS
+
+  template<typename K>
+  N* create(K key);
+
+  /**
+   * Retire a node. It is destroyed by reclaim() once no reader can reach it.
+   */
+  void destroy(N* node);
+
+  /**
+   * Set the epoch that tags nodes retired from now on.
+   */
+  void epoch(uint64_t epoch);
+
+  /**
+   * Destroy nodes retired before an epoch.
+   *
+   * @param epoch - the oldest epoch a reader is in
+   */
+  void reclaim(uint64_t epoch);
+
+  /**
+   * @return the number of nodes waiting to be destroyed
+   */
+  uint32_t retired() const;
+
+  /**
+   * @return the wrapped allocator
+   */
+  A& allocator();
+
+private:
+
+  struct Retired
+  {
+    uint64_t epoch_;
+    N* node_;
+  };
+
+// ATTRIBUTES
+
+  A alloc_;
+  std::deque<Retired> retired_;
+  uint64_t epoch_;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * The class represents an AvlTree shared by many reader threads and updated by one writer at a
+ * time.
+ *
+ * Readers never take the writer lock. The writer bumps a sequence number before and after each
+ * update, and a reader retries if the number changed while it searched, i.e. optimistic version
+ * validation as in a seqlock. Readers never block the writer or each other, and a search that
+ * doesn't overlap an update completes in one pass. A reader that finds an update in progress
+ * spins with exponential backoff, then sleeps, until it ends, so reads are not wait-free: a writer updating
+ * back to back delays readers by the duration of its updates.
+ *
+ * Nodes erased by the writer are retired, not destroyed, until every reader that might hold
+ * them has left its read section (epoch-based reclamation). Each reader thread owns one of
+ * S cache-line-sized slots where it publishes the epoch it entered in. Readers that didn't get a
+ * slot share a counter instead, and the writer reclaims nothing while it's non-zero.
+ *
+ * IMPORTANT: Readers load node links while the writer may store them. This relies on aligned
+ * pointer-sized loads and stores being atomic on x86, as seqlocks do. Node data read during a
+ * search may be torn, so reader callbacks must only copy it out; the copy is valid once the
+ * search returns.
+ *
+ * @tparam S - the maximum number of concurrent Reader objects
+ */
+template <typename N, typename K = uint16_t, typename H = int16_t,
+          typename A = HeapNodeAllocator<N>, uint16_t S = 64>
+class ConcurrentAvlTree
+{
+public:
+
+  typedef AvlTree<N, K, H, RetiringNodeAllocator<N, A>> Tree;
+
+  /** Spin-loop hints a reader waits for an update to end before it starts sleeping. */
+  static const uint16_t MAX_BACKOFF = 1024;
+
+  /**
+   * The class represents a reader thread's handle. Create one per thread and keep it for as long
+   * as the thread reads the tree.
+   */
+  class Reader
+  {
+  public:
+
+  // LIFECYCLE
+
+    /**
+     * Claim a reader slot.
+     */
+    explicit Reader(ConcurrentAvlTree* tree);
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
+    /**
+     * Release the slot.
+     */
+    ~Reader();
+
+  // OPERATIONS
+
+    /**
+     * @return false if all slots are taken. Searches then hold off reclamation of all nodes
+     *  rather than those retired after they started
+     */
+    bool ok() const;
+
+    /**
+     * Search for a key.
+     *
+     * @param key - the key to look up
+     * @param reader - callable taking N* that copies node data out. It may be called several
+     *  times; the last call's copy is consistent
+     * @return true if the key was found
+     */
+    template<typename F>
+    bool search(K key, F&& reader);
+
+    /**
+     * Search for the smallest key not less than key. Call it with the next key to iterate a
+     * range.
+     *
+     * @see search
+     */
+    template<typename F>
+    bool lowerBound(K key, F&& reader);
+
+  private:
+
+    template<typename F>
+    bool read(K key, bool exact, F&& reader);
+
+  // ATTRIBUTES
+
+    ConcurrentAvlTree* tree_;
+    int32_t slot_;
+  };
+
+// LIFECYCLE
+
+  ConcurrentAvlTree();
+  ConcurrentAvlTree(const ConcurrentAvlTree&) = delete;
+  ConcurrentAvlTree& operator=(const ConcurrentAvlTree&) = delete;
+
+// OPERATIONS
+
+  /**
+   * Run an update with exclusive access to the tree. Any AvlTree operation may be used.
+   *
+   * @param writer - callable taking Tree&
+   */
+  template<typename F>
+  void write(F&& writer);
+
+  /**
+   * Insert a key and initialize its node before readers can see it.
+   *
+   * @param init - callable taking N*, called if the key was inserted
+   * @return 0 on success, otherwise -1 and errno is set to EEXIST or ENOMEM
+   */
+  template<typename F>
+  int insert(K key, F&& init);
+
+  /**
+   * Erase a key.
+   */
+  void erase(K key);
+
+  /**
+   * @return the number of erased nodes not yet destroyed
+   */
+  uint32_t retired();
+
+private:
+
+  /** A reader slot padded to a cache line, so readers don't invalidate each other's lines. */
+  struct alignas(64) Slot
+  {
+    /** The epoch the reader entered in, 0 if it isn't reading. */
+    std::atomic<uint64_t> epoch_;
+    std::atomic<bool> owned_;
+  };
+
+// OPERATIONS
+
+  /**
+   * Search a possibly changing tree, giving up after MAX_HEIGHT steps.
+   *
+   * @param exact - look up key if true, otherwise its lower bound
+   * @param node - set to the node found or nullptr
+   * @return false if the search exceeded the height bound
+   */
+  bool find(K key, bool exact, N** node);
+
+  /**
+   * @return the oldest epoch a reader is in, the current one if there are no readers, or 1 if a
+   *  reader without a slot is in a read section
+   */
+  uint64_t minEpoch() const;
+
+// ATTRIBUTES
+
+  Slot slots_[S];
+  /** The number of readers without a slot in a read section. */
+  alignas(64) std::atomic<uint32_t> pinned_;
+  alignas(64) std::atomic<uint32_t> seq_;
+  std::atomic<uint64_t> epoch_;
+  std::mutex mutex_;
+  Tree tree_;
+};
+
+/////////////////////////////////////////////// INLINE /////////////////////////////////////////////
+
+/////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
+
+//============================================= LIFECYCLE ==========================================
+
+template<typename N, typename A>
+inline RetiringNodeAllocator<N, A>::RetiringNodeAllocator() :
+  alloc_(),
+  retired_(),
+  epoch_(0)
+{
+}
+
+template<typename N, typename A>
+inline RetiringNodeAllocator<N, A>::~RetiringNodeAllocator()
+{
+  reclaim(~uint64_t(0));
+}
+
+template<typename N, typename K, typename H, typename A, uint16_t S>
+inline ConcurrentAvlTree<N, K, H, A, S>::Reader::Reader(ConcurrentAvlTree* tree) :
+  tree_(tree),
+  slot_(-1)
+{
+  for (uint16_t i = 0; i < S; i++) {
+    bool owned = false;
+
+    if (tree->slots_[i].owned_.compare_exchange_strong(owned, true)) {
+      slot_ = i;
+      break;
+    }
+  }
+}
+
+template<typename N, typename K, typename H, typename A, uint16_t S>
+inline ConcurrentAvlTree<N, K, H, A, S>::Reader::~Reader()
+{
+  if (slot_ >= 0) {
+    tree_->slots_[slot_].owned_.store(false, std::memory_order_release);
+  }
+}
+
+template<typename N, typename K, typename H, typename A, uint16_t S>
+inline ConcurrentAvlTree<N, K, H, A, S>::ConcurrentAvlTree() :
+  slots_(),
+  pinned_(0),
+  seq_(0),
+  epoch_(1),
+  mutex_(),
+  tree_()
+{
+}
+
+//============================================= OPERATIONS =========================================
+
+template<typename N, typename A>
+template<typename K>
+inline N* RetiringNodeAllocator<N, A>::create(K key)
+{
+  return alloc_.create(key);
+}
+
+template<typename N, typename A>
+inline void RetiringNodeAllocator<N, A>::destroy(N* node)
+{
+  retired_.push_back({ epoch_, node });
+}
+
+template<typename N, typename A>
+inline void RetiringNodeAllocator<N, A>::epoch(uint64_t epoch)
+{
+  epoch_ = epoch;
+}
+
+template<typename N, typename A>
+inline void RetiringNodeAllocator<N, A>::reclaim(uint64_t epoch)
+{
+  // Tags don't decrease, so the oldest nodes are at the front.
+  while (!retired_.empty() && retired_.front().epoch_ < epoch) {
+    alloc_.destroy(retired_.front().node_);
+    retired_.pop_front();
+  }
+}
+
+template<typename N, typename A>
+inline uint32_t RetiringNodeAllocator<N, A>::retired() const
+{
+  return retired_.size();
+}
+
+template<typename N, typename A>
+inline A& RetiringNodeAllocator<N, A>::allocator()
+{
+  return alloc_;
+}
+
+template<typename N, typename K, typename H, typename A, uint16_t S>
+inline bool ConcurrentAvlTree<N, K, H, A, S>::Reader::ok() const
+{
+  return (slot_ >= 0);
+}
+
+template<typename N, typename K, typename H, typename A, uint16_t S>
+template<typename F>
+inline bool ConcurrentAvlTree<N, K, H, A, S>::Reader::search(K key, F&& reader)
+{
+  return read(key, true, reader);
+}
+
+template<typename N, typename K, typename H, typename A, uint16_t S>
+template<typename F>
+inline bool ConcurrentAvlTree<N, K, H, A, S>::Reader::lowerBound(K key, F&& reader)
+{
+  return read(key, false, reader);
+}
+
+template<typename N, typename K, typename H, typename A, uint16_t S>
+template<typename F>
+bool ConcurrentAvlTree<N, K, H, A, S>::Reader::read(K key, bool exact, F&& reader)
+{
+  N* node = nullptr;
+
+  // Publish the epoch, or pin all retired nodes without a slot, before loading any link. The
+  // fence pairs with the writer's, so either the writer sees this reader or the reader sees the
+  // unlinked nodes.
+  if (slot_ >= 0) {
+    tree_->slots_[slot_].epoch_.store(tree_->epoch_.load(std::memory_order_relaxed),
+      std::memory_order_relaxed);
+  } else {
+    tree_->pinned_.fetch_add(1, std::memory_order_relaxed);
+  }
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+  uint16_t backoff = 1;
+
+  while (true) {
+    uint32_t seq = tree_->seq_.load(std::memory_order_acquire);
+
+    // An update is in progress. Waiting for it isn't a failed attempt. Long waits sleep, as the
+    // writer may have been preempted on the same core, and yielding to it would only wake this
+    // reader the next time it stops mid-update.
+    if (seq & 1) {
+      if (backoff < MAX_BACKOFF) {
+        for (uint16_t i = 0; i < backoff; i++) {
+          __builtin_ia32_pause();
+        }
+        backoff *= 2;
+      } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(1));
+      }
+      continue;
+    }
+
+    bool done = tree_->find(key, exact, &node);
+
+    if (done && nullptr != node) {
+      reader(node);
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (done && seq == tree_->seq_.load(std::memory_order_relaxed)) {
+      break;
+    }
+  }
+
+  if (slot_ >= 0) {
+    tree_->slots_[slot_].epoch_.store(0, std::memory_order_release);
+  } else {
+    tree_->pinned_.fetch_sub(1, std::memory_order_release);
+  }
+  return (nullptr != node);
+}
+
+template<typename N, typename K, typename H, typename A, uint16_t S>
+template<typename F>
+void ConcurrentAvlTree<N, K, H, A, S>::write(F&& writer)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint64_t epoch = epoch_.load(std::memory_order_relaxed);
+
+  tree_.allocator().epoch(epoch);
+
+  seq_.store(seq_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  writer(tree_);
+
+  seq_.store(seq_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+
+  // Readers entering from now on can't reach nodes retired above.
+  epoch_.store(epoch + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  tree_.allocator().reclaim(minEpoch());
+}
+
+template<typename N, typename K, typename H, typename A, uint16_t S>
+template<typename F>
+int ConcurrentAvlTree<N, K, H, A, S>::insert(K key, F&& init)
+{
+  int ret = 0;
+
+  write([&](Tree& tree) {
+    if (nullptr != tree.search(key)) {
+      errno = EEXIST;
+      ret = -1;
+      return;
+    }
+
+    tree.insert(key);
+    N* node = tree.search(key);
+
+    if (nullptr == node) {
+      errno = ENOMEM;
+      ret = -1;
+      return;
+    }
+    init(node);
+  });
+  return ret;
+}
+
+template<typename N, typename K, typename H, typename A, uint16_t S>
+inline void ConcurrentAvlTree<N, K, H, A, S>::erase(K key)
+{
+  write([key](Tree& tree) { tree.erase(key); });
+}
+
+template<typename N, typename K, typename H, typename A, uint16_t S>
+inline uint32_t ConcurrentAvlTree<N, K, H, A, S>::retired()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return tree_.allocator().retired();
+}
+
+/////////////////////////////////////////////// PRIVATE ////////////////////////////////////////////
+
+//============================================= OPERATIONS =========================================
+
+template<typename N, typename K, typename H, typename A, uint16_t S>
+inline bool ConcurrentAvlTree<N, K, H, A, S>::find(K key, bool exact, N** found)
+{
+  N* node = tree_.root();
+  N* lower = nullptr;
+
+  // A concurrent rotation may route the search in a circle. The height bound ends it.
+  for (uint8_t i = 0; i <= Tree::MAX_HEIGHT; i++) {
+    if (nullptr == node) {
+      *found = (exact ? nullptr : lower);
+      return true;
+    }
+
+    if (key < node->key()) {
+      lower = node;
+      node = node->left();
+    } else if (node->key() < key) {
+      node = node->right();
+    } else {
+      *found = node;
+      return true;
+    }
+  }
+
+  *found = nullptr;
+  return false;
+}
+
+template<typename N, typename K, typename H, typename A, uint16_t S>
+inline uint64_t ConcurrentAvlTree<N, K, H, A, S>::minEpoch() const
+{
+  // Readers without a slot may hold any retired node. Nodes are tagged with epochs from 1 up.
+  if (0 != pinned_.load(std::memory_order_relaxed)) {
+    return 1;
+  }
+
+  uint64_t min = epoch_.load(std::memory_order_relaxed);
+
+  for (uint16_t i = 0; i < S; i++) {
+    uint64_t epoch = slots_[i].epoch_.load(std::memory_order_relaxed);
+
+    if (0 != epoch && epoch < min) {
+      min = epoch;
+    }
+  }
+  return min;
+}
+
+} // namespace btr
+
+#endif // _btr_ConcurrentAvlTree_hpp_
@@ -0,0 +1,357 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+#ifndef _btr_ShardedValueTracker_hpp_
+#define _btr_ShardedValueTracker_hpp_
+
+// SYSTEM INCLUDES
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// PROJECT INCLUDES
+
+namespace btr
+{
+
+/**
+ * The class tracks the last S values pushed by each of many writer threads, e.g. latency samples
+ * of workers, and aggregates them on demand.
+ *
+ * Each writer thread claims a shard, padded to cache lines, through a Writer handle, so writers
+ * never share a cache line and push() takes no lock or read-modify-write instruction. A writer
+ * bumps its shard's sequence number before and after each push, as in a seqlock, and stats()
+ * copies each shard again if the number changed meanwhile. Each shard is thus read in a state
+ * between two pushes, and the aggregate is the union of those windows. Values are stored with
+ * relaxed atomics, which compile to plain moves on x86.
+ *
+ * A writer pushing back to back may change its shard during every copy. After MAX_RETRIES
+ * failed copies, stats() asks the writer to hold off: push() waits before its next value while
+ * the shard is held, so the copy succeeds after at most the push already in progress. The
+ * writer's only cost otherwise is a load of the hold count from its own cache line.
+ *
+ * If more than N writers exist, the remaining ones share an overflow shard under a mutex.
+ *
+ * @tparam S - the number of tracked values per shard
+ * @tparam N - the number of shards for concurrent writers
+ */
+template<typename T, uint32_t S = 64, uint16_t N = 16>
+class ShardedValueTracker
+{
+public:
+
+  static_assert(S > 0, "Window must hold at least one value");
+
+  /** Optimistic copies of a shard before stats() holds off its writer. */
+  static const uint8_t MAX_RETRIES = 8;
+
+  /** Spin-loop hints a held off writer waits before it starts yielding. */
+  static const uint16_t MAX_SPINS = 1024;
+
+  /** Aggregate of the windows of all shards. */
+  struct Stats
+  {
+    /** The number of values pushed since construction or reset. */
+    uint64_t pushes_;
+    /** The number of values in the windows. The rest of the fields are 0 if there are none. */
+    uint32_t count_;
+    T min_;
+    T max_;
+    T mean_;
+    T median_;
+  };
+
+  /**
+   * The class represents a writer thread's handle. Create one per thread and keep it for as long
+   * as the thread pushes values.
+   */
+  class Writer
+  {
+  public:
+
+  // LIFECYCLE
+
+    /**
+     * Claim a shard.
+     */
+    explicit Writer(ShardedValueTracker* tracker);
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    /**
+     * Release the shard. Its values stay in the aggregate.
+     */
+    ~Writer();
+
+  // OPERATIONS
+
+    /**
+     * @return false if all shards are taken. Values are then pushed to the overflow shard.
+     */
+    bool ok() const;
+
+    /**
+     * Add new value to the writer's shard.
+     *
+     * @param val - the value to add
+     */
+    void push(T val);
+
+  private:
+
+  // ATTRIBUTES
+
+    ShardedValueTracker* tracker_;
+    int32_t shard_;
+  };
+
+// LIFECYCLE
+
+  ShardedValueTracker();
+  ShardedValueTracker(const ShardedValueTracker&) = delete;
+  ShardedValueTracker& operator=(const ShardedValueTracker&) = delete;
+
+// OPERATIONS
+
+  /**
+   * Remove all values. No writer may push meanwhile.
+   */
+  void reset();
+
+  /**
+   * Merge the shards.
+   *
+   * @return the aggregate of the values in all windows
+   */
+  Stats stats() const;
+
+private:
+
+  /** A shard padded to cache lines, so writers don't invalidate each other's lines. */
+  struct alignas(64) Shard
+  {
+    std::atomic<uint32_t> seq_;
+    /** The number of readers holding off the writer. */
+    mutable std::atomic<uint32_t> holds_;
+    std::atomic<bool> owned_;
+    std::atomic<uint32_t> pos_;
+    std::atomic<uint64_t> pushes_;
+    std::atomic<T> vals_[S];
+  };
+
+// OPERATIONS
+
+  /**
+   * Add a value to a shard, once no reader holds it. Only one thread may push to a shard at a
+   * time.
+   */
+  void push(Shard* shard, T val);
+
+  /**
+   * Copy the values in a shard's window, holding off the writer if optimistic copies keep
+   * failing.
+   *
+   * @param vals - the vector to append the values to
+   * @return the number of values pushed to the shard
+   */
+  uint64_t copy(const Shard& shard, std::vector<T>* vals) const;
+
+// ATTRIBUTES
+
+  /** Shards of Writer handles, followed by the overflow shard. */
+  Shard shards_[N + 1];
+  std::mutex mutex_;
+};
+
+/////////////////////////////////////////////// INLINE /////////////////////////////////////////////
+
+/////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
+
+//============================================= LIFECYCLE ==========================================
+
+template<typename T, uint32_t S, uint16_t N>
+inline ShardedValueTracker<T, S, N>::Writer::Writer(ShardedValueTracker* tracker) :
+  tracker_(tracker),
+  shard_(-1)
+{
+  for (uint16_t i = 0; i < N; i++) {
+    bool owned = false;
+
+    if (tracker->shards_[i].owned_.compare_exchange_strong(owned, true)) {
+      shard_ = i;
+      break;
+    }
+  }
+}
+
+template<typename T, uint32_t S, uint16_t N>
+inline ShardedValueTracker<T, S, N>::Writer::~Writer()
+{
+  if (shard_ >= 0) {
+    tracker_->shards_[shard_].owned_.store(false, std::memory_order_release);
+  }
+}
+
+template<typename T, uint32_t S, uint16_t N>
+inline ShardedValueTracker<T, S, N>::ShardedValueTracker() :
+  shards_(),
+  mutex_()
+{
+  reset();
+}
+
+//============================================= OPERATIONS =========================================
+
+template<typename T, uint32_t S, uint16_t N>
+inline bool ShardedValueTracker<T, S, N>::Writer::ok() const
+{
+  return (shard_ >= 0);
+}
+
+template<typename T, uint32_t S, uint16_t N>
+inline void ShardedValueTracker<T, S, N>::Writer::push(T val)
+{
+  if (shard_ >= 0) {
+    tracker_->push(tracker_->shards_ + shard_, val);
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(tracker_->mutex_);
+  tracker_->push(tracker_->shards_ + N, val);
+}
+
+template<typename T, uint32_t S, uint16_t N>
+void ShardedValueTracker<T, S, N>::reset()
+{
+  for (Shard& shard : shards_) {
+    shard.seq_.store(shard.seq_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    shard.pos_.store(0, std::memory_order_relaxed);
+    shard.pushes_.store(0, std::memory_order_relaxed);
+    shard.seq_.store(shard.seq_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+}
+
+template<typename T, uint32_t S, uint16_t N>
+typename ShardedValueTracker<T, S, N>::Stats ShardedValueTracker<T, S, N>::stats() const
+{
+  Stats result = Stats();
+  std::vector<T> vals;
+  vals.reserve(S * (N + 1));
+
+  for (const Shard& shard : shards_) {
+    result.pushes_ += copy(shard, &vals);
+  }
+
+  result.count_ = uint32_t(vals.size());
+
+  if (vals.empty()) {
+    return result;
+  }
+
+  // Sum in double, so that many large values don't overflow T.
+  double sum = 0;
+
+  for (T val : vals) {
+    sum += double(val);
+  }
+
+  result.mean_ = T(sum / vals.size());
+  result.min_ = *std::min_element(vals.begin(), vals.end());
+  result.max_ = *std::max_element(vals.begin(), vals.end());
+
+  // Like ValueTracker, an even count has the mean of the two middle values as the median.
+  size_t mid = vals.size() / 2;
+  std::nth_element(vals.begin(), vals.begin() + mid, vals.end());
+  result.median_ = vals[mid];
+
+  if (0 == vals.size() % 2) {
+    T lower = *std::max_element(vals.begin(), vals.begin() + mid);
+    result.median_ = (result.median_ + lower) / 2;
+  }
+  return result;
+}
+
+/////////////////////////////////////////////// PRIVATE ////////////////////////////////////////////
+
+//============================================= OPERATIONS =========================================
+
+template<typename T, uint32_t S, uint16_t N>
+inline void ShardedValueTracker<T, S, N>::push(Shard* shard, T val)
+{
+  for (uint16_t spins = 0; 0 != shard->holds_.load(std::memory_order_acquire); ) {
+    if (spins < MAX_SPINS) {
+      __builtin_ia32_pause();
+      ++spins;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+
+  // Only one thread writes a shard at a time, so there is no read-modify-write instruction.
+  uint32_t seq = shard->seq_.load(std::memory_order_relaxed);
+  uint32_t pos = shard->pos_.load(std::memory_order_relaxed);
+  uint64_t pushes = shard->pushes_.load(std::memory_order_relaxed);
+
+  shard->seq_.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  shard->vals_[pos].store(val, std::memory_order_relaxed);
+  shard->pos_.store(pos + 1 == S ? 0 : pos + 1, std::memory_order_relaxed);
+  shard->pushes_.store(pushes + 1, std::memory_order_relaxed);
+
+  shard->seq_.store(seq + 2, std::memory_order_release);
+}
+
+template<typename T, uint32_t S, uint16_t N>
+uint64_t ShardedValueTracker<T, S, N>::copy(const Shard& shard, std::vector<T>* vals) const
+{
+  size_t size = vals->size();
+  bool holding = false;
+
+  for (uint32_t i = 0; ; i++) {
+    if (MAX_RETRIES == i) {
+      // The writer checks the count before starting a push. The fence orders the increment
+      // before the sequence number loads, so at most the push in progress can still land.
+      shard.holds_.fetch_add(1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      holding = true;
+    }
+
+    uint32_t seq = shard.seq_.load(std::memory_order_acquire);
+
+    if (seq & 1) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    uint64_t pushes = shard.pushes_.load(std::memory_order_relaxed);
+    uint32_t count = (pushes < S ? uint32_t(pushes) : S);
+
+    for (uint32_t j = 0; j < count; j++) {
+      vals->push_back(shard.vals_[j].load(std::memory_order_relaxed));
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (seq == shard.seq_.load(std::memory_order_relaxed)) {
+      if (holding) {
+        shard.holds_.fetch_sub(1, std::memory_order_release);
+      }
+      return pushes;
+    }
+
+    vals->resize(size);
+  }
+}
+
+} // namespace btr
+
+#endif // _btr_ShardedValueTracker_hpp_
@@ -0,0 +1,225 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+#include <cstdlib>
+
+// PROJECT INCLUDES
+#include "utility/common/avl_tree_aggregate.hpp"
+
+namespace btr
+{
+
+//================================ TEST FIXTURES ===============================
+
+/** Sample keyed by timestamp, summing values. */
+class SumSample : public AggregateNodeBase<SumSample, uint32_t, int64_t, SumAggregate>
+{
+public:
+
+  SumSample(uint32_t key) :
+    AggregateNodeBase(key, key % 17)
+  {}
+};
+
+/** Sample keyed by timestamp, tracking the maximum value. */
+class MaxSample : public AggregateNodeBase<MaxSample, uint32_t, int16_t, MaxAggregate>
+{
+public:
+
+  MaxSample(uint32_t key) :
+    AggregateNodeBase(key, int16_t(key * 7919 % 1000))
+  {}
+};
+
+/** Sample keyed by timestamp, tracking the minimum value. */
+class MinSample : public AggregateNodeBase<MinSample, uint32_t, int16_t, MinAggregate>
+{
+public:
+
+  MinSample(uint32_t key) :
+    AggregateNodeBase(key, int16_t(key * 7919 % 1000))
+  {}
+};
+
+/**
+ * Verify sizes and aggregates of all nodes in a subtree.
+ */
+template<typename N>
+bool checkAggregates(N* node)
+{
+  if (nullptr == node) {
+    return true;
+  }
+
+  uint32_t size = 1;
+  typename N::Value value = node->value();
+
+  if (nullptr != node->left()) {
+    size += node->left()->size();
+    value = N::combine(node->left()->aggregate(), value);
+  }
+  if (nullptr != node->right()) {
+    size += node->right()->size();
+    value = N::combine(value, node->right()->aggregate());
+  }
+  return (size == node->size() && value == node->aggregate()
+      && checkAggregates(node->left()) && checkAggregates(node->right()));
+}
+
+/**
+ * Insert and erase random keys in a tree and a map.
+ */
+template<typename Tree>
+void churn(Tree* tree, std::map<uint32_t, int64_t>* expected, uint32_t ops, uint32_t key_range)
+{
+  for (uint32_t i = 0; i < ops; i++) {
+    uint32_t key = rand() % key_range;
+
+    if (rand() % 3 == 0) {
+      tree->erase(key);
+      expected->erase(key);
+    } else {
+      tree->insert(key);
+      (*expected)[key] = tree->search(key)->value();
+    }
+  }
+}
+
+//=================================== TESTS ====================================
+
+TEST(AvlTreeAggregateTest, rankSelect)
+{
+  AvlTree<SumSample, uint32_t> tree;
+  std::map<uint32_t, int64_t> expected;
+  srand(31);
+  churn(&tree, &expected, 3000, 2000);
+  ASSERT_TRUE(checkAggregates(tree.root()));
+  ASSERT_EQ(expected.size(), tree.root()->size());
+
+  uint32_t index = 0;
+
+  for (auto& entry : expected) {
+    ASSERT_EQ(index, tree.rank(entry.first));
+    ASSERT_EQ(index + 1, tree.rank(entry.first + 1));
+
+    SumSample* node = tree.select(index);
+    ASSERT_TRUE(nullptr != node);
+    ASSERT_EQ(entry.first, node->key());
+    ++index;
+  }
+
+  ASSERT_TRUE(nullptr == tree.select(index));
+  ASSERT_EQ(0u, tree.rank(0));
+  ASSERT_EQ(index, tree.rank(5000));
+}
+
+TEST(AvlTreeAggregateTest, sum)
+{
+  AvlTree<SumSample, uint32_t> tree;
+  std::map<uint32_t, int64_t> expected;
+  srand(32);
+  churn(&tree, &expected, 3000, 2000);
+
+  for (uint32_t lo = 0; lo < 2100; lo += 37) {
+    for (uint32_t hi = lo; hi < 2100; hi += 151) {
+      int64_t sum = -1;
+      uint32_t count = 0;
+      int64_t expected_sum = 0;
+
+      for (auto it = expected.lower_bound(lo); it != expected.upper_bound(hi); ++it) {
+        expected_sum += it->second;
+        ++count;
+      }
+
+      ASSERT_EQ(count, tree.aggregate(lo, hi, &sum)) << lo << " " << hi;
+
+      if (count > 0) {
+        ASSERT_EQ(expected_sum, sum) << lo << " " << hi;
+      } else {
+        ASSERT_EQ(-1, sum);
+      }
+    }
+  }
+
+  tree.eraseBranch(tree.root());
+}
+
+TEST(AvlTreeAggregateTest, minMax)
+{
+  AvlTree<MaxSample, uint32_t> max_tree;
+  AvlTree<MinSample, uint32_t> min_tree;
+  std::map<uint32_t, int64_t> expected;
+  srand(33);
+  churn(&max_tree, &expected, 2000, 1000);
+  srand(33);
+  expected.clear();
+  churn(&min_tree, &expected, 2000, 1000);
+  ASSERT_TRUE(checkAggregates(max_tree.root()));
+  ASSERT_TRUE(checkAggregates(min_tree.root()));
+
+  for (uint32_t lo = 0; lo < 1000; lo += 41) {
+    uint32_t hi = lo + 97;
+    int16_t max = 0;
+    int16_t min = 0;
+    int64_t expected_max = -1;
+    int64_t expected_min = 1000;
+
+    for (auto it = expected.lower_bound(lo); it != expected.upper_bound(hi); ++it) {
+      expected_max = std::max(expected_max, it->second);
+      expected_min = std::min(expected_min, it->second);
+    }
+
+    max_tree.aggregate(lo, hi, &max);
+    min_tree.aggregate(lo, hi, &min);
+    ASSERT_EQ(expected_max, max);
+    ASSERT_EQ(expected_min, min);
+  }
+}
+
+TEST(AvlTreeAggregateTest, refreshAndBulk)
+{
+  AvlTree<SumSample, uint32_t> tree;
+  std::vector<uint32_t> keys;
+
+  for (uint32_t i = 0; i < 1000; i++) {
+    keys.push_back(i);
+  }
+
+  ASSERT_EQ(0, tree.buildFromSorted(keys.begin(), keys.end()));
+  ASSERT_TRUE(checkAggregates(tree.root()));
+
+  int64_t before = 0;
+  int64_t after = 0;
+  tree.aggregate(0, 999, &before);
+
+  tree.search(500)->value(1000);
+  ASSERT_TRUE(nullptr != tree.refresh(500));
+  ASSERT_TRUE(nullptr == tree.refresh(5000));
+  ASSERT_TRUE(checkAggregates(tree.root()));
+
+  tree.aggregate(0, 999, &after);
+  ASSERT_EQ(before - 500 % 17 + 1000, after);
+
+  // Set operations relink nodes through the same update path.
+  AvlTree<SumSample, uint32_t> other;
+  other.buildFromSorted(keys.begin() + 900, keys.end());
+  tree.setDifference(&other);
+  ASSERT_TRUE(checkAggregates(tree.root()));
+  ASSERT_EQ(900u, tree.root()->size());
+
+  tree.eraseRange(100, 199);
+  ASSERT_TRUE(checkAggregates(tree.root()));
+  ASSERT_EQ(100u, tree.rank(200));
+}
+
+} // namespace btr
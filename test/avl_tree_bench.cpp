@@ -0,0 +1,518 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+#include <chrono>
+#include <vector>
+#include <random>
+
+// PROJECT INCLUDES
+#include "utility/common/avl_tree.hpp"
+#include "utility/common/avl_tree_snapshot.hpp"
+#include "utility/common/test_helpers.hpp"
+#include "utility/common/wavl_tree.hpp"
+
+namespace btr
+{
+
+//================================ TEST FIXTURES ===============================
+
+/** Minimal tree node for measurements. */
+class BenchNode : public NodeBase<BenchNode, uint32_t, int16_t>
+{
+public:
+
+  BenchNode(uint32_t key) :
+    NodeBase(key)
+  {}
+};
+
+typedef AvlTree<BenchNode, uint32_t, int16_t> BenchTree;
+
+/**
+ * Recursive insert/erase/search that AvlTree used before switching to an explicit path stack.
+ * Kept as the reference for results and timing.
+ */
+class RecursiveAvl
+{
+public:
+
+  static BenchNode* insert(BenchTree* tree, uint32_t key)
+  {
+    BenchNode* n = insert(tree, tree->root(), key);
+    tree->root(n);
+    return n;
+  }
+
+  static BenchNode* erase(BenchTree* tree, uint32_t key)
+  {
+    BenchNode* n = erase(tree, tree->root(), key);
+    tree->root(n);
+    return n;
+  }
+
+  static BenchNode* search(BenchNode* root, uint32_t key)
+  {
+    if (nullptr == root || root->key() == key) {
+      return root;
+    }
+    if (root->key() < key) {
+      return search(root->right(), key);
+    }
+    return search(root->left(), key);
+  }
+
+private:
+
+  static BenchNode* insert(BenchTree* tree, BenchNode* node, uint32_t key)
+  {
+    if (nullptr == node) {
+      return tree->allocator().create(key);
+    }
+
+    if (key < node->key()) {
+      node->left(insert(tree, node->left(), key));
+    } else if (key > node->key()) {
+      node->right(insert(tree, node->right(), key));
+    } else {
+      return node;
+    }
+
+    node->height(BenchTree::max(
+          BenchTree::height(node->left()), BenchTree::height(node->right())) + 1);
+
+    int16_t b = BenchTree::balance(node);
+
+    if (b > 1) {
+      if (nullptr != node->left()) {
+        if (key < node->left()->key()) {
+          node = tree->rotateRight(node);
+        } else if (key > node->left()->key()) {
+          node->left(tree->rotateLeft(node->left()));
+          node = tree->rotateRight(node);
+        }
+      }
+    } else if (b < -1) {
+      if (nullptr != node->right()) {
+        if (key > node->right()->key()) {
+          node = tree->rotateLeft(node);
+        } else if (key < node->right()->key()) {
+          node->right(tree->rotateRight(node->right()));
+          node = tree->rotateLeft(node);
+        }
+      }
+    }
+    return node;
+  }
+
+  static BenchNode* erase(BenchTree* tree, BenchNode* root, uint32_t key)
+  {
+    if (nullptr == root) {
+      return nullptr;
+    }
+
+    if (key < root->key()) {
+      root->left(erase(tree, root->left(), key));
+    } else if (key > root->key()) {
+      root->right(erase(tree, root->right(), key));
+    } else {
+      if ((nullptr == root->left()) || (nullptr == root->right())) {
+        BenchNode* temp = root->left() ? root->left() : root->right();
+
+        if (nullptr == temp) {
+          temp = root;
+          root = nullptr;
+        } else {
+          *root = *temp;
+        }
+        tree->allocator().destroy(temp);
+      } else {
+        BenchNode* root_left = root->left();
+        BenchNode* root_right = root->right();
+        int16_t height = root->height();
+        BenchNode* temp = BenchTree::searchMin(root->right());
+
+        *root = *temp;
+        root->left(root_left);
+        root->right(root_right);
+        root->height(height);
+        root->right(erase(tree, root->right(), temp->key()));
+      }
+    }
+
+    if (nullptr == root) {
+      return nullptr;
+    }
+
+    root->height(BenchTree::max(
+          BenchTree::height(root->left()), BenchTree::height(root->right())) + 1);
+
+    int16_t b = BenchTree::balance(root);
+
+    if (b > 1) {
+      if (BenchTree::balance(root->left()) < 0) {
+        root->left(tree->rotateLeft(root->left()));
+      }
+      return tree->rotateRight(root);
+    }
+    if (b < -1) {
+      if (BenchTree::balance(root->right()) > 0) {
+        root->right(tree->rotateRight(root->right()));
+      }
+      return tree->rotateLeft(root);
+    }
+    return root;
+  }
+};
+
+/**
+ * @return true if two subtrees have the same shape, keys and heights
+ */
+static bool sameShape(BenchNode* a, BenchNode* b)
+{
+  if (nullptr == a || nullptr == b) {
+    return (a == b);
+  }
+  return (a->key() == b->key() && a->height() == b->height()
+      && sameShape(a->left(), b->left()) && sameShape(a->right(), b->right()));
+}
+
+/**
+ * @return random keys
+ */
+static std::vector<uint32_t> randomKeys(uint32_t count, uint32_t range)
+{
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<uint32_t> dist(0, range);
+  std::vector<uint32_t> keys(count);
+
+  for (auto& k : keys) {
+    k = dist(gen);
+  }
+  return keys;
+}
+
+/**
+ * @return nanoseconds per operation of calling func on every key
+ */
+template<typename F>
+static double measure(const std::vector<uint32_t>& keys, F func)
+{
+  auto start = std::chrono::steady_clock::now();
+
+  for (auto k : keys) {
+    func(k);
+  }
+
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() / keys.size();
+}
+
+/**
+ * Compare iterative and recursive insert, search and erase on a tree of the given size.
+ */
+static void compareRecursive(uint32_t nodes)
+{
+  std::vector<uint32_t> keys = randomKeys(nodes, 0xFFFFFFFF);
+  BenchTree iterative;
+  BenchTree recursive;
+  volatile uintptr_t sink = 0;
+
+  double ins_i = measure(keys, [&](uint32_t k) { iterative.insert(k); });
+  double ins_r = measure(keys, [&](uint32_t k) { RecursiveAvl::insert(&recursive, k); });
+  double find_i = measure(keys, [&](uint32_t k) {
+      sink = reinterpret_cast<uintptr_t>(BenchTree::search(iterative.root(), k)); });
+  double find_r = measure(keys, [&](uint32_t k) {
+      sink = reinterpret_cast<uintptr_t>(RecursiveAvl::search(recursive.root(), k)); });
+  double erase_i = measure(keys, [&](uint32_t k) { iterative.erase(k); });
+  double erase_r = measure(keys, [&](uint32_t k) { RecursiveAvl::erase(&recursive, k); });
+  (void)sink;
+
+  TEST_MSG << nodes << " nodes, ns/op iterative vs recursive: insert " << ins_i << " / " << ins_r
+    << ", search " << find_i << " / " << find_r << ", erase " << erase_i << " / " << erase_r;
+
+  ASSERT_TRUE(nullptr == iterative.root());
+  ASSERT_TRUE(nullptr == recursive.root());
+}
+
+/**
+ * Compare per-key insert of sorted keys with buildFromSorted, and per-key insert of a random
+ * batch with insertBatch.
+ */
+static void compareBulk(uint32_t nodes)
+{
+  std::vector<uint32_t> keys(nodes);
+
+  for (uint32_t i = 0; i < nodes; i++) {
+    keys[i] = i * 2;
+  }
+
+  BenchTree single;
+  BenchTree bulk;
+
+  double ins = measure(keys, [&](uint32_t k) { single.insert(k); });
+  auto start = std::chrono::steady_clock::now();
+  bulk.buildFromSorted(keys.begin(), keys.end());
+  double build = std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start).count() / nodes;
+
+  std::vector<uint32_t> batch = randomKeys(nodes, nodes * 4);
+  std::vector<uint32_t> copy(batch);
+
+  double ins_batch = measure(batch, [&](uint32_t k) { single.insert(k); });
+  start = std::chrono::steady_clock::now();
+  bulk.insertBatch(copy.data(), copy.size());
+  double merge = std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start).count() / nodes;
+
+  TEST_MSG << nodes << " keys, ns/key insert vs bulk: sorted " << ins << " / " << build
+    << ", batch " << ins_batch << " / " << merge;
+
+  for (auto k : batch) {
+    ASSERT_TRUE(nullptr != BenchTree::search(bulk.root(), k));
+  }
+}
+
+/**
+ * Compare tree search with snapshot search of random keys.
+ */
+static void compareSnapshot(uint32_t nodes)
+{
+  std::vector<uint32_t> keys = randomKeys(nodes, 0xFFFFFFFF);
+  BenchTree tree;
+
+  for (auto k : keys) {
+    tree.insert(k);
+  }
+
+  AvlTreeSnapshot<BenchNode, uint32_t> snapshot;
+  ASSERT_EQ(0, snapshot.freeze(tree));
+
+  std::vector<uint32_t> lookups = randomKeys(nodes, 0xFFFFFFFF);
+
+  for (uint32_t i = 0; i < lookups.size(); i += 2) {
+    lookups[i] = keys[i];
+  }
+
+  volatile uintptr_t sink = 0;
+  double find_tree = measure(lookups, [&](uint32_t k) {
+      sink = reinterpret_cast<uintptr_t>(BenchTree::search(tree.root(), k)); });
+  double find_snap = measure(lookups, [&](uint32_t k) {
+      sink = reinterpret_cast<uintptr_t>(snapshot.search(k)); });
+  (void)sink;
+
+  TEST_MSG << nodes << " nodes, ns/search tree vs snapshot: " << find_tree << " / " << find_snap;
+
+  for (auto k : lookups) {
+    ASSERT_TRUE(BenchTree::search(tree.root(), k) == snapshot.search(k));
+  }
+}
+
+/**
+ * Compare per-key insert with setUnion of two trees of the given size.
+ */
+static void compareUnion(uint32_t nodes)
+{
+  std::vector<uint32_t> keys = randomKeys(nodes, 0xFFFFFFFF);
+  std::vector<uint32_t> others = randomKeys(nodes * 2, 0xFFFFFFFF);
+  others.erase(others.begin(), others.begin() + nodes);
+
+  BenchTree single;
+  BenchTree joined;
+  BenchTree other;
+
+  for (auto k : keys) {
+    single.insert(k);
+    joined.insert(k);
+  }
+  for (auto k : others) {
+    other.insert(k);
+  }
+
+  double ins = measure(others, [&](uint32_t k) { single.insert(k); });
+  auto start = std::chrono::steady_clock::now();
+  joined.setUnion(&other);
+  double uni = std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - start).count() / nodes;
+
+  TEST_MSG << nodes << " + " << nodes << " nodes, ns/key insert vs union: " << ins << " / " << uni;
+
+  for (auto k : others) {
+    ASSERT_TRUE(nullptr != BenchTree::search(joined.root(), k));
+  }
+}
+
+/**
+ * Compare insert and append of increasing keys.
+ */
+static void compareAppend(uint32_t nodes)
+{
+  std::vector<uint32_t> keys(nodes);
+
+  for (uint32_t i = 0; i < nodes; i++) {
+    keys[i] = i * 3;
+  }
+
+  BenchTree inserted;
+  BenchTree appended;
+
+  double ins = measure(keys, [&](uint32_t k) { inserted.insert(k); });
+  double app = measure(keys, [&](uint32_t k) { appended.append(k); });
+
+  TEST_MSG << nodes << " keys, ns/key insert vs append: " << ins << " / " << app;
+
+  ASSERT_TRUE(sameShape(inserted.root(), appended.root()));
+}
+
+/**
+ * Compare AvlTree and WavlTree on a tree of the given size under workloads mixing inserts and
+ * erases of random keys in the given percentages.
+ */
+static void compareWavl(uint32_t nodes, uint32_t erase_pct)
+{
+  typedef WavlTree<BenchNode, uint32_t, int16_t> BenchWavl;
+
+  std::vector<uint32_t> keys = randomKeys(nodes, nodes * 4);
+  std::vector<uint32_t> ops = randomKeys(nodes * 4, nodes * 4);
+  std::mt19937 gen(7);
+  BenchTree avl;
+  BenchWavl wavl;
+
+  for (auto k : keys) {
+    avl.insert(k);
+    wavl.insert(k);
+  }
+
+  // Flag erases in the lowest bit so both trees see the same operations.
+  for (auto& k : ops) {
+    k = (k << 1) | (gen() % 100 < erase_pct ? 1 : 0);
+  }
+
+  double mixed_avl = measure(ops, [&](uint32_t k) {
+      if (k & 1) {
+        avl.erase(k >> 1);
+      } else {
+        avl.insert(k >> 1);
+      }
+  });
+  double mixed_wavl = measure(ops, [&](uint32_t k) {
+      if (k & 1) {
+        wavl.erase(k >> 1);
+      } else {
+        wavl.insert(k >> 1);
+      }
+  });
+
+  TEST_MSG << nodes << " nodes, " << erase_pct << "% erases, ns/op avl vs wavl: " << mixed_avl
+    << " / " << mixed_wavl << ", root height " << BenchTree::height(avl.root()) << " / "
+    << BenchWavl::height(wavl.root());
+
+  BenchTree::Iterator it = avl.begin();
+
+  for (BenchWavl::Iterator wit = wavl.begin(); wit != wavl.end(); ++wit, ++it) {
+    ASSERT_TRUE(it != avl.end());
+    ASSERT_EQ(it->key(), wit->key());
+  }
+  ASSERT_TRUE(it == avl.end());
+}
+
+//=================================== TESTS ====================================
+
+/** Iterative operations must produce the same trees as the recursive ones. */
+TEST(AvlTreeBench, sameAsRecursive)
+{
+  std::vector<uint32_t> keys = randomKeys(20000, 5000);
+  BenchTree iterative;
+  BenchTree recursive;
+
+  for (uint32_t i = 0; i < keys.size(); i++) {
+    if (i % 3 == 2) {
+      iterative.erase(keys[i - 1]);
+      RecursiveAvl::erase(&recursive, keys[i - 1]);
+    } else {
+      iterative.insert(keys[i]);
+      RecursiveAvl::insert(&recursive, keys[i]);
+    }
+    ASSERT_TRUE(sameShape(iterative.root(), recursive.root())) << "Step: " << i;
+  }
+}
+
+TEST(AvlTreeBench, iterativeVsRecursive1K)
+{
+  compareRecursive(1000);
+}
+
+TEST(AvlTreeBench, DISABLED_iterativeVsRecursive1M)
+{
+  compareRecursive(1000000);
+}
+
+TEST(AvlTreeBench, DISABLED_iterativeVsRecursive10M)
+{
+  compareRecursive(10000000);
+}
+
+TEST(AvlTreeBench, bulk1K)
+{
+  compareBulk(1000);
+}
+
+TEST(AvlTreeBench, DISABLED_bulk1M)
+{
+  compareBulk(1000000);
+}
+
+TEST(AvlTreeBench, snapshot1K)
+{
+  compareSnapshot(1000);
+}
+
+TEST(AvlTreeBench, DISABLED_snapshot1M)
+{
+  compareSnapshot(1000000);
+}
+
+TEST(AvlTreeBench, union10K)
+{
+  compareUnion(10000);
+}
+
+TEST(AvlTreeBench, DISABLED_union1M)
+{
+  compareUnion(1000000);
+}
+
+TEST(AvlTreeBench, append10K)
+{
+  compareAppend(10000);
+}
+
+TEST(AvlTreeBench, DISABLED_append10M)
+{
+  compareAppend(10000000);
+}
+
+TEST(AvlTreeBench, wavl1K)
+{
+  compareWavl(1000, 50);
+}
+
+TEST(AvlTreeBench, DISABLED_wavl100K)
+{
+  compareWavl(100000, 30);
+  compareWavl(100000, 50);
+  compareWavl(100000, 70);
+}
+
+TEST(AvlTreeBench, DISABLED_wavl1M)
+{
+  compareWavl(1000000, 30);
+  compareWavl(1000000, 50);
+  compareWavl(1000000, 70);
+}
+
+} // namespace btr
@@ -0,0 +1,222 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+#include <set>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+// PROJECT INCLUDES
+#include "utility/common/avl_tree.hpp"
+#include "utility/common/avl_tree_image.hpp"
+
+namespace btr
+{
+
+//================================ TEST FIXTURES ===============================
+
+/** Tree node with a payload. */
+class Item : public NodeBase<Item, uint32_t, int16_t>
+{
+public:
+
+  Item(uint32_t key) :
+    NodeBase(key),
+    value_(key * 3)
+  {}
+
+  uint32_t value_;
+};
+
+typedef AvlTree<Item, uint32_t, int16_t> ItemTree;
+typedef AvlTreeImage<uint32_t, uint32_t> ItemImage;
+
+/**
+ * Serialize a tree into a buffer.
+ */
+int writeImage(ItemTree& tree, Buff* buff)
+{
+  return ItemImage::write(tree, buff, [](Item* node, uint32_t* payload) {
+    *payload = node->value_;
+  });
+}
+
+/**
+ * Fill a tree and a set with random keys.
+ */
+void fill(ItemTree* tree, std::set<uint32_t>* expected, uint32_t count, uint32_t key_range)
+{
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t key = rand() % key_range;
+    tree->insert(key);
+    expected->insert(key);
+  }
+}
+
+/**
+ * Verify image contents against a set of keys.
+ */
+void checkImage(const ItemImage& image, const std::set<uint32_t>& expected, uint32_t key_range)
+{
+  ASSERT_EQ(expected.size(), image.size());
+
+  for (uint32_t key = 0; key < key_range; key++) {
+    const ItemImage::Record* r = image.search(key);
+
+    if (expected.count(key) > 0) {
+      ASSERT_TRUE(nullptr != r) << key;
+      ASSERT_EQ(key, r->key_);
+      ASSERT_EQ(key * 3, r->payload_);
+    } else {
+      ASSERT_TRUE(nullptr == r) << key;
+    }
+  }
+
+  std::vector<uint32_t> keys;
+  image.visit([&keys](const ItemImage::Record* r) {
+    keys.push_back(r->key_);
+    return 0;
+  }, key_range / 4, key_range / 2);
+  ASSERT_EQ(std::vector<uint32_t>(expected.lower_bound(key_range / 4),
+      expected.upper_bound(key_range / 2)), keys);
+}
+
+//=================================== TESTS ====================================
+
+TEST(AvlTreeImageTest, buff)
+{
+  ItemTree tree;
+  std::set<uint32_t> expected;
+  srand(41);
+  fill(&tree, &expected, 1000, 4000);
+
+  Buff buff(16, alignof(ItemImage::Record));
+  ASSERT_EQ(0, writeImage(tree, &buff));
+  ASSERT_EQ(ItemImage::imageSize(expected.size()), buff.available());
+
+  ItemImage image;
+  ASSERT_EQ(0, image.attach(buff.read_ptr(), buff.available()));
+  checkImage(image, expected, 4000);
+
+  // Records are in key order and linked as a balanced tree.
+  for (uint32_t i = 1; i < image.size(); i++) {
+    ASSERT_LT(image.record(i - 1)->key_, image.record(i)->key_);
+  }
+  ASSERT_TRUE(nullptr == image.record(image.size()));
+
+  // Attached read-only.
+  ASSERT_TRUE(nullptr == image.mutableSearch(*expected.begin()));
+
+  // Stop visiting.
+  uint32_t visited = 0;
+  ASSERT_EQ(-1, image.visit([&visited](const ItemImage::Record*) {
+    return (++visited == 5 ? -1 : 0);
+  }, 0, 4000));
+  ASSERT_EQ(5u, visited);
+}
+
+TEST(AvlTreeImageTest, empty)
+{
+  ItemTree tree;
+  Buff buff(16);
+  ItemImage image;
+
+  ASSERT_EQ(0, writeImage(tree, &buff));
+  ASSERT_EQ(0, image.attach(buff.read_ptr(), buff.available()));
+  ASSERT_EQ(0u, image.size());
+  ASSERT_TRUE(nullptr == image.search(0));
+  ASSERT_EQ(0, image.visit([](const ItemImage::Record*) { return -1; }, 0, 10));
+}
+
+TEST(AvlTreeImageTest, noSpace)
+{
+  ItemTree tree;
+  tree.insert(1);
+  tree.insert(2);
+
+  Buff buff(32);
+  ASSERT_EQ(-1, ItemImage::write(tree, &buff, [](Item*, uint32_t*) {}, Buff::NO_MOD));
+  ASSERT_EQ(ENOMEM, errno);
+  ASSERT_EQ(0u, buff.available());
+}
+
+TEST(AvlTreeImageTest, corrupt)
+{
+  ItemTree tree;
+  tree.insert(1);
+  tree.insert(2);
+
+  Buff buff(16);
+  ASSERT_EQ(0, writeImage(tree, &buff));
+
+  ItemImage image;
+  uint8_t* data = buff.read_ptr();
+
+  // Truncated.
+  ASSERT_EQ(-1, image.attach(data, buff.available() - 1));
+  ASSERT_EQ(EINVAL, errno);
+  ASSERT_EQ(-1, image.attach(data, 4));
+
+  // Misaligned.
+  ASSERT_EQ(-1, image.attach(data + 1, buff.available() - 1));
+
+  // Bad magic.
+  data[0] ^= 0xFF;
+  ASSERT_EQ(-1, image.attach(data, buff.available()));
+  data[0] ^= 0xFF;
+  ASSERT_EQ(0, image.attach(data, buff.available()));
+
+  // Different key type.
+  AvlTreeImage<uint16_t, uint32_t> other;
+  ASSERT_EQ(-1, other.attach(data, buff.available()));
+  ASSERT_EQ(EINVAL, errno);
+}
+
+TEST(AvlTreeImageTest, map)
+{
+  ItemTree tree;
+  std::set<uint32_t> expected;
+  srand(42);
+  fill(&tree, &expected, 500, 2000);
+
+  Buff buff(16);
+  ASSERT_EQ(0, writeImage(tree, &buff));
+
+  char path[] = "/tmp/avl_tree_image_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_LE(0, fd);
+  ASSERT_EQ(ssize_t(buff.available()), ::write(fd, buff.read_ptr(), buff.available()));
+  close(fd);
+
+  ItemImage image;
+  ASSERT_EQ(0, image.map(path));
+  checkImage(image, expected, 2000);
+  ASSERT_TRUE(nullptr == image.mutableSearch(*expected.begin()));
+
+  // Copy-on-write changes stay in memory.
+  uint32_t key = *expected.begin();
+  ASSERT_EQ(0, image.map(path, true));
+  ItemImage::Record* r = image.mutableSearch(key);
+  ASSERT_TRUE(nullptr != r);
+  r->payload_ = 7;
+  ASSERT_EQ(7u, image.search(key)->payload_);
+
+  ItemImage reloaded;
+  ASSERT_EQ(0, reloaded.map(path));
+  checkImage(reloaded, expected, 2000);
+
+  image.detach();
+  ASSERT_EQ(0u, image.size());
+  ASSERT_EQ(-1, image.map("/tmp/avl_tree_image_missing"));
+  ASSERT_EQ(ENOENT, errno);
+  unlink(path);
+}
+
+} // namespace btr
@@ -0,0 +1,224 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+#include <limits>
+#include <set>
+#include <vector>
+#include <cstdlib>
+
+// PROJECT INCLUDES
+#include "utility/common/avl_tree.hpp"
+#include "utility/common/avl_tree_snapshot.hpp"
+
+namespace btr
+{
+
+//================================ TEST FIXTURES ===============================
+
+/** Tree node with a payload. */
+class Entry : public NodeBase<Entry, uint32_t, int16_t>
+{
+public:
+
+  Entry(uint32_t key) :
+    NodeBase(key),
+    value_(key * 10)
+  {}
+
+  uint32_t value_;
+};
+
+typedef AvlTree<Entry, uint32_t, int16_t> EntryTree;
+
+/** Tree node for other key types. */
+template<typename K>
+class KeyEntry : public NodeBase<KeyEntry<K>, K, int16_t>
+{
+public:
+
+  KeyEntry(K key) :
+    NodeBase<KeyEntry<K>, K, int16_t>(key)
+  {}
+};
+
+/**
+ * Compare snapshot lookups of keys spread over the whole range of K, including the sign bit, with
+ * std::set.
+ */
+template<typename K>
+void checkKeyType(uint32_t count)
+{
+  typedef KeyEntry<K> Node;
+  AvlTree<Node, K, int16_t> tree;
+  std::set<K> expected;
+  std::vector<K> probes;
+
+  for (uint32_t i = 0; i < count; i++) {
+    K key = K(uint32_t(rand()) * 2654435761u);
+    tree.insert(key);
+    expected.insert(key);
+    probes.push_back(key);
+    probes.push_back(K(key + 1));
+    probes.push_back(K(key - 1));
+  }
+  probes.push_back(std::numeric_limits<K>::min());
+  probes.push_back(std::numeric_limits<K>::max());
+
+  AvlTreeSnapshot<Node, K> snapshot;
+  ASSERT_EQ(0, snapshot.freeze(tree));
+
+  for (K key : probes) {
+    auto lower = expected.lower_bound(key);
+    auto upper = expected.upper_bound(key);
+    Node* first = nullptr;
+    Node* last = nullptr;
+    snapshot.equalRange(key, &first, &last);
+
+    if (lower == expected.end()) {
+      ASSERT_TRUE(nullptr == snapshot.lowerBound(key));
+      ASSERT_TRUE(nullptr == first);
+    } else {
+      ASSERT_EQ(*lower, snapshot.lowerBound(key)->key()) << int64_t(key);
+      ASSERT_EQ(*lower, first->key());
+    }
+
+    if (upper == expected.end()) {
+      ASSERT_TRUE(nullptr == snapshot.upperBound(key));
+      ASSERT_TRUE(nullptr == last);
+    } else {
+      ASSERT_EQ(*upper, snapshot.upperBound(key)->key()) << int64_t(key);
+      ASSERT_EQ(*upper, last->key());
+    }
+    ASSERT_EQ(expected.count(key) > 0, nullptr != snapshot.search(key));
+  }
+}
+
+//=================================== TESTS ====================================
+
+TEST(AvlTreeSnapshotTest, empty)
+{
+  EntryTree tree;
+  AvlTreeSnapshot<Entry, uint32_t> snapshot;
+
+  ASSERT_EQ(0, snapshot.freeze(tree));
+  ASSERT_EQ(uint32_t(0), snapshot.size());
+  ASSERT_TRUE(nullptr == snapshot.search(1));
+  ASSERT_TRUE(nullptr == snapshot.lowerBound(0));
+  ASSERT_EQ(0, snapshot.visit([](Entry*) { return -1; }));
+}
+
+TEST(AvlTreeSnapshotTest, searchAndBounds)
+{
+  // Every size up to a few full levels, so that both complete and partial last levels are hit.
+  for (uint32_t count = 1; count < 70; count++) {
+    EntryTree tree;
+
+    for (uint32_t i = 0; i < count; i++) {
+      tree.insert(i * 2 + 1);
+    }
+
+    AvlTreeSnapshot<Entry, uint32_t> snapshot;
+    ASSERT_EQ(0, snapshot.freeze(tree));
+    ASSERT_EQ(count, snapshot.size());
+
+    for (uint32_t key = 0; key <= count * 2 + 1; key++) {
+      Entry* node = snapshot.search(key);
+
+      if (key % 2 && key < count * 2) {
+        ASSERT_TRUE(nullptr != node) << count << " " << key;
+        ASSERT_EQ(key, node->key());
+        ASSERT_EQ(key * 10, node->value_);
+      } else {
+        ASSERT_TRUE(nullptr == node);
+      }
+
+      Entry* lower = snapshot.lowerBound(key);
+
+      if (key < count * 2) {
+        ASSERT_TRUE(nullptr != lower) << count << " " << key;
+        ASSERT_EQ(key | 1, lower->key());
+      } else {
+        ASSERT_TRUE(nullptr == lower);
+      }
+
+      Entry* upper = snapshot.upperBound(key);
+      Entry* first = nullptr;
+      Entry* last = nullptr;
+      snapshot.equalRange(key, &first, &last);
+      ASSERT_TRUE(first == lower);
+      ASSERT_TRUE(last == upper);
+
+      if (key + 1 < count * 2) {
+        ASSERT_TRUE(nullptr != upper) << count << " " << key;
+        ASSERT_EQ((key + 1) | 1, upper->key());
+      } else {
+        ASSERT_TRUE(nullptr == upper);
+      }
+    }
+  }
+}
+
+TEST(AvlTreeSnapshotTest, keyTypes)
+{
+  srand(5);
+
+  for (uint32_t count : { 10u, 100u, 3000u }) {
+    checkKeyType<uint16_t>(count);
+    checkKeyType<int16_t>(count);
+    checkKeyType<uint32_t>(count);
+    checkKeyType<int32_t>(count);
+    checkKeyType<uint64_t>(count);
+  }
+}
+
+TEST(AvlTreeSnapshotTest, visit)
+{
+  EntryTree tree;
+  std::set<uint32_t> expected;
+  srand(9);
+
+  for (int i = 0; i < 1000; i++) {
+    uint32_t key = rand() % 5000;
+    tree.insert(key);
+    expected.insert(key);
+  }
+
+  AvlTreeSnapshot<Entry, uint32_t> snapshot;
+  ASSERT_EQ(0, snapshot.freeze(tree));
+
+  std::vector<uint32_t> keys;
+  snapshot.visit([&keys](Entry* n) {
+    keys.push_back(n->key());
+    return 0;
+  });
+  ASSERT_EQ(std::vector<uint32_t>(expected.begin(), expected.end()), keys);
+
+  keys.clear();
+  snapshot.visit([&keys](Entry* n) {
+    keys.push_back(n->key());
+    return 0;
+  }, 1000, 2000);
+  ASSERT_EQ(std::vector<uint32_t>(expected.lower_bound(1000), expected.upper_bound(2000)), keys);
+
+  keys.clear();
+  ASSERT_EQ(-1, snapshot.visit([&keys](Entry* n) {
+    keys.push_back(n->key());
+    return (keys.size() == 3 ? -1 : 0);
+  }, 1000, 2000));
+  ASSERT_EQ(3u, keys.size());
+
+  // Re-freezing picks up changes.
+  tree.insert(6000);
+  ASSERT_TRUE(nullptr == snapshot.search(6000));
+  ASSERT_EQ(0, snapshot.freeze(tree));
+  ASSERT_TRUE(nullptr != snapshot.search(6000));
+}
+
+} // namespace btr
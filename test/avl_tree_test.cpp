@@ -11,6 +11,11 @@
 #include <iostream>
 #include <sstream>
 #include <limits>
+#include <map>
+#include <set>
+#include <cstdlib>
+#include <algorithm>
+#include <iterator>
 
 // PROJECT INCLUDES
 #include "utility/common/avl_tree.hpp"
@@ -63,6 +68,68 @@ protected:
 
 //------------------------------------------------------------------------------
 
+/**
+ * Verify binary-search-tree order, stored heights and AVL balance of a subtree.
+ *
+ * @param node - subtree root
+ * @param count - incremented by the number of nodes in the subtree
+ * @return subtree height or -1 if the subtree is invalid
+ */
+template<typename N>
+int checkAvl(N* node, uint32_t* count)
+{
+  if (nullptr == node) {
+    return 0;
+  }
+  if ((nullptr != node->left() && node->left()->key() >= node->key())
+      || (nullptr != node->right() && node->right()->key() <= node->key())) {
+    return -1;
+  }
+
+  int lh = checkAvl(node->left(), count);
+  int rh = checkAvl(node->right(), count);
+
+  if (lh < 0 || rh < 0 || lh - rh > 1 || rh - lh > 1) {
+    return -1;
+  }
+
+  int h = (lh > rh ? lh : rh) + 1;
+  ++(*count);
+  return (h == node->height() ? h : -1);
+}
+
+/**
+ * Insert and erase random keys, comparing the tree against std::set.
+ */
+template<typename Tree>
+void churn(Tree* tree, uint32_t ops, uint16_t key_range)
+{
+  std::set<uint16_t> expected;
+  srand(7);
+
+  for (uint32_t i = 0; i < ops; i++) {
+    uint16_t key = rand() % key_range;
+
+    if (rand() % 3 == 0) {
+      tree->erase(key);
+      expected.erase(key);
+    } else {
+      tree->insert(key);
+      expected.insert(key);
+    }
+  }
+
+  uint32_t count = 0;
+  ASSERT_LT(0, checkAvl(tree->root(), &count));
+  ASSERT_EQ(expected.size(), count);
+
+  for (auto key : expected) {
+    ASSERT_TRUE(nullptr != tree->search(key)) << key;
+  }
+}
+
+//------------------------------------------------------------------------------
+
 /** Test fixture for testing AvlTree */
 class AvlTreeTest : public testing::Test
 {
@@ -125,14 +192,15 @@ TEST_F(AvlTreeTest, erase)
   ASSERT_TRUE(nullptr != s_node);
   ASSERT_TRUE(tree_.root() == s_node);
   ASSERT_EQ(3, s_node->key());
-  s_node->keys_.clear();
-  s_node->keys_.push_back(91);
-  s_node->keys_.push_back(88);
 
-  // After deleting root node 3, node 7 becomes root. We expect data members to be copied over
-  // from 3 to 7.
+  Server* successor = tree_.search(7);
+  successor->keys_.push_back(91);
+  successor->keys_.push_back(88);
+
+  // After deleting root node 3, its successor 7 is relinked in its place. No data is copied, so
+  // the node stays where it was and keeps its data.
   Server* e_node = tree_.erase(3);
-  (void)e_node;
+  ASSERT_TRUE(successor == e_node);
   s_node = tree_.search(tree_.root(), 3);
   ASSERT_TRUE(nullptr == s_node);
 
@@ -141,14 +209,46 @@ TEST_F(AvlTreeTest, erase)
   ASSERT_TRUE(nullptr == s_node);
 
   s_node = tree_.search(tree_.root(), 7);
+  ASSERT_TRUE(successor == s_node);
   ASSERT_TRUE(tree_.root() == s_node);
-  ASSERT_EQ(tree_.root()->key(), s_node->key());
   ASSERT_EQ(1, s_node->left()->key());
   ASSERT_TRUE(nullptr == s_node->right());
+  ASSERT_EQ(2u, s_node->keys_.size());
   ASSERT_EQ(91, s_node->keys_[0]);
   ASSERT_EQ(88, s_node->keys_[1]);
 }
 
+/** Erasing keys must not move other nodes. */
+TEST(AvlTreeEraseTest, stableNodes)
+{
+  AvlTree<Server, uint16_t, int16_t, PoolNodeAllocator<Server>> tree;
+  std::map<uint16_t, Server*> nodes;
+  srand(41);
+
+  for (int i = 0; i < 3000; i++) {
+    uint16_t key = rand() % 1000;
+
+    if (rand() % 3 == 0) {
+      tree.erase(key);
+      nodes.erase(key);
+    } else if (nullptr == tree.search(key)) {
+      tree.insert(key);
+      nodes[key] = tree.search(key);
+    }
+
+    if (i % 100 == 0) {
+      uint32_t count = 0;
+      ASSERT_LT(-1, checkAvl(tree.root(), &count));
+      ASSERT_EQ(nodes.size(), count);
+
+      for (auto& entry : nodes) {
+        ASSERT_TRUE(entry.second == tree.search(entry.first)) << entry.first;
+      }
+    }
+  }
+  ASSERT_EQ(nodes.size(), tree.allocator().count());
+}
+
 /** Test eraseBranch function. */
 TEST_F(AvlTreeTest, eraseBranch)
 {
@@ -156,4 +256,487 @@ TEST_F(AvlTreeTest, eraseBranch)
   ASSERT_TRUE(nullptr == tree_.root());
 }
 
+/** Test in-order iteration in both directions. */
+TEST_F(AvlTreeTest, iterate)
+{
+  std::vector<uint16_t> keys;
+
+  for (auto it = tree_.begin(); it != tree_.end(); ++it) {
+    keys.push_back(it->key());
+  }
+  ASSERT_EQ(std::vector<uint16_t>({ 1, 3, 7, 9 }), keys);
+
+  keys.clear();
+
+  for (auto it = tree_.end(); it != tree_.begin();) {
+    --it;
+    keys.push_back((*it).key());
+  }
+  ASSERT_EQ(std::vector<uint16_t>({ 9, 7, 3, 1 }), keys);
+
+  AvlTree<Server> empty;
+  ASSERT_TRUE(empty.begin() == empty.end());
+}
+
+/** Test lowerBound, upperBound and equalRange functions. */
+TEST_F(AvlTreeTest, bounds)
+{
+  ASSERT_EQ(1, tree_.lowerBound(0)->key());
+  ASSERT_EQ(3, tree_.lowerBound(2)->key());
+  ASSERT_EQ(3, tree_.lowerBound(3)->key());
+  ASSERT_TRUE(tree_.end() == tree_.lowerBound(10));
+
+  ASSERT_EQ(7, tree_.upperBound(3)->key());
+  ASSERT_EQ(7, tree_.upperBound(4)->key());
+  ASSERT_TRUE(tree_.end() == tree_.upperBound(9));
+
+  // Bounds are valid starting points for iteration.
+  auto it = tree_.lowerBound(2);
+  ASSERT_EQ(7, (++it)->key());
+  ASSERT_EQ(1, (--(--it))->key());
+
+  AvlTree<Server>::Iterator first, last;
+  tree_.equalRange(7, &first, &last);
+  ASSERT_EQ(7, first->key());
+  ASSERT_EQ(9, last->key());
+
+  tree_.equalRange(5, &first, &last);
+  ASSERT_TRUE(first == last);
+  ASSERT_EQ(7, first->key());
+}
+
+/** Test visitors and ranged traversal. */
+TEST_F(AvlTreeTest, visit)
+{
+  std::vector<uint16_t> keys;
+
+  ASSERT_EQ(0, tree_.visit(tree_.root(), [&keys](Server* n) {
+    keys.push_back(n->key());
+    return 0;
+  }));
+  ASSERT_EQ(std::vector<uint16_t>({ 1, 3, 7, 9 }), keys);
+
+  keys.clear();
+  ASSERT_EQ(-1, tree_.visit(tree_.root(), [&keys](Server* n) {
+    keys.push_back(n->key());
+    return (n->key() == 3 ? -1 : 0);
+  }));
+  ASSERT_EQ(std::vector<uint16_t>({ 1, 3 }), keys);
+
+  keys.clear();
+  tree_.visit(tree_.root(), [&keys](Server* n) {
+    keys.push_back(n->key());
+    return 0;
+  }, 2, 7);
+  ASSERT_EQ(std::vector<uint16_t>({ 3, 7 }), keys);
+
+  tree_.traverse(tree_.root(), &observer_, 4, 100);
+  ASSERT_EQ(std::vector<uint16_t>({ 7, 9 }), observer_.keys_);
+}
+
+/** Test bulk loading sorted keys. */
+TEST(AvlTreeBulkTest, buildFromSorted)
+{
+  AvlTree<Server> tree;
+  std::vector<uint16_t> keys;
+
+  for (uint16_t i = 0; i < 1000; i++) {
+    keys.push_back(i / 2 * 3);
+  }
+
+  tree.insert(5000);
+  ASSERT_EQ(0, tree.buildFromSorted(keys.begin(), keys.end()));
+  ASSERT_TRUE(nullptr == tree.search(5000));
+
+  uint32_t count = 0;
+  ASSERT_EQ(9, checkAvl(tree.root(), &count));
+  ASSERT_EQ(uint32_t(500), count);
+
+  uint16_t expected = 0;
+
+  for (auto it = tree.begin(); it != tree.end(); ++it, expected += 3) {
+    ASSERT_EQ(expected, it->key());
+  }
+
+  ASSERT_EQ(0, tree.buildFromSorted(keys.begin(), keys.begin()));
+  ASSERT_TRUE(nullptr == tree.root());
+}
+
+/** Test merging a batch into a tree. */
+TEST(AvlTreeBulkTest, insertBatch)
+{
+  AvlTree<Server> tree;
+  std::set<uint16_t> expected;
+  srand(3);
+
+  for (int i = 0; i < 300; i++) {
+    uint16_t key = rand() % 1000;
+    tree.insert(key);
+    expected.insert(key);
+  }
+
+  // Existing nodes are relinked, not copied.
+  Server* node = tree.search(*expected.begin());
+  node->keys_.push_back(91);
+
+  std::vector<uint16_t> batch;
+
+  for (int i = 0; i < 500; i++) {
+    batch.push_back(rand() % 2000);
+  }
+  batch.push_back(*expected.begin());
+  expected.insert(batch.begin(), batch.end());
+
+  ASSERT_EQ(0, tree.insertBatch(batch.data(), batch.size()));
+  ASSERT_TRUE(std::is_sorted(batch.begin(), batch.end()));
+
+  uint32_t count = 0;
+  ASSERT_LT(0, checkAvl(tree.root(), &count));
+  ASSERT_EQ(expected.size(), count);
+
+  auto eit = expected.begin();
+
+  for (auto it = tree.begin(); it != tree.end(); ++it, ++eit) {
+    ASSERT_EQ(*eit, it->key());
+  }
+  ASSERT_TRUE(node == tree.search(node->key()));
+  ASSERT_EQ(91, node->keys_[0]);
+
+  // A small batch is inserted one by one.
+  uint16_t small[] = { 4000, 1, 4000 };
+  expected.insert(small, small + 3);
+  ASSERT_EQ(0, tree.insertBatch(small, 3));
+
+  count = 0;
+  ASSERT_LT(0, checkAvl(tree.root(), &count));
+  ASSERT_EQ(expected.size(), count);
+
+  tree.eraseBranch(tree.root());
+}
+
+/** Test bulk operations with an exhausted allocator. */
+TEST(AvlTreeBulkTest, allocatorExhausted)
+{
+  AvlTree<Server, uint16_t, int16_t, StaticNodeAllocator<Server, 8>> tree;
+  uint16_t keys[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+
+  errno = 0;
+  ASSERT_EQ(-1, tree.buildFromSorted(keys, keys + 10));
+  ASSERT_EQ(ENOMEM, errno);
+
+  uint32_t count = 0;
+  ASSERT_LT(0, checkAvl(tree.root(), &count));
+  ASSERT_EQ(uint32_t(8), count);
+
+  tree.buildFromSorted(keys, keys + 4);
+  uint16_t batch[] = { 20, 19, 18, 17, 16, 15 };
+  errno = 0;
+  ASSERT_EQ(-1, tree.insertBatch(batch, 6));
+  ASSERT_EQ(ENOMEM, errno);
+
+  count = 0;
+  ASSERT_LT(0, checkAvl(tree.root(), &count));
+  ASSERT_EQ(uint32_t(8), count);
+}
+
+/** Test a small batch, inserted one by one, with an exhausted allocator. */
+TEST(AvlTreeBulkTest, smallBatchAllocatorExhausted)
+{
+  AvlTree<Server, uint16_t, int16_t, StaticNodeAllocator<Server, 64>> tree;
+  uint16_t keys[64];
+
+  for (uint16_t i = 0; i < 64; i++) {
+    keys[i] = i * 2;
+  }
+  ASSERT_EQ(0, tree.buildFromSorted(keys, keys + 64));
+
+  // Keys already in the tree need no allocation.
+  uint16_t present[] = { 10, 20 };
+  errno = 0;
+  ASSERT_EQ(0, tree.insertBatch(present, 2));
+  ASSERT_EQ(0, errno);
+
+  uint16_t batch[] = { 30, 31 };
+  ASSERT_EQ(-1, tree.insertBatch(batch, 2));
+  ASSERT_EQ(ENOMEM, errno);
+
+  uint32_t count = 0;
+  ASSERT_LT(0, checkAvl(tree.root(), &count));
+  ASSERT_EQ(uint32_t(64), count);
+}
+
+/**
+ * Fill a tree and a set with random keys.
+ */
+template<typename Tree>
+void randomFill(Tree* tree, std::set<uint16_t>* keys, uint32_t count, uint16_t key_range)
+{
+  for (uint32_t i = 0; i < count; i++) {
+    uint16_t key = rand() % key_range;
+    tree->insert(key);
+    keys->insert(key);
+  }
+}
+
+/**
+ * Verify that a tree is a valid AVL tree holding exactly the given keys.
+ */
+template<typename Tree>
+void expectKeys(Tree* tree, const std::set<uint16_t>& keys)
+{
+  uint32_t count = 0;
+  ASSERT_LT(-1, checkAvl(tree->root(), &count));
+  ASSERT_EQ(keys.size(), count);
+
+  auto eit = keys.begin();
+
+  for (auto it = tree->begin(); it != tree->end(); ++it, ++eit) {
+    ASSERT_EQ(*eit, it->key());
+  }
+}
+
+/** Test appending increasing keys mixed with other modifications. */
+TEST(AvlTreeSetTest, append)
+{
+  AvlTree<Server, uint16_t, int16_t> appended;
+  AvlTree<Server, uint16_t, int16_t> inserted;
+  std::set<uint16_t> expected;
+  srand(17);
+
+  for (uint16_t key = 1; key < 3000; key += 1 + rand() % 3) {
+    appended.append(key);
+    inserted.insert(key);
+    expected.insert(key);
+
+    // Any other change discards the cached spine.
+    if (rand() % 50 == 0) {
+      uint16_t other = rand() % key;
+      appended.erase(other);
+      inserted.erase(other);
+      expected.erase(other);
+    }
+    if (rand() % 50 == 0) {
+      appended.erase(key);
+      inserted.erase(key);
+      expected.erase(key);
+    }
+  }
+
+  expectKeys(&appended, expected);
+  expectKeys(&inserted, expected);
+
+  // Keys not greater than the maximum go through insert.
+  uint16_t max = *expected.rbegin();
+  appended.append(max);
+  appended.append(5);
+  expected.insert(5);
+  expectKeys(&appended, expected);
+
+  appended.eraseRange(max - 100, max);
+  appended.append(max + 1);
+  ASSERT_TRUE(nullptr != appended.search(max + 1));
+  ASSERT_TRUE(nullptr == appended.search(max));
+
+  appended.eraseBranch(appended.root());
+  appended.append(1);
+  appended.append(2);
+  ASSERT_EQ(uint16_t(1), appended.root()->key());
+  ASSERT_EQ(uint16_t(2), appended.root()->right()->key());
+}
+
+/** Test split and join functions. */
+TEST(AvlTreeSetTest, splitJoin)
+{
+  srand(21);
+
+  for (uint16_t key = 0; key < 520; key += 13) {
+    AvlTree<Server> tree;
+    AvlTree<Server> right;
+    std::set<uint16_t> keys;
+    randomFill(&tree, &keys, 300, 500);
+    right.insert(1);
+
+    tree.split(key, &right);
+    expectKeys(&tree, std::set<uint16_t>(keys.begin(), keys.lower_bound(key)));
+    expectKeys(&right, std::set<uint16_t>(keys.lower_bound(key), keys.end()));
+
+    ASSERT_EQ(0, tree.join(&right));
+    ASSERT_TRUE(nullptr == right.root());
+    expectKeys(&tree, keys);
+  }
+
+  // Join of lopsided trees.
+  AvlTree<Server> small;
+  AvlTree<Server> large;
+  uint16_t keys[] = { 1, 2 };
+  small.buildFromSorted(keys, keys + 2);
+  std::set<uint16_t> expected(keys, keys + 2);
+
+  for (uint16_t i = 10; i < 1000; i++) {
+    large.insert(i);
+    expected.insert(i);
+  }
+
+  ASSERT_EQ(0, small.join(&large));
+  expectKeys(&small, expected);
+
+  // Overlapping keys are rejected.
+  large.insert(5);
+  errno = 0;
+  ASSERT_EQ(-1, small.join(&large));
+  ASSERT_EQ(EINVAL, errno);
+  ASSERT_TRUE(nullptr != large.search(5));
+}
+
+/** Test union, intersection and difference against std::set. */
+TEST(AvlTreeSetTest, setOperations)
+{
+  srand(22);
+
+  // Sizes are chosen so that large trees take the parallel path.
+  uint32_t sizes[][2] = { { 0, 50 }, { 50, 0 }, { 10, 1000 }, { 1000, 10 }, { 30000, 20000 } };
+
+  for (auto size : sizes) {
+    AvlTree<Server> a1, b1, a2, b2, a3, b3;
+    std::set<uint16_t> a, b;
+    randomFill(&a1, &a, size[0], 60000);
+    randomFill(&b1, &b, size[1], 60000);
+
+    for (auto key : a) {
+      a2.insert(key);
+      a3.insert(key);
+    }
+    for (auto key : b) {
+      b2.insert(key);
+      b3.insert(key);
+    }
+
+    std::set<uint16_t> expected;
+    std::set_union(a.begin(), a.end(), b.begin(), b.end(),
+        std::inserter(expected, expected.end()));
+
+    Server* kept = (a.empty() ? nullptr : a1.search(*a.begin()));
+    a1.setUnion(&b1);
+    expectKeys(&a1, expected);
+    ASSERT_TRUE(nullptr == b1.root());
+
+    if (nullptr != kept) {
+      ASSERT_TRUE(kept == a1.search(kept->key()));
+    }
+
+    expected.clear();
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(),
+        std::inserter(expected, expected.end()));
+    a2.setIntersection(&b2);
+    expectKeys(&a2, expected);
+    ASSERT_TRUE(nullptr == b2.root());
+
+    expected.clear();
+    std::set_difference(a.begin(), a.end(), b.begin(), b.end(),
+        std::inserter(expected, expected.end()));
+    a3.setDifference(&b3);
+    expectKeys(&a3, expected);
+    ASSERT_TRUE(nullptr == b3.root());
+  }
+}
+
+/** Test eraseRange function. */
+TEST(AvlTreeSetTest, eraseRange)
+{
+  AvlTree<Server, uint16_t, int16_t, PoolNodeAllocator<Server>> tree;
+  std::set<uint16_t> keys;
+  srand(23);
+  randomFill(&tree, &keys, 2000, 5000);
+
+  tree.eraseRange(1000, 2000);
+  keys.erase(keys.lower_bound(1000), keys.upper_bound(2000));
+  expectKeys(&tree, keys);
+  ASSERT_EQ(keys.size(), tree.allocator().count());
+
+  tree.eraseRange(3000, 2999);
+  expectKeys(&tree, keys);
+
+  tree.eraseRange(0, 0xFFFF);
+  ASSERT_TRUE(nullptr == tree.root());
+  ASSERT_EQ(uint32_t(0), tree.allocator().count());
+}
+
+/** Test iteration and bounds against std::set on a larger tree. */
+TEST(AvlTreeIterTest, matchesSet)
+{
+  AvlTree<Server, uint16_t, int16_t, PoolNodeAllocator<Server>> tree;
+  std::set<uint16_t> expected;
+  srand(11);
+
+  for (int i = 0; i < 2000; i++) {
+    uint16_t key = rand() % 4000;
+    tree.insert(key);
+    expected.insert(key);
+  }
+
+  auto eit = expected.begin();
+
+  for (auto it = tree.begin(); it != tree.end(); ++it, ++eit) {
+    ASSERT_EQ(*eit, it->key());
+  }
+  ASSERT_TRUE(expected.end() == eit);
+
+  for (uint16_t key = 0; key < 4010; key += 7) {
+    auto lb = tree.lowerBound(key);
+    auto elb = expected.lower_bound(key);
+    ASSERT_EQ(expected.end() == elb, tree.end() == lb) << key;
+
+    if (expected.end() != elb) {
+      ASSERT_EQ(*elb, lb->key());
+    }
+
+    auto ub = tree.upperBound(key);
+    auto eub = expected.upper_bound(key);
+    ASSERT_EQ(expected.end() == eub, tree.end() == ub) << key;
+
+    if (expected.end() != eub) {
+      ASSERT_EQ(*eub, ub->key());
+    }
+  }
+
+  uint32_t count = 0;
+  tree.visit(tree.root(), [&count](Server*) {
+    ++count;
+    return 0;
+  }, 100, 2000);
+  ASSERT_EQ(uint32_t(std::distance(expected.lower_bound(100), expected.upper_bound(2000))), count);
+
+  tree.eraseBranch(tree.root());
+}
+
+/** Test node allocation from a fixed-capacity slab. */
+TEST(AvlTreeAllocTest, staticSlab)
+{
+  AvlTree<Server, uint16_t, int16_t, StaticNodeAllocator<Server, 64>> tree;
+  churn(&tree, 500, 64);
+
+  // Inserting into a full slab leaves the tree unchanged.
+  AvlTree<Server, uint16_t, int16_t, StaticNodeAllocator<Server, 2>> full;
+  full.insert(1);
+  full.insert(2);
+  full.insert(3);
+  ASSERT_EQ(uint32_t(2), full.allocator().count());
+  ASSERT_TRUE(nullptr == full.search(3));
+
+  uint32_t count = 0;
+  ASSERT_LT(0, checkAvl(full.root(), &count));
+  ASSERT_EQ(uint32_t(2), count);
+}
+
+/** Test node allocation from a growable slab pool. */
+TEST(AvlTreeAllocTest, pool)
+{
+  AvlTree<Server, uint16_t, int16_t, PoolNodeAllocator<Server, 32>> tree;
+  churn(&tree, 5000, 1000);
+  ASSERT_LT(uint32_t(0), tree.allocator().count());
+
+  tree.eraseBranch(tree.root());
+  ASSERT_EQ(uint32_t(0), tree.allocator().count());
+}
+
 } // namespace btr
@@ -0,0 +1,165 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+
+// PROJECT INCLUDES
+#include "utility/common/buff_cursor.hpp"
+#include "utility/common/test_helpers.hpp"
+
+namespace btr
+{
+
+//================================ TEST FIXTURES ===============================
+
+/** Message with fields of mixed width. */
+struct Message
+{
+  uint8_t id;
+  int16_t x;
+  int16_t y;
+  int16_t z;
+  uint32_t stamp;
+  uint64_t seq;
+};
+
+/** Encoded size of Message. */
+static const uint32_t MESSAGE_BYTES = 1 + 2 + 2 + 2 + 4 + 8;
+
+/** Compare Message fields. */
+static bool operator==(const Message& a, const Message& b)
+{
+  return a.id == b.id && a.x == b.x && a.y == b.y && a.z == b.z
+    && a.stamp == b.stamp && a.seq == b.seq;
+}
+
+template<bool MSB>
+static int encode(Buff* buff, const Message& m)
+{
+  BuffWriter<MSB> w(buff, MESSAGE_BYTES);
+  w.put(m.id);
+  w.put(m.x);
+  w.put(m.y);
+  w.put(m.z);
+  w.put(m.stamp);
+  w.put(m.seq);
+  return w.finish();
+}
+
+template<bool MSB>
+static int decode(Buff* buff, Message* m)
+{
+  BuffReader<MSB> r(buff, MESSAGE_BYTES);
+  r.get(&m->id);
+  r.get(&m->x);
+  r.get(&m->y);
+  r.get(&m->z);
+  r.get(&m->stamp);
+  r.get(&m->seq);
+  return r.finish();
+}
+
+//=================================== TESTS ====================================
+
+TEST(BuffCursorTest, roundTrip)
+{
+  Buff buff(4);
+  Message in = { 7, -2, 300, -30000, 0xDEADBEEF, 0x0102030405060708 };
+
+  // The writer grows the buffer once for the whole message.
+  ASSERT_EQ(0, encode<true>(&buff, in));
+  ASSERT_EQ(MESSAGE_BYTES, buff.available());
+  ASSERT_EQ(uint8_t(7), buff.read_ptr()[0]);
+  ASSERT_EQ(uint8_t(0xFF), buff.read_ptr()[1]);
+  ASSERT_EQ(uint8_t(0xFE), buff.read_ptr()[2]);
+
+  ASSERT_EQ(0, encode<false>(&buff, in));
+  ASSERT_EQ(MESSAGE_BYTES * 2, buff.available());
+
+  Message out = {};
+  ASSERT_EQ(0, decode<true>(&buff, &out));
+  ASSERT_TRUE(in == out);
+  ASSERT_EQ(MESSAGE_BYTES, buff.available());
+
+  out = Message();
+  ASSERT_EQ(0, decode<false>(&buff, &out));
+  ASSERT_TRUE(in == out);
+  ASSERT_EQ(uint32_t(0), buff.available());
+}
+
+TEST(BuffCursorTest, readerShort)
+{
+  Buff buff(32);
+  buff.write(ARRAY(1, 2, 3, 4));
+
+  Message out = {};
+  out.id = 9;
+  errno = 0;
+
+  BuffReader<true> r(&buff, MESSAGE_BYTES);
+  ASSERT_FALSE(r.ok());
+  r.get(&out.id);
+  r.get(&out.stamp);
+  ASSERT_EQ(uint32_t(0), r.consumed());
+  ASSERT_EQ(-1, r.finish());
+  ASSERT_EQ(ERANGE, errno);
+
+  // Fields read as zero and the buffer is intact.
+  ASSERT_EQ(uint8_t(0), out.id);
+  ASSERT_EQ(uint32_t(0), out.stamp);
+  ASSERT_EQ(uint32_t(4), buff.available());
+}
+
+TEST(BuffCursorTest, readerOverrun)
+{
+  Buff buff(32);
+  buff.write(ARRAY(1, 2, 3, 4));
+
+  BuffReader<true> r(&buff, 2);
+  uint32_t v = 0;
+  r.get(&v);
+  ASSERT_EQ(uint32_t(0x01020304), v);
+  ASSERT_EQ(-1, r.finish());
+  ASSERT_EQ(uint32_t(4), buff.available());
+}
+
+TEST(BuffCursorTest, writerNoSpace)
+{
+  Buff buff(8);
+  Message in = { 7, -2, 300, -30000, 0xDEADBEEF, 0x0102030405060708 };
+
+  BuffWriter<true> w(&buff, MESSAGE_BYTES, Buff::NO_MOD);
+  ASSERT_FALSE(w.ok());
+  w.put(in.seq);
+  w.put(ARRAY(1, 2, 3), 3);
+  ASSERT_EQ(uint32_t(0), w.written());
+  ASSERT_EQ(-1, w.finish());
+  ASSERT_EQ(ERANGE, errno);
+  ASSERT_EQ(uint32_t(0), buff.available());
+  ASSERT_EQ(uint32_t(8), buff.capacity());
+}
+
+TEST(BuffCursorTest, rawBytes)
+{
+  Buff buff(8);
+  const uint8_t payload[] = { 0xA, 0xB, 0xC };
+
+  BuffWriter<false> w(&buff, 5);
+  w.put(uint16_t(0x0102));
+  w.put(payload, sizeof(payload));
+  ASSERT_EQ(0, w.finish());
+  ASSERT_EQ(uint8_t(0x02), buff.read_ptr()[0]);
+
+  uint8_t out[3] = { 0 };
+  BuffReader<false> r(&buff, 5);
+  r.skip(2);
+  r.get(out, sizeof(out));
+  ASSERT_EQ(0, r.finish());
+  ASSERT_EQ(0, memcmp(payload, out, sizeof(out)));
+}
+
+} // namespace btr
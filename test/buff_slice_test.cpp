@@ -0,0 +1,98 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+
+// PROJECT INCLUDES
+#include "utility/common/buff_slice.hpp"
+#include "utility/common/test_helpers.hpp"
+
+namespace btr
+{
+
+//================================ TEST FIXTURES ===============================
+
+/**
+ * Create a slice over a received frame.
+ */
+static BuffSlice makeFrame()
+{
+  Buff* buff = new Buff(16);
+  buff->write(ARRAY(0xA, 0x1, 0x2, 0x3, 0x4, 0x5));
+  buff->advanceReadPtr(1);
+  return BuffSlice(buff);
+}
+
+//=================================== TESTS ====================================
+
+TEST(BuffSliceTest, empty)
+{
+  BuffSlice s;
+  ASSERT_TRUE(nullptr == s.data());
+  ASSERT_TRUE(nullptr == s.mutableData());
+  ASSERT_EQ(uint32_t(0), s.size());
+}
+
+TEST(BuffSliceTest, fanOut)
+{
+  BuffSlice frame = makeFrame();
+  ASSERT_EQ(uint32_t(5), frame.size());
+  ASSERT_EQ(uint8_t(0x1), frame.data()[0]);
+  ASSERT_EQ(1, frame.refs());
+
+  BuffSlice logger(frame);
+  BuffSlice controller = frame;
+  BuffSlice host = frame.slice(1, 3);
+
+  ASSERT_EQ(4, frame.refs());
+  ASSERT_EQ(frame.data(), logger.data());
+  ASSERT_EQ(frame.data(), controller.data());
+  ASSERT_EQ(frame.data() + 1, host.data());
+  ASSERT_EQ(uint32_t(3), host.size());
+  ASSERT_EQ(uint8_t(0x2), host.data()[0]);
+}
+
+TEST(BuffSliceTest, sliceClipped)
+{
+  BuffSlice frame = makeFrame();
+
+  BuffSlice tail = frame.slice(3, 100);
+  ASSERT_EQ(uint32_t(2), tail.size());
+  ASSERT_EQ(uint8_t(0x4), tail.data()[0]);
+
+  BuffSlice none = frame.slice(9, 1);
+  ASSERT_EQ(uint32_t(0), none.size());
+
+  BuffSlice nested = frame.slice(1, 4).slice(1, 2);
+  ASSERT_EQ(uint32_t(2), nested.size());
+  ASSERT_EQ(uint8_t(0x3), nested.data()[0]);
+}
+
+TEST(BuffSliceTest, copyOnWrite)
+{
+  BuffSlice frame = makeFrame();
+  BuffSlice controller = frame.slice(2, 2);
+  const uint8_t* shared = frame.data();
+
+  // The backing buffer is shared, so mutation copies the controller's range only.
+  uint8_t* bytes = controller.mutableData();
+  ASSERT_TRUE(nullptr != bytes);
+  ASSERT_TRUE(shared + 2 != bytes);
+  bytes[0] = 0xFF;
+
+  ASSERT_EQ(1, frame.refs());
+  ASSERT_EQ(1, controller.refs());
+  ASSERT_EQ(uint8_t(0x3), frame.data()[2]);
+  ASSERT_EQ(uint8_t(0xFF), controller.data()[0]);
+  ASSERT_EQ(uint8_t(0x4), controller.data()[1]);
+
+  // Sole owner mutates in place.
+  bytes = frame.mutableData();
+  ASSERT_EQ(shared, bytes);
+}
+
+} // namespace btr
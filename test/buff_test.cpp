@@ -324,4 +324,46 @@ TEST_F(BuffTest, shiftOnWrite)
   ASSERT_TRUE(data == buff_.data());
 }
 
+/** Test that aligned storage stays aligned and intact across reserve. */
+TEST(BuffAllocTest, alignedReserve)
+{
+  Buff buff(10, Buff::CACHE_LINE);
+  ASSERT_EQ(uintptr_t(0), reinterpret_cast<uintptr_t>(buff.data()) % 64);
+  ASSERT_EQ(uint16_t(64), buff.alignment());
+  ASSERT_TRUE(buff.write(ARRAY(1, 2, 3, 4, 5, 6, 7, 8, 9, 10)));
+  buff.advanceReadPtr(2);
+
+  for (uint32_t capacity = 11; capacity < 100000; capacity *= 3) {
+    ASSERT_TRUE(buff.reserve(capacity));
+    ASSERT_EQ(uintptr_t(0), reinterpret_cast<uintptr_t>(buff.data()) % 64) << capacity;
+    ASSERT_EQ(uint32_t(8), buff.available());
+    ASSERT_EQ(uint8_t(3), *buff.read_ptr());
+    ASSERT_EQ(uint8_t(10), buff.data()[9]);
+  }
+
+  ASSERT_TRUE(buff.reserve(10));
+  ASSERT_EQ(uintptr_t(0), reinterpret_cast<uintptr_t>(buff.data()) % 64);
+  ASSERT_EQ(uint8_t(10), buff.data()[9]);
+}
+
+/** Test huge-page-backed storage. Without reserved huge pages, the buffer falls back to THP. */
+TEST(BuffAllocTest, hugePages)
+{
+  Buff buff(4096, 0, Buff::ALLOC_HUGETLB);
+  ASSERT_TRUE(nullptr != buff.data());
+  ASSERT_TRUE(Buff::ALLOC_HUGETLB == buff.alloc() || Buff::ALLOC_THP == buff.alloc());
+  ASSERT_EQ(uintptr_t(0), reinterpret_cast<uintptr_t>(buff.data()) % 4096);
+
+  buff.write(ARRAY(1, 2, 3));
+  ASSERT_TRUE(buff.reserve(8 * 1024 * 1024));
+  ASSERT_EQ(uint32_t(3), buff.available());
+  ASSERT_EQ(uint8_t(3), buff.data()[2]);
+  ASSERT_EQ(uintptr_t(0), reinterpret_cast<uintptr_t>(buff.data()) % 4096);
+
+  Buff thp(3 * 1024 * 1024, 0, Buff::ALLOC_THP);
+  ASSERT_EQ(uint8_t(Buff::ALLOC_THP), thp.alloc());
+  memset(thp.data(), 0xA, thp.capacity());
+  ASSERT_EQ(uint8_t(0xA), thp.data()[thp.capacity() - 1]);
+}
+
 } // namespace btr
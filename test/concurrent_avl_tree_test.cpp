@@ -0,0 +1,281 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// PROJECT INCLUDES
+#include "utility/common/test_helpers.hpp"
+#include "utility/x86/concurrent_avl_tree.hpp"
+
+namespace btr
+{
+
+//================================ TEST FIXTURES ===============================
+
+/** Node whose two values must always match. */
+class Record : public NodeBase<Record, uint32_t, int16_t>
+{
+public:
+
+  Record(uint32_t key) :
+    NodeBase(key),
+    a_(0),
+    b_(0),
+    c_(0),
+    d_(~uint64_t(0))
+  {}
+
+  uint64_t a_;
+  uint64_t b_;
+  uint64_t c_;
+  uint64_t d_;
+};
+
+typedef ConcurrentAvlTree<Record, uint32_t, int16_t> RecordTree;
+
+/**
+ * Insert a record with matching values.
+ */
+static int insertRecord(RecordTree* tree, uint32_t key, uint64_t value)
+{
+  return tree->insert(key, [value](Record* r) {
+    r->a_ = value;
+    r->b_ = ~value;
+  });
+}
+
+//=================================== TESTS ====================================
+
+TEST(ConcurrentAvlTreeTest, singleThread)
+{
+  RecordTree tree;
+  RecordTree::Reader reader(&tree);
+  ASSERT_TRUE(reader.ok());
+
+  ASSERT_EQ(0, insertRecord(&tree, 5, 50));
+  ASSERT_EQ(0, insertRecord(&tree, 9, 90));
+  errno = 0;
+  ASSERT_EQ(-1, insertRecord(&tree, 5, 51));
+  ASSERT_EQ(EEXIST, errno);
+
+  uint64_t value = 0;
+  auto copy = [&value](Record* r) { value = r->a_; };
+
+  ASSERT_TRUE(reader.search(5, copy));
+  ASSERT_EQ(50u, value);
+  ASSERT_FALSE(reader.search(6, copy));
+  ASSERT_TRUE(reader.lowerBound(6, copy));
+  ASSERT_EQ(90u, value);
+  ASSERT_FALSE(reader.lowerBound(10, copy));
+
+  // Without readers, erased nodes are destroyed at the end of the write.
+  tree.erase(5);
+  ASSERT_FALSE(reader.search(5, copy));
+  ASSERT_EQ(0u, tree.retired());
+
+  tree.write([](RecordTree::Tree& t) {
+    uint32_t keys[] = { 1, 2, 3 };
+    t.insertBatch(keys, 3);
+  });
+  ASSERT_TRUE(reader.search(2, copy));
+}
+
+TEST(ConcurrentAvlTreeTest, slots)
+{
+  typedef ConcurrentAvlTree<Record, uint32_t, int16_t, HeapNodeAllocator<Record>, 2> SmallTree;
+  SmallTree tree;
+  tree.insert(1, [](Record*) {});
+
+  SmallTree::Reader r1(&tree);
+  uint64_t value = 0;
+  auto copy = [&value](Record* r) { value = r->a_; };
+
+  {
+    SmallTree::Reader r2(&tree);
+    SmallTree::Reader r3(&tree);
+    ASSERT_TRUE(r1.ok());
+    ASSERT_TRUE(r2.ok());
+    ASSERT_FALSE(r3.ok());
+
+    // A reader without a slot still reads without the writer lock.
+    ASSERT_TRUE(r3.search(1, copy));
+
+    // The writer isn't blocked by it, but keeps the nodes it may hold. The search sees the
+    // update and retries without the erased key.
+    uint32_t calls = 0;
+    uint32_t retired = 0;
+
+    ASSERT_FALSE(r3.search(1, [&](Record* r) {
+      if (0 == calls++) {
+        std::thread writer([&tree]() { tree.erase(1); });
+        writer.join();
+        retired = tree.retired();
+      }
+      value = r->a_;
+    }));
+    ASSERT_EQ(1u, calls);
+    ASSERT_EQ(1u, retired);
+  }
+
+  // Once the reader left, the next update reclaims the node.
+  tree.insert(2, [](Record*) {});
+  ASSERT_EQ(0u, tree.retired());
+
+  SmallTree::Reader r4(&tree);
+  ASSERT_TRUE(r4.ok());
+}
+
+/** Readers must never miss stable keys or see torn records while a writer churns the tree. */
+TEST(ConcurrentAvlTreeTest, readersAndWriter)
+{
+  RecordTree tree;
+  const uint32_t stable = 2000;
+
+  for (uint32_t key = 0; key < stable * 2; key += 2) {
+    insertRecord(&tree, key, key);
+  }
+
+  std::atomic<bool> stop(false);
+  std::atomic<uint32_t> failures(0);
+  std::atomic<uint64_t> reads(0);
+  std::vector<std::thread> readers;
+
+  for (int t = 0; t < 4; t++) {
+    readers.emplace_back([&, t]() {
+      RecordTree::Reader reader(&tree);
+      uint32_t key = t;
+      uint64_t count = 0;
+
+      while (!stop.load(std::memory_order_relaxed)) {
+        // Every other search hits the record the writer updates in place.
+        key = (count % 2 ? (key * 1103515245 + 12345) % (stable * 2) : 0);
+        uint64_t a = 0;
+        uint64_t b = 0;
+        uint64_t c = 0;
+        uint64_t d = 0;
+        bool found = reader.search(key, [&](Record* r) {
+          a = r->a_;
+          b = r->b_;
+          c = r->c_;
+          d = r->d_;
+        });
+
+        // Even keys are always present with value == key. Odd keys come and go.
+        if ((key % 2 == 0 && (!found || a != key)) || (found && (a != ~b || c != ~d))) {
+          failures.fetch_add(1);
+        }
+        ++count;
+      }
+      reads.fetch_add(count);
+    });
+  }
+
+  auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+  uint32_t writes = 0;
+
+  for (uint32_t i = 0; std::chrono::steady_clock::now() < end; i++) {
+    uint32_t key = (i * 7919) % (stable * 2) | 1;
+
+    if (i % 2) {
+      insertRecord(&tree, key, i);
+    } else {
+      tree.erase(key);
+    }
+
+    // Update a stable record in place. Readers must never see one value updated and the
+    // other not.
+    tree.write([i](RecordTree::Tree& t) {
+      Record* r = t.search(0);
+      r->c_ = i;
+      // Give readers a chance to run mid-update, also on a single core.
+      if (i % 16 == 0) {
+        std::this_thread::yield();
+      }
+      r->d_ = ~uint64_t(i);
+    });
+    ++writes;
+  }
+
+  stop = true;
+
+  for (auto& thread : readers) {
+    thread.join();
+  }
+
+  TEST_MSG << reads.load() << " reads, " << writes << " writes, "
+    << tree.retired() << " retired nodes pending";
+  ASSERT_EQ(0u, failures.load());
+}
+
+/** Read throughput with 1..8 reader threads, without and with a concurrent writer. */
+TEST(ConcurrentAvlTreeTest, DISABLED_readScaling)
+{
+  RecordTree tree;
+  const uint32_t count = 1000000;
+
+  tree.write([count](RecordTree::Tree& t) {
+    std::vector<uint32_t> keys(count);
+
+    for (uint32_t i = 0; i < count; i++) {
+      keys[i] = i;
+    }
+    t.buildFromSorted(keys.begin(), keys.end());
+  });
+
+  for (int writer = 0; writer < 2; writer++) {
+    for (int threads = 1; threads <= 8; threads *= 2) {
+      std::atomic<bool> stop(false);
+      std::atomic<uint64_t> reads(0);
+      std::vector<std::thread> readers;
+
+      for (int t = 0; t < threads; t++) {
+        readers.emplace_back([&, t]() {
+          RecordTree::Reader reader(&tree);
+          uint32_t key = t;
+          uint64_t n = 0;
+          uint64_t sink = 0;
+
+          while (!stop.load(std::memory_order_relaxed)) {
+            key = (key * 1103515245 + 12345) % count;
+            reader.search(key, [&sink](Record* r) { sink += r->a_; });
+            ++n;
+          }
+          reads.fetch_add(n + (sink & 0));
+        });
+      }
+
+      auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+
+      for (uint32_t i = 0; std::chrono::steady_clock::now() < end; i++) {
+        if (writer) {
+          tree.erase(count + (i % 100));
+          insertRecord(&tree, count + (i % 100), i);
+        } else {
+          std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+      }
+
+      stop = true;
+
+      for (auto& thread : readers) {
+        thread.join();
+      }
+
+      TEST_MSG << threads << " readers" << (writer ? " + writer: " : ": ")
+        << reads.load() * 2 / 1000 << " Kreads/s";
+    }
+  }
+}
+
+} // namespace btr
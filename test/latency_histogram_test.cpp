@@ -0,0 +1,265 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+#include <random>
+
+// PROJECT INCLUDES
+#include "utility/common/latency_histogram.hpp"
+
+//================================ TEST FIXTURES ===============================
+
+namespace btr
+{
+
+/**
+ * Check that percentiles are not below the exact values and exceed them by 2^-P at most.
+ *
+ * @param sorted - all recorded values, sorted
+ */
+template<typename H, typename T>
+void checkPercentiles(const H& hist, const std::vector<T>& sorted, uint8_t precision)
+{
+  ASSERT_EQ(sorted.size(), hist.count());
+  ASSERT_EQ(sorted.front(), hist.min());
+  ASSERT_EQ(sorted.back(), hist.max());
+
+  for (float q : { 0.01f, 0.1f, 0.5f, 0.9f, 0.99f, 0.999f }) {
+    double rank = double(q) * sorted.size();
+    T exact = sorted[rank > 1 ? uint64_t(std::ceil(rank)) - 1 : 0];
+    T val = hist.percentile(q);
+    ASSERT_LE(exact, val) << "q: " << q;
+    ASSERT_LE(val - exact, exact >> precision) << "q: " << q;
+  }
+}
+
+//=================================== TESTS ====================================
+
+TEST(LatencyHistogramTest, exact)
+{
+  LatencyHistogram<uint32_t, 4> hist;
+  ASSERT_EQ(0u, hist.percentile(0.5f));
+  ASSERT_EQ(0, hist.mean());
+
+  // Values below 2^P have a bucket each.
+  for (uint32_t i = 1; i <= 10; i++) {
+    hist.record(i);
+  }
+
+  ASSERT_EQ(10u, hist.count());
+  ASSERT_EQ(1u, hist.min());
+  ASSERT_EQ(10u, hist.max());
+  ASSERT_EQ(5.5f, hist.mean());
+  ASSERT_EQ(5u, hist.percentile(0.5f));
+  ASSERT_EQ(9u, hist.percentile(0.9f));
+  ASSERT_EQ(10u, hist.percentile(0.95f));
+  ASSERT_EQ(1u, hist.percentile(0));
+  ASSERT_EQ(10u, hist.percentile(1));
+
+  hist.record(3, 4);
+  ASSERT_EQ(14u, hist.count());
+  ASSERT_EQ(5u, hist.countAt(3));
+  hist.record(3, 0);
+  ASSERT_EQ(14u, hist.count());
+
+  hist.reset();
+  ASSERT_EQ(0u, hist.count());
+  ASSERT_EQ(0u, hist.countAt(3));
+}
+
+TEST(LatencyHistogramTest, buckets)
+{
+  LatencyHistogram<uint32_t, 3> hist;
+
+  // With 8 buckets per power of two, [1024, 1152) is one bucket and 1152 starts the next.
+  hist.record(1024);
+  hist.record(1151);
+  ASSERT_EQ(2u, hist.countAt(1100));
+  ASSERT_EQ(0u, hist.countAt(1152));
+  ASSERT_EQ(0u, hist.countAt(1023));
+
+  // The largest values fit the last bucket.
+  hist.record(0xFFFFFFFF);
+  ASSERT_EQ(1u, hist.countAt(0xF0000000));
+  ASSERT_EQ(0xFFFFFFFF, hist.percentile(1));
+
+  // The reported value is the highest one of the bucket, bounded by the maximum.
+  ASSERT_EQ(1151u, hist.percentile(0.5f));
+}
+
+TEST(LatencyHistogramTest, precision)
+{
+  const uint8_t precision = 5;
+  LatencyHistogram<uint32_t, precision> hist;
+  std::vector<uint32_t> vals;
+  std::mt19937 gen(1);
+  std::lognormal_distribution<double> latency(8, 2);
+
+  for (uint32_t i = 0; i < 200000; i++) {
+    uint32_t val = uint32_t(std::min(latency(gen), 4e9));
+    hist.record(val);
+    vals.push_back(val);
+  }
+
+  std::sort(vals.begin(), vals.end());
+  checkPercentiles(hist, vals, precision);
+
+  double sum = 0;
+
+  for (uint32_t val : vals) {
+    sum += val;
+  }
+  ASSERT_NEAR(sum / vals.size(), hist.mean(), sum / vals.size() * 1e-6);
+}
+
+TEST(LatencyHistogramTest, types)
+{
+  // A small histogram for AVR.
+  const uint8_t small_precision = 2;
+  LatencyHistogram<uint16_t, small_precision> small;
+  std::vector<uint16_t> small_vals;
+
+  // CPU ticks.
+  const uint8_t large_precision = 7;
+  LatencyHistogram<uint64_t, large_precision> large;
+  std::vector<uint64_t> large_vals;
+  std::mt19937_64 gen(2);
+
+  for (uint32_t i = 0; i < 10000; i++) {
+    uint16_t small_val = uint16_t(gen() >> (gen() % 64));
+    small.record(small_val);
+    small_vals.push_back(small_val);
+
+    uint64_t large_val = gen() >> (gen() % 64);
+    large.record(large_val);
+    large_vals.push_back(large_val);
+  }
+
+  std::sort(small_vals.begin(), small_vals.end());
+  std::sort(large_vals.begin(), large_vals.end());
+  checkPercentiles(small, small_vals, small_precision);
+  checkPercentiles(large, large_vals, large_precision);
+
+  uint32_t buckets = LatencyHistogram<uint16_t, 2>::BUCKETS;
+  ASSERT_EQ(60u, buckets);
+}
+
+TEST(LatencyHistogramTest, mergeThreads)
+{
+  const uint32_t threads = 4;
+  const uint8_t precision = 4;
+  std::vector<LatencyHistogram<uint32_t, precision>> hists(threads);
+  std::vector<std::vector<uint32_t>> vals(threads);
+  std::vector<std::thread> workers;
+
+  for (uint32_t t = 0; t < threads; t++) {
+    workers.emplace_back([&hists, &vals, t] {
+      std::mt19937 gen(t);
+
+      for (uint32_t i = 0; i < 50000; i++) {
+        // Each thread sees a different latency range.
+        uint32_t val = (gen() % 10000 + 1) * (t + 1);
+        hists[t].record(val);
+        vals[t].push_back(val);
+      }
+    });
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+
+  LatencyHistogram<uint32_t, precision> total;
+  std::vector<uint32_t> all;
+
+  for (uint32_t t = 0; t < threads; t++) {
+    total.merge(hists[t]);
+    all.insert(all.end(), vals[t].begin(), vals[t].end());
+  }
+
+  // Merging itself or an empty histogram changes nothing.
+  total.merge(total);
+  total.merge(LatencyHistogram<uint32_t, precision>());
+
+  std::sort(all.begin(), all.end());
+  checkPercentiles(total, all, precision);
+}
+
+TEST(LatencyHistogramTest, serialize)
+{
+  LatencyHistogram<uint32_t, 4> hist;
+  LatencyHistogram<uint32_t, 4> copy;
+  std::mt19937 gen(3);
+
+  for (uint32_t i = 0; i < 10000; i++) {
+    hist.record(gen() % 5000 + 100);
+  }
+
+  Buff buff(16);
+  ASSERT_EQ(0, hist.serialize(&buff));
+  ASSERT_EQ(hist.serializedSize(), buff.available());
+
+  // Only the used buckets are written.
+  uint32_t buckets = LatencyHistogram<uint32_t, 4>::BUCKETS;
+  ASSERT_GT(buckets * sizeof(uint32_t), buff.available());
+
+  // Values are LSB regardless of the host.
+  ASSERT_EQ(4, buff.read_ptr()[0]);
+  ASSERT_EQ(4, buff.read_ptr()[1]);
+  ASSERT_EQ(10000 & 0xFF, buff.read_ptr()[4]);
+
+  ASSERT_EQ(0, copy.deserialize(&buff));
+  ASSERT_EQ(0u, buff.available());
+  ASSERT_EQ(hist.count(), copy.count());
+  ASSERT_EQ(hist.min(), copy.min());
+  ASSERT_EQ(hist.max(), copy.max());
+  ASSERT_EQ(hist.mean(), copy.mean());
+
+  for (float q = 0; q <= 1; q += 0.05f) {
+    ASSERT_EQ(hist.percentile(q), copy.percentile(q)) << q;
+  }
+
+  // An empty histogram.
+  buff.reset();
+  LatencyHistogram<uint32_t, 4> empty;
+  ASSERT_EQ(0, empty.serialize(&buff));
+  ASSERT_EQ(0, copy.deserialize(&buff));
+  ASSERT_EQ(0u, copy.count());
+
+  // Short data.
+  buff.reset();
+  hist.serialize(&buff);
+  buff.write_ptr() -= 1;
+  ASSERT_EQ(-1, copy.deserialize(&buff));
+  ASSERT_EQ(ERANGE, errno);
+  ASSERT_EQ(0u, copy.count());
+
+  // Counts that don't add up.
+  buff.reset();
+  hist.serialize(&buff);
+  buff.read_ptr()[4] += 1;
+  ASSERT_EQ(-1, copy.deserialize(&buff));
+  ASSERT_EQ(EINVAL, errno);
+  ASSERT_EQ(0u, copy.count());
+
+  // Different parameters.
+  buff.reset();
+  hist.serialize(&buff);
+  LatencyHistogram<uint32_t, 5> other;
+  ASSERT_EQ(-1, other.deserialize(&buff));
+  ASSERT_EQ(EINVAL, errno);
+
+  // No room.
+  Buff small(4);
+  ASSERT_EQ(-1, hist.serialize(&small, Buff::NO_MOD));
+  ASSERT_EQ(ENOMEM, errno);
+}
+
+} // namespace btr
@@ -0,0 +1,167 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <vector>
+
+// PROJECT INCLUDES
+#include "utility/common/multi_value_tracker.hpp"
+#include "utility/common/test_helpers.hpp"
+
+//================================ TEST FIXTURES ===============================
+
+namespace btr
+{
+
+/**
+ * Push random rows to a tracker and compare every statistic with a window kept per channel.
+ */
+template<typename T, uint16_t C, uint32_t W, typename A>
+void checkTracker(MultiValueTracker<T, C, W, A>* tracker, int range)
+{
+  std::vector<std::deque<T>> windows(C, std::deque<T>(W, T(0)));
+  T row[C];
+  T out[C];
+
+  for (uint32_t i = 0; i < 3 * W + 7; i++) {
+    for (uint16_t c = 0; c < C; c++) {
+      row[c] = T(rand() % (2 * range) - range);
+      windows[c].push_back(row[c]);
+      windows[c].pop_front();
+    }
+    tracker->push(row);
+
+    tracker->last(out);
+    for (uint16_t c = 0; c < C; c++) {
+      ASSERT_EQ(windows[c].back(), out[c]);
+      ASSERT_EQ(windows[c].back(), tracker->last(c));
+      ASSERT_EQ(windows[c][1], tracker->value(c, 1));
+    }
+
+    tracker->delta(out);
+    for (uint16_t c = 0; c < C; c++) {
+      ASSERT_EQ(T(windows[c][W - 1] - windows[c][W - 2]), out[c]);
+    }
+
+    tracker->min(out);
+    for (uint16_t c = 0; c < C; c++) {
+      ASSERT_EQ(*std::min_element(windows[c].begin(), windows[c].end()), out[c]) << c;
+    }
+
+    tracker->max(out);
+    for (uint16_t c = 0; c < C; c++) {
+      ASSERT_EQ(*std::max_element(windows[c].begin(), windows[c].end()), out[c]) << c;
+    }
+
+    tracker->mean(out);
+    for (uint16_t c = 0; c < C; c++) {
+      A sum = 0;
+
+      for (T val : windows[c]) {
+        sum += A(val);
+      }
+      ASSERT_EQ(T(sum / A(W)), out[c]) << c;
+    }
+  }
+}
+
+//=================================== TESTS ====================================
+
+TEST(MultiValueTrackerTest, channels)
+{
+  srand(1);
+
+  // Whole AVX2 vectors, a partial one, and fewer channels than a vector.
+  MultiValueTracker<int16_t, 32, 8> tracker32;
+  checkTracker(&tracker32, 30000);
+
+  MultiValueTracker<int16_t, 37, 5> tracker37;
+  checkTracker(&tracker37, 30000);
+
+  MultiValueTracker<int16_t, 3, 6> tracker3;
+  checkTracker(&tracker3, 100);
+
+  // Sums of int16_t values exceed int16_t.
+  MultiValueTracker<int16_t, 16, 200> wide;
+  checkTracker(&wide, 32000);
+
+  MultiValueTracker<float, 10, 7, float> floats;
+  checkTracker(&floats, 1000);
+
+  tracker3.reset(4);
+  int16_t out[3];
+  tracker3.mean(out);
+  ASSERT_EQ(4, out[2]);
+  ASSERT_EQ(4, tracker3.value(1, 0));
+  ASSERT_EQ(6u, tracker3.count());
+}
+
+TEST(MultiValueTrackerTest, kernels)
+{
+  // The int16_t kernels agree with the scalar ones, whichever they use.
+  const uint32_t rows = 50;
+  const uint32_t channels = 45;
+  std::vector<int16_t> vals(rows * channels);
+  srand(2);
+
+  for (int16_t& val : vals) {
+    val = int16_t(rand() % 65536 - 32768);
+  }
+
+  int32_t sums[channels];
+  int32_t scalar_sums[channels];
+  MultiValueKernels::sum(vals.data(), rows, channels, sums);
+  MultiValueKernels::sum<int16_t, int32_t>(vals.data(), rows, channels, scalar_sums);
+  ASSERT_EQ(0, memcmp(sums, scalar_sums, sizeof(sums)));
+
+  int16_t out[channels];
+  int16_t scalar_out[channels];
+  MultiValueKernels::min(vals.data(), rows, channels, out);
+  MultiValueKernels::min<int16_t>(vals.data(), rows, channels, scalar_out);
+  ASSERT_EQ(0, memcmp(out, scalar_out, sizeof(out)));
+
+  MultiValueKernels::max(vals.data(), rows, channels, out);
+  MultiValueKernels::max<int16_t>(vals.data(), rows, channels, scalar_out);
+  ASSERT_EQ(0, memcmp(out, scalar_out, sizeof(out)));
+}
+
+TEST(MultiValueTrackerTest, DISABLED_perf)
+{
+  const uint32_t iterations = 200000;
+  MultiValueTracker<int16_t, 32, 64> tracker;
+  int16_t row[32];
+  int16_t out[32];
+  int64_t check = 0;
+
+  for (int16_t& val : row) {
+    val = int16_t(rand() % 1000);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (uint32_t i = 0; i < iterations; i++) {
+    row[i % 32] = int16_t(i);
+    tracker.push(row);
+    tracker.mean(out);
+    check += out[0];
+    tracker.min(out);
+    check += out[1];
+    tracker.max(out);
+    check += out[2];
+  }
+
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - start).count();
+  TEST_MSG << "push, mean, min and max of 32 channels: " << ns / iterations << " ns, check "
+    << check;
+}
+
+} // namespace btr
@@ -0,0 +1,103 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+
+// PROJECT INCLUDES
+#include "utility/common/node_allocator.hpp"
+
+namespace btr
+{
+
+//================================ TEST FIXTURES ===============================
+
+/** Node type counting live instances. */
+struct CountedNode
+{
+  CountedNode(uint16_t key) : key_(key), next_(nullptr) { ++alive_; }
+  ~CountedNode() { --alive_; }
+
+  uint16_t key_;
+  CountedNode* next_;
+
+  static int alive_;
+};
+
+int CountedNode::alive_ = 0;
+
+//=================================== TESTS ====================================
+
+TEST(NodeAllocatorTest, heap)
+{
+  HeapNodeAllocator<CountedNode> alloc;
+  CountedNode* n = alloc.create(uint16_t(5));
+  ASSERT_EQ(5, n->key_);
+  ASSERT_EQ(1, CountedNode::alive_);
+  alloc.destroy(n);
+  ASSERT_EQ(0, CountedNode::alive_);
+}
+
+TEST(NodeAllocatorTest, staticSlab)
+{
+  StaticNodeAllocator<CountedNode, 3> alloc;
+  ASSERT_EQ(uint32_t(3), alloc.capacity());
+
+  CountedNode* n1 = alloc.create(uint16_t(1));
+  CountedNode* n2 = alloc.create(uint16_t(2));
+  CountedNode* n3 = alloc.create(uint16_t(3));
+  ASSERT_TRUE(nullptr != n1 && nullptr != n2 && nullptr != n3);
+  ASSERT_EQ(uint32_t(3), alloc.count());
+  ASSERT_EQ(3, CountedNode::alive_);
+
+  // Exhausted.
+  ASSERT_TRUE(nullptr == alloc.create(uint16_t(4)));
+
+  // Freed slot is reused.
+  alloc.destroy(n2);
+  ASSERT_EQ(2, CountedNode::alive_);
+  CountedNode* n4 = alloc.create(uint16_t(4));
+  ASSERT_EQ(n2, n4);
+  ASSERT_EQ(4, n4->key_);
+
+  alloc.destroy(n1);
+  alloc.destroy(n3);
+  alloc.destroy(n4);
+  ASSERT_EQ(uint32_t(0), alloc.count());
+  ASSERT_EQ(0, CountedNode::alive_);
+}
+
+TEST(NodeAllocatorTest, pool)
+{
+  PoolNodeAllocator<CountedNode, 4> alloc;
+  ASSERT_EQ(uint32_t(0), alloc.capacity());
+
+  CountedNode* nodes[10];
+
+  for (uint16_t i = 0; i < 10; i++) {
+    nodes[i] = alloc.create(i);
+    ASSERT_EQ(i, nodes[i]->key_);
+  }
+  ASSERT_EQ(uint32_t(12), alloc.capacity());
+  ASSERT_EQ(uint32_t(10), alloc.count());
+
+  // Nodes within a slab are contiguous.
+  ASSERT_EQ(nodes[0] + 1, nodes[1]);
+
+  alloc.destroy(nodes[7]);
+  alloc.destroy(nodes[3]);
+  ASSERT_EQ(nodes[3], alloc.create(uint16_t(30)));
+  ASSERT_EQ(nodes[7], alloc.create(uint16_t(70)));
+  ASSERT_EQ(uint32_t(12), alloc.capacity());
+
+  for (uint16_t i = 0; i < 10; i++) {
+    alloc.destroy(nodes[i]);
+  }
+  ASSERT_EQ(uint32_t(0), alloc.count());
+  ASSERT_EQ(0, CountedNode::alive_);
+}
+
+} // namespace btr
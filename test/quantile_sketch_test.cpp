@@ -0,0 +1,234 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <random>
+
+// PROJECT INCLUDES
+#include "utility/common/quantile_sketch.hpp"
+#include "utility/common/test_helpers.hpp"
+
+//================================ TEST FIXTURES ===============================
+
+namespace btr
+{
+
+typedef QuantileSketch<float, 200> Sketch;
+
+/**
+ * Check that the estimated quantiles of a sketch are within the given rank error.
+ *
+ * @param sorted - all pushed values, sorted
+ */
+template<typename S, typename T>
+void checkQuantiles(const S& sketch, const std::vector<T>& sorted, double max_error)
+{
+  ASSERT_EQ(sorted.size(), sketch.count());
+  ASSERT_EQ(sorted.front(), sketch.min());
+  ASSERT_EQ(sorted.back(), sketch.max());
+
+  for (float q : { 0.01f, 0.1f, 0.25f, 0.5f, 0.75f, 0.9f, 0.95f, 0.99f }) {
+    T val = sketch.quantile(q);
+    double lo = std::lower_bound(sorted.begin(), sorted.end(), val) - sorted.begin();
+    double hi = std::upper_bound(sorted.begin(), sorted.end(), val) - sorted.begin();
+    double target = q * sorted.size();
+    double error = (target < lo ? lo - target : (target > hi ? target - hi : 0)) / sorted.size();
+    ASSERT_LE(error, max_error) << "q: " << q << " value: " << val;
+  }
+
+  // Estimated ranks carry the same error.
+  T median = sorted[sorted.size() / 2];
+  double rank = double(sketch.rank(median)) / sorted.size();
+  ASSERT_NEAR(0.5, rank, max_error);
+}
+
+//=================================== TESTS ====================================
+
+TEST(QuantileSketchTest, exact)
+{
+  QuantileSketch<int32_t, 16> sketch;
+  ASSERT_EQ(0, sketch.quantile(0.5f));
+  ASSERT_EQ(0u, sketch.count());
+
+  for (int32_t i = 10; i >= 1; i--) {
+    sketch.push(i * 10);
+  }
+
+  ASSERT_EQ(10u, sketch.retained());
+  ASSERT_EQ(10, sketch.min());
+  ASSERT_EQ(100, sketch.max());
+  ASSERT_EQ(10, sketch.quantile(0));
+  ASSERT_EQ(50, sketch.quantile(0.5f));
+  ASSERT_EQ(100, sketch.quantile(0.95f));
+  ASSERT_EQ(100, sketch.quantile(1));
+  ASSERT_EQ(5u, sketch.rank(55));
+
+  sketch.reset();
+  ASSERT_EQ(0u, sketch.count());
+}
+
+TEST(QuantileSketchTest, accuracy)
+{
+  std::mt19937 gen(1);
+  std::lognormal_distribution<float> latency(3, 1);
+  std::vector<float> vals;
+  Sketch sketch;
+  uint32_t max_retained = 0;
+
+  for (uint32_t i = 0; i < 1000000; i++) {
+    float val = latency(gen);
+    sketch.push(val);
+    vals.push_back(val);
+    max_retained = std::max(max_retained, sketch.retained());
+  }
+
+  std::sort(vals.begin(), vals.end());
+  checkQuantiles(sketch, vals, 0.02);
+
+  uint32_t capacity = Sketch::CAPACITY;
+  ASSERT_GE(capacity, max_retained);
+  TEST_MSG << "Retained " << sketch.retained() << " of " << sketch.count() << " values";
+}
+
+TEST(QuantileSketchTest, smallK)
+{
+  // A small K on a sorted stream, where a biased compaction would show quickly.
+  QuantileSketch<uint16_t, 32, 12> sketch;
+  std::vector<uint16_t> vals;
+
+  for (uint32_t i = 0; i < 60000; i++) {
+    sketch.push(uint16_t(i));
+    vals.push_back(uint16_t(i));
+  }
+
+  checkQuantiles(sketch, vals, 0.08);
+}
+
+TEST(QuantileSketchTest, levelLimit)
+{
+  // Far more values than the levels hold, so the top level is thinned.
+  QuantileSketch<uint32_t, 16, 4> sketch;
+  std::vector<uint32_t> vals;
+  std::mt19937 gen(2);
+
+  for (uint32_t i = 0; i < 100000; i++) {
+    uint32_t val = gen() % 100000;
+    sketch.push(val);
+    vals.push_back(val);
+  }
+
+  std::sort(vals.begin(), vals.end());
+  checkQuantiles(sketch, vals, 0.15);
+
+  uint32_t capacity = QuantileSketch<uint32_t, 16, 4>::CAPACITY;
+  ASSERT_GE(capacity, sketch.retained());
+}
+
+TEST(QuantileSketchTest, mergeThreads)
+{
+  const uint32_t threads = 4;
+  std::vector<Sketch> sketches(threads);
+  std::vector<std::vector<float>> vals(threads);
+  std::vector<std::thread> workers;
+
+  for (uint32_t t = 0; t < threads; t++) {
+    workers.emplace_back([&sketches, &vals, t]() {
+      // Different ranges per thread, so that a wrong merge shifts the quantiles.
+      std::mt19937 gen(t);
+      std::uniform_real_distribution<float> dist(t * 100.0f, t * 100.0f + 200.0f);
+
+      for (uint32_t i = 0; i < 50000 * (t + 1); i++) {
+        float val = dist(gen);
+        sketches[t].push(val);
+        vals[t].push_back(val);
+      }
+    });
+  }
+
+  for (auto& w : workers) {
+    w.join();
+  }
+
+  Sketch merged;
+  std::vector<float> all;
+
+  for (uint32_t t = 0; t < threads; t++) {
+    merged.merge(sketches[t]);
+    all.insert(all.end(), vals[t].begin(), vals[t].end());
+  }
+
+  std::sort(all.begin(), all.end());
+  checkQuantiles(merged, all, 0.02);
+
+  // Merging into a sketch with values, and an empty one, and itself.
+  Sketch small;
+  small.push(-1);
+  small.merge(merged);
+  small.merge(Sketch());
+  small.merge(small);
+  all.insert(all.begin(), -1);
+  checkQuantiles(small, all, 0.02);
+}
+
+TEST(QuantileSketchTest, serialize)
+{
+  QuantileSketch<int16_t, 64> sketch;
+  QuantileSketch<int16_t, 64> copy;
+  std::mt19937 gen(3);
+
+  for (uint32_t i = 0; i < 20000; i++) {
+    sketch.push(int16_t(gen() % 2000 - 1000));
+  }
+
+  Buff buff(16);
+  ASSERT_EQ(0, sketch.serialize(&buff));
+  ASSERT_EQ(sketch.serializedSize(), buff.available());
+
+  // Values are LSB regardless of the host.
+  ASSERT_EQ(64, buff.read_ptr()[0]);
+  ASSERT_EQ(0, buff.read_ptr()[1]);
+
+  ASSERT_EQ(0, copy.deserialize(&buff));
+  ASSERT_EQ(0u, buff.available());
+  ASSERT_EQ(sketch.count(), copy.count());
+  ASSERT_EQ(sketch.retained(), copy.retained());
+  ASSERT_EQ(sketch.min(), copy.min());
+  ASSERT_EQ(sketch.max(), copy.max());
+
+  for (float q = 0; q <= 1; q += 0.05f) {
+    ASSERT_EQ(sketch.quantile(q), copy.quantile(q)) << q;
+  }
+
+  // The copy keeps working.
+  copy.push(5000);
+  ASSERT_EQ(5000, copy.max());
+
+  // Short data.
+  buff.reset();
+  sketch.serialize(&buff);
+  buff.write_ptr() -= 1;
+  ASSERT_EQ(-1, copy.deserialize(&buff));
+  ASSERT_EQ(ERANGE, errno);
+  ASSERT_EQ(0u, copy.count());
+
+  // Different parameters.
+  buff.reset();
+  sketch.serialize(&buff);
+  QuantileSketch<int16_t, 32> other;
+  ASSERT_EQ(-1, other.deserialize(&buff));
+  ASSERT_EQ(EINVAL, errno);
+
+  // No room.
+  Buff small(4);
+  ASSERT_EQ(-1, sketch.serialize(&small, Buff::NO_MOD));
+  ASSERT_EQ(ENOMEM, errno);
+}
+
+} // namespace btr
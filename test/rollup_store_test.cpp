@@ -0,0 +1,157 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+
+// PROJECT INCLUDES
+#include "utility/common/rollup_store.hpp"
+
+//================================ TEST FIXTURES ===============================
+
+namespace btr
+{
+
+typedef RollupStore<int16_t, 3, 60, double> Store;
+
+/** Widths of 1-second, 1-minute and 1-hour buckets. */
+const uint32_t WIDTHS[] = { 1000, 60000, 3600000 };
+
+/**
+ * Check a query against the samples whose bucket at the used level starts in the range.
+ */
+void checkQuery(const Store& store, const std::vector<std::pair<uint32_t, int16_t>>& samples,
+  uint32_t from_ms, uint32_t to_ms, uint8_t expected_level)
+{
+  Store::Bucket result;
+  uint8_t level = store.query(from_ms, to_ms, &result);
+  ASSERT_EQ(expected_level, level);
+
+  uint32_t count = 0;
+  int16_t min = 0;
+  int16_t max = 0;
+  double sum = 0;
+
+  for (const std::pair<uint32_t, int16_t>& sample : samples) {
+    uint32_t start = sample.first - sample.first % WIDTHS[level];
+
+    if (start >= from_ms && start < to_ms) {
+      min = (0 == count || sample.second < min ? sample.second : min);
+      max = (0 == count || max < sample.second ? sample.second : max);
+      sum += sample.second;
+      ++count;
+    }
+  }
+
+  ASSERT_EQ(from_ms, result.start_);
+  ASSERT_EQ(count, result.count_);
+  ASSERT_EQ(min, result.min_);
+  ASSERT_EQ(max, result.max_);
+  ASSERT_DOUBLE_EQ(sum, result.sum_);
+}
+
+//=================================== TESTS ====================================
+
+TEST(RollupStoreTest, push)
+{
+  Store store(WIDTHS);
+  ASSERT_EQ(60000u, store.width(1));
+  ASSERT_EQ(0u, store.size(0));
+  ASSERT_EQ(nullptr, store.bucket(0, 0));
+
+  store.push(5, 1500);
+  store.push(-3, 1999);
+  store.push(8, 2000);
+
+  ASSERT_EQ(2u, store.size(0));
+  ASSERT_EQ(1u, store.size(1));
+
+  const Store::Bucket* bucket = store.bucket(0, 1);
+  ASSERT_EQ(1000u, bucket->start_);
+  ASSERT_EQ(2u, bucket->count_);
+  ASSERT_EQ(-3, bucket->min_);
+  ASSERT_EQ(5, bucket->max_);
+  ASSERT_DOUBLE_EQ(1, bucket->mean());
+
+  bucket = store.bucket(1, 0);
+  ASSERT_EQ(0u, bucket->start_);
+  ASSERT_EQ(3u, bucket->count_);
+  ASSERT_EQ(nullptr, store.bucket(1, 1));
+
+  // Buckets are opened only for times with values.
+  store.push(1, 9000);
+  ASSERT_EQ(3u, store.size(0));
+  ASSERT_EQ(9000u, store.bucket(0, 0)->start_);
+  ASSERT_EQ(2000u, store.bucket(0, 1)->start_);
+
+  store.reset();
+  ASSERT_EQ(0u, store.size(0));
+  ASSERT_EQ(0u, store.size(2));
+
+  Store::Bucket result;
+  store.query(0, 10000, &result);
+  ASSERT_EQ(0u, result.count_);
+  ASSERT_EQ(0, result.mean());
+}
+
+TEST(RollupStoreTest, query)
+{
+  Store store(WIDTHS);
+  std::vector<std::pair<uint32_t, int16_t>> samples;
+  uint32_t now = 0;
+  srand(1);
+
+  // Three hours at irregular intervals.
+  while (now < 3 * 3600000) {
+    int16_t val = int16_t(rand() % 2000 - 1000);
+    store.push(val, now);
+    samples.emplace_back(now, val);
+    now += 50 + rand() % 500;
+  }
+
+  uint32_t last = samples.back().first;
+  ASSERT_EQ(60u, store.size(0));
+  ASSERT_EQ(60u, store.size(1));
+  ASSERT_EQ(3u, store.size(2));
+
+  // Whole hours come from the hour level.
+  checkQuery(store, samples, 0, 3600000, 2);
+  checkQuery(store, samples, 3600000, 3 * 3600000, 2);
+
+  // So does a range from an hour up to now.
+  checkQuery(store, samples, 2 * 3600000, last + 1, 2);
+
+  // Minutes from the minute level, while it holds them.
+  uint32_t minute = last - last % 60000;
+  checkQuery(store, samples, minute - 10 * 60000, minute, 1);
+  checkQuery(store, samples, minute - 30 * 60000, last + 1, 1);
+
+  // Seconds from the second level.
+  uint32_t second = last - last % 1000;
+  checkQuery(store, samples, second - 20 * 1000, second - 3000, 0);
+  checkQuery(store, samples, second - 20 * 1000 + 500, last + 1, 0);
+
+  // An unaligned start older than the second level holds comes from the minute level.
+  checkQuery(store, samples, second - 120 * 1000, last + 1, 1);
+
+  // Starts older than any level holds come from the coarsest one.
+  Store small(WIDTHS);
+  small.push(1, 0);
+
+  for (uint32_t i = 1; i <= 60; i++) {
+    small.push(2, i * 3600000);
+  }
+
+  Store::Bucket result;
+  ASSERT_EQ(2u, small.query(0, 61 * 3600000, &result));
+  ASSERT_EQ(60u, result.count_);
+  ASSERT_EQ(2, result.min_);
+}
+
+} // namespace btr
@@ -0,0 +1,205 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// PROJECT INCLUDES
+#include "utility/common/test_helpers.hpp"
+#include "utility/x86/sharded_value_tracker.hpp"
+
+namespace btr
+{
+
+//=================================== TESTS ====================================
+
+TEST(ShardedValueTrackerTest, stats)
+{
+  ShardedValueTracker<int32_t, 4, 2> tracker;
+  ShardedValueTracker<int32_t, 4, 2>::Stats stats = tracker.stats();
+  ASSERT_EQ(0u, stats.pushes_);
+  ASSERT_EQ(0u, stats.count_);
+
+  {
+    ShardedValueTracker<int32_t, 4, 2>::Writer first(&tracker);
+    ShardedValueTracker<int32_t, 4, 2>::Writer second(&tracker);
+    ShardedValueTracker<int32_t, 4, 2>::Writer third(&tracker);
+    ASSERT_TRUE(first.ok());
+    ASSERT_TRUE(second.ok());
+    ASSERT_FALSE(third.ok());
+
+    // The first shard keeps the last 4 values.
+    for (int32_t i = 1; i <= 6; i++) {
+      first.push(i);
+    }
+    second.push(10);
+    third.push(-4);
+  }
+
+  stats = tracker.stats();
+  ASSERT_EQ(8u, stats.pushes_);
+  ASSERT_EQ(6u, stats.count_);
+  ASSERT_EQ(-4, stats.min_);
+  ASSERT_EQ(10, stats.max_);
+  ASSERT_EQ(4, stats.mean_);
+  ASSERT_EQ(4, stats.median_);
+
+  // Released shards can be claimed again and keep their values.
+  ShardedValueTracker<int32_t, 4, 2>::Writer writer(&tracker);
+  ASSERT_TRUE(writer.ok());
+  writer.push(7);
+  stats = tracker.stats();
+  ASSERT_EQ(9u, stats.pushes_);
+  ASSERT_EQ(5, stats.median_);
+
+  tracker.reset();
+  stats = tracker.stats();
+  ASSERT_EQ(0u, stats.pushes_);
+  ASSERT_EQ(0u, stats.count_);
+}
+
+TEST(ShardedValueTrackerTest, concurrent)
+{
+  const uint32_t writers = 4;
+  const uint32_t pushes = 200000;
+  typedef ShardedValueTracker<uint64_t, 32, 3> Tracker;
+  Tracker tracker;
+  std::atomic<uint32_t> ready(0);
+  std::atomic<uint32_t> done(0);
+  std::vector<std::thread> threads;
+
+  // One more writer than shards, so the overflow shard is used too.
+  for (uint32_t t = 0; t < writers; t++) {
+    threads.emplace_back([&tracker, &ready, &done] {
+      Tracker::Writer writer(&tracker);
+      ++ready;
+
+      while (ready.load() < writers) {
+        std::this_thread::yield();
+      }
+
+      for (uint64_t i = 1; i <= pushes; i++) {
+        writer.push(i);
+      }
+      ++done;
+    });
+  }
+
+  // Each shard holds consecutive values ending at its number of pushes, so all windows are full
+  // and a torn copy would break the relation between the aggregates.
+  uint32_t checks = 0;
+
+  while (done.load() < writers) {
+    Tracker::Stats stats = tracker.stats();
+
+    if (stats.count_ > 0) {
+      ASSERT_LE(stats.min_, stats.median_);
+      ASSERT_LE(stats.median_, stats.max_);
+      ASSERT_LE(stats.count_, stats.pushes_);
+      ASSERT_LE(stats.max_, pushes);
+    }
+    ++checks;
+  }
+
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  Tracker::Stats stats = tracker.stats();
+  ASSERT_EQ(uint64_t(writers) * pushes, stats.pushes_);
+  ASSERT_EQ(writers * 32, stats.count_);
+  ASSERT_EQ(pushes - 31, stats.min_);
+  ASSERT_EQ(pushes, stats.max_);
+  ASSERT_LT(0u, checks);
+}
+
+TEST(ShardedValueTrackerTest, consistent)
+{
+  // A single writer pushes increasing values, so a consistent copy of its shard holds the values
+  // just below its number of pushes.
+  typedef ShardedValueTracker<uint64_t, 16, 1> Tracker;
+  Tracker tracker;
+  std::atomic<bool> done(false);
+
+  std::thread thread([&tracker, &done] {
+    Tracker::Writer writer(&tracker);
+
+    for (uint64_t i = 1; i <= 500000; i++) {
+      writer.push(i);
+    }
+    done = true;
+  });
+
+  while (!done.load()) {
+    Tracker::Stats stats = tracker.stats();
+
+    if (stats.count_ > 0) {
+      ASSERT_EQ(stats.pushes_, stats.max_);
+      ASSERT_EQ(stats.max_ - stats.min_ + 1, stats.count_);
+      ASSERT_EQ((stats.min_ + stats.max_) / 2, stats.mean_);
+    }
+  }
+
+  thread.join();
+}
+
+TEST(ShardedValueTrackerTest, progress)
+{
+  // Writers push back to back for as long as stats() is called, so nearly every optimistic copy
+  // overlaps a push. Each call must still return, with consistent shards.
+  typedef ShardedValueTracker<uint64_t, 64, 2> Tracker;
+  Tracker tracker;
+  std::atomic<bool> stop(false);
+  std::atomic<uint64_t> pushed[2];
+  std::vector<std::thread> threads;
+
+  for (uint32_t t = 0; t < 2; t++) {
+    pushed[t] = 0;
+    threads.emplace_back([&tracker, &stop, &pushed, t] {
+      Tracker::Writer writer(&tracker);
+
+      for (uint64_t i = 1; !stop.load(std::memory_order_relaxed); i++) {
+        writer.push(i);
+        pushed[t].store(i, std::memory_order_relaxed);
+      }
+    });
+  }
+
+  while (0 == pushed[0].load() || 0 == pushed[1].load()) {
+    std::this_thread::yield();
+  }
+
+  uint64_t before = pushed[0].load() + pushed[1].load();
+  auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(300);
+  uint32_t calls = 0;
+
+  while (std::chrono::steady_clock::now() < end) {
+    Tracker::Stats stats = tracker.stats();
+    ASSERT_LE(stats.min_, stats.median_);
+    ASSERT_LE(stats.median_, stats.max_);
+    ASSERT_LE(stats.count_, stats.pushes_);
+    ++calls;
+  }
+
+  uint64_t after = pushed[0].load() + pushed[1].load();
+  stop = true;
+
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  TEST_MSG << calls << " stats() calls, " << (after - before) << " pushes meanwhile";
+  ASSERT_LT(1000u, calls);
+  ASSERT_LT(before, after);
+}
+
+} // namespace btr
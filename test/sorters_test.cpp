@@ -6,6 +6,9 @@
 
 // SYSTEM INCLUDES
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
 
 // PROJECT INCLUDES
 #include "utility/common/sorters.hpp"
@@ -43,4 +46,34 @@ TEST(SortersTest, testInsertionSort)
   ASSERT_TRUE(ArraysMatch(data_even_sorted, data_even));
 }
 
+TEST(SortersTest, testHeapSort)
+{
+  const uint16_t data_odd_sorted[] = { 2, 4, 5, 7, 16 };
+  uint16_t data_odd[] = { 7, 5, 2, 16, 4 };
+  Sorters::heapSort(data_odd, sizeof(data_odd_sorted) / sizeof(uint16_t));
+  ASSERT_TRUE(ArraysMatch(data_odd_sorted, data_odd));
+
+  const uint16_t data_even_sorted[] = { 2, 4, 5, 5, 7, 16 };
+  uint16_t data_even[] = { 7, 5, 2, 16, 4, 5 };
+  Sorters::heapSort(data_even, sizeof(data_even_sorted) / sizeof(uint16_t));
+  ASSERT_TRUE(ArraysMatch(data_even_sorted, data_even));
+
+  uint16_t single[] = { 3 };
+  Sorters::heapSort(single, 1);
+  Sorters::heapSort(single, 0);
+  ASSERT_EQ(3, single[0]);
+
+  srand(5);
+  std::vector<int32_t> data(1001);
+
+  for (auto& v : data) {
+    v = rand() % 200 - 100;
+  }
+
+  std::vector<int32_t> expected(data);
+  std::sort(expected.begin(), expected.end());
+  Sorters::heapSort(data.data(), data.size());
+  ASSERT_EQ(expected, data);
+}
+
 } // namespace btr
@@ -0,0 +1,214 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <deque>
+#include <cmath>
+#include <cstdlib>
+
+// PROJECT INCLUDES
+#include "utility/common/stat_trackers.hpp"
+
+//================================ TEST FIXTURES ===============================
+
+namespace btr
+{
+
+/**
+ * @return sample variance of the values
+ */
+double variance(const std::deque<double>& vals)
+{
+  double mean = 0;
+
+  for (double v : vals) {
+    mean += v;
+  }
+  mean /= vals.size();
+
+  double m2 = 0;
+
+  for (double v : vals) {
+    m2 += (v - mean) * (v - mean);
+  }
+  return (vals.size() > 1 ? m2 / (vals.size() - 1) : 0);
+}
+
+//=================================== TESTS ====================================
+
+TEST(StatTrackersTest, variance)
+{
+  VarianceTracker<int32_t, 50, double> tracker;
+  std::deque<double> window;
+  srand(3);
+
+  ASSERT_EQ(0u, tracker.count());
+  ASSERT_EQ(0, tracker.variance());
+
+  for (int i = 0; i < 1000; i++) {
+    // Large offset with small noise, where the naive sum of squares loses precision.
+    int32_t val = 1000000 + rand() % 100;
+    tracker.push(val);
+    window.push_back(val);
+
+    if (window.size() > 50) {
+      window.pop_front();
+    }
+
+    ASSERT_EQ(window.size(), tracker.count());
+    ASSERT_NEAR(variance(window), tracker.variance(), 1e-6) << "Push: " << i;
+    ASSERT_NEAR(std::sqrt(variance(window)), tracker.stddev(), 1e-6);
+  }
+
+  tracker.reset();
+  tracker.push(5);
+  ASSERT_EQ(5, tracker.mean());
+  ASSERT_EQ(0, tracker.variance());
+
+  // Equal values may leave a tiny negative sum of squares.
+  VarianceTracker<float, 3> flat;
+
+  for (int i = 0; i < 10; i++) {
+    flat.push(0.1f);
+    ASSERT_LE(0, flat.variance());
+  }
+}
+
+TEST(StatTrackersTest, ema)
+{
+  EmaTracker<double> tracker(EmaTracker<double>::alphaForPeriod(3));
+  ASSERT_DOUBLE_EQ(0.5, tracker.alpha());
+  ASSERT_FALSE(tracker.ready());
+
+  tracker.push(10);
+  ASSERT_TRUE(tracker.ready());
+  ASSERT_DOUBLE_EQ(10, tracker.mean());
+  ASSERT_DOUBLE_EQ(0, tracker.variance());
+
+  tracker.push(20);
+  ASSERT_DOUBLE_EQ(15, tracker.mean());
+  ASSERT_DOUBLE_EQ(25, tracker.variance());
+  ASSERT_DOUBLE_EQ(5, tracker.stddev());
+
+  // A constant signal converges to its value with no variance.
+  for (int i = 0; i < 200; i++) {
+    tracker.push(7);
+  }
+  ASSERT_NEAR(7, tracker.mean(), 1e-9);
+  ASSERT_NEAR(0, tracker.variance(), 1e-9);
+
+  tracker.reset();
+  ASSERT_FALSE(tracker.ready());
+  tracker.push(-1);
+  ASSERT_DOUBLE_EQ(-1, tracker.mean());
+}
+
+TEST(StatTrackersTest, minMax)
+{
+  MinMaxTracker<int16_t, 7> tracker;
+  MinMaxTracker<int16_t, 8> tracker8;
+  std::deque<int16_t> window;
+  std::deque<int16_t> window8;
+  srand(4);
+
+  for (int i = 0; i < 2000; i++) {
+    // Narrow range, so equal values and long monotonic runs occur.
+    int16_t val = (i % 100 < 30 ? int16_t(i % 100) : int16_t(rand() % 20 - 10));
+    tracker.push(val);
+    tracker8.push(val);
+    window.push_back(val);
+    window8.push_back(val);
+
+    if (window.size() > 7) {
+      window.pop_front();
+    }
+    if (window8.size() > 8) {
+      window8.pop_front();
+    }
+
+    ASSERT_EQ(window.size(), tracker.count());
+    ASSERT_EQ(*std::min_element(window.begin(), window.end()), tracker.min()) << i;
+    ASSERT_EQ(*std::max_element(window.begin(), window.end()), tracker.max()) << i;
+
+    // A power of two window wraps its positions with a mask.
+    ASSERT_EQ(window8.size(), tracker8.count());
+    ASSERT_EQ(*std::min_element(window8.begin(), window8.end()), tracker8.min()) << i;
+    ASSERT_EQ(*std::max_element(window8.begin(), window8.end()), tracker8.max()) << i;
+  }
+
+  tracker.reset();
+  ASSERT_EQ(0u, tracker.count());
+  tracker.push(42);
+  ASSERT_EQ(42, tracker.min());
+  ASSERT_EQ(42, tracker.max());
+}
+
+TEST(StatTrackersTest, timeWindow)
+{
+  TimeWindowTracker<int32_t, 12, double> tracker(500);
+  std::deque<std::pair<uint32_t, int32_t>> window;
+  srand(5);
+
+  ASSERT_EQ(500u, tracker.window());
+  ASSERT_EQ(0u, tracker.count());
+  ASSERT_EQ(0, tracker.mean());
+  ASSERT_EQ(0, tracker.rate());
+
+  // Start close to the wrap-around of the millisecond counter.
+  uint32_t now = 0xFFFFF000;
+
+  for (int i = 0; i < 5000; i++) {
+    // Irregular sampling: bursts of close values and long gaps.
+    now += (i % 50 < 40 ? rand() % 20 : rand() % 400);
+    int32_t val = rand() % 1000 - 500;
+    tracker.push(val, now);
+    window.emplace_back(now, val);
+
+    while (now - window.front().first >= 500 || window.size() > 12) {
+      window.pop_front();
+    }
+
+    ASSERT_EQ(window.size(), tracker.count()) << i;
+
+    double sum = 0;
+    int32_t min = window.front().second;
+    int32_t max = min;
+
+    for (const std::pair<uint32_t, int32_t>& sample : window) {
+      sum += sample.second;
+      min = std::min(min, sample.second);
+      max = std::max(max, sample.second);
+    }
+
+    ASSERT_NEAR(sum / window.size(), tracker.mean(), 1e-9) << i;
+    ASSERT_EQ(min, tracker.min()) << i;
+    ASSERT_EQ(max, tracker.max()) << i;
+    ASSERT_EQ(val, tracker.last());
+  }
+
+  // Queries cover the window as of the last expiry.
+  tracker.expire(now + 499);
+  ASSERT_EQ(1u, tracker.count());
+  tracker.expire(now + 500);
+  ASSERT_EQ(0u, tracker.count());
+
+  // Rate and slope use the span between the oldest and the newest value.
+  tracker.reset();
+  tracker.push(10, 1000);
+  ASSERT_EQ(0, tracker.rate());
+  tracker.push(10, 1000);
+  ASSERT_EQ(0, tracker.slope());
+  tracker.push(30, 1100);
+  tracker.push(60, 1200);
+  ASSERT_EQ(4u, tracker.count());
+  ASSERT_DOUBLE_EQ(15, tracker.rate());
+  ASSERT_DOUBLE_EQ(250, tracker.slope());
+  ASSERT_DOUBLE_EQ(27.5, tracker.mean());
+}
+
+} // namespace btr
@@ -0,0 +1,159 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+#include <chrono>
+
+// PROJECT INCLUDES
+#include "utility/common/value_codec.hpp"
+#include "utility/common/test_helpers.hpp"
+
+namespace btr
+{
+
+//================================ TEST FIXTURES ===============================
+
+/**
+ * Byte-by-byte swap that ValueCodec used before switching to compiler intrinsics. Kept here as
+ * a baseline for the measurements.
+ */
+template<typename T>
+static void loopSwap(T* val)
+{
+  uint8_t* bytes = reinterpret_cast<uint8_t*>(val);
+  int j = sizeof(T) - 1;
+
+  for (int i = 0; i < j; i++, j--) {
+    uint8_t tmp = bytes[i];
+    bytes[i] = bytes[j];
+    bytes[j] = tmp;
+  }
+}
+
+/**
+ * Byte-by-byte MSB decode that ValueCodec used for full-width integers. Kept as a baseline.
+ */
+template<typename T>
+static void loopDecodeMsb(const uint8_t* buff, T* val)
+{
+  *val = 0;
+
+  for (uint32_t i = 0; i < sizeof(T); i++) {
+    *val = ((*val << 8) | buff[i]);
+  }
+}
+
+/**
+ * Run func a number of times and report nanoseconds per call.
+ *
+ * @param name - measurement label
+ * @param calls - the number of calls to time
+ * @param func - callable taking the loop index
+ */
+template<typename F>
+static void measure(const char* name, uint32_t calls, F func)
+{
+  auto start = std::chrono::steady_clock::now();
+
+  for (uint32_t i = 0; i < calls; i++) {
+    func(i);
+  }
+
+  auto end = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(end - start).count();
+  TEST_MSG << name << ": " << (ns / calls) << " ns/call";
+}
+
+/**
+ * Compare the byte loop swap with the intrinsic-based ones.
+ */
+static void compareSwap(uint32_t calls)
+{
+  volatile uint32_t sink = 0;
+
+  measure("loop swap<uint32_t>", calls, [&](uint32_t i) {
+    uint32_t v = i;
+    loopSwap(&v);
+    sink = v;
+  });
+  measure("swap<uint32_t>(msb)", calls, [&](uint32_t i) {
+    uint32_t v = i;
+    ValueCodec::swap(&v, (i & 1) != 0);
+    sink = v;
+  });
+  measure("swap<true, uint32_t>", calls, [&](uint32_t i) {
+    uint32_t v = i;
+    ValueCodec::swap<true>(&v);
+    sink = v;
+  });
+  (void)sink;
+}
+
+/**
+ * Compare the byte loop decode with the fixed-width encode/decode.
+ */
+static void compareFixedInt(uint32_t calls)
+{
+  uint8_t raw[sizeof(uint64_t) * 8] = { 0 };
+  volatile uint64_t sink = 0;
+
+  for (uint32_t i = 0; i < sizeof(raw); i++) {
+    raw[i] = uint8_t(i);
+  }
+
+  measure("encodeFixedInt<uint64_t>(msb)", calls, [&](uint32_t i) {
+    ValueCodec::encodeFixedInt(raw + (i & 7) * sizeof(uint64_t), uint64_t(i), true);
+  });
+  measure("encodeFixedInt<true, uint64_t>", calls, [&](uint32_t i) {
+    ValueCodec::encodeFixedInt<true>(raw + (i & 7) * sizeof(uint64_t), uint64_t(i));
+  });
+  measure("loop decode<uint64_t>", calls, [&](uint32_t i) {
+    uint64_t v;
+    loopDecodeMsb(raw + (i & 7) * sizeof(v), &v);
+    sink = v;
+  });
+  measure("decodeFixedInt<uint64_t>(bytes, msb)", calls, [&](uint32_t i) {
+    uint64_t v;
+    ValueCodec::decodeFixedInt(raw + (i & 7) * sizeof(v), &v, sizeof(v), true);
+    sink = v;
+  });
+  measure("decodeFixedInt<true, uint64_t>", calls, [&](uint32_t i) {
+    uint64_t v;
+    ValueCodec::decodeFixedInt<true>(raw + (i & 7) * sizeof(v), &v);
+    sink = v;
+  });
+
+  ValueCodec::encodeFixedInt<true>(raw, uint64_t(0x0102030405060708));
+  uint64_t v = 0;
+  ValueCodec::decodeFixedInt<true>(raw, &v);
+  ASSERT_EQ(uint64_t(0x0102030405060708), v);
+  (void)sink;
+}
+
+//=================================== TESTS ====================================
+
+TEST(ValueCodecBench, swap10K)
+{
+  compareSwap(10000);
+}
+
+TEST(ValueCodecBench, DISABLED_swap10M)
+{
+  compareSwap(10000000);
+}
+
+TEST(ValueCodecBench, encodeDecodeFixedInt10K)
+{
+  compareFixedInt(10000);
+}
+
+TEST(ValueCodecBench, DISABLED_encodeDecodeFixedInt10M)
+{
+  compareFixedInt(10000000);
+}
+
+} // namespace btr
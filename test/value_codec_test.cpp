@@ -153,6 +153,46 @@ TEST_F(ValueCodecTest, swap)
   }
 }
 
+TEST_F(ValueCodecTest, swapWidths)
+{
+  uint16_t v16 = 0x0102;
+  ValueCodec::swap(&v16);
+  ASSERT_EQ(uint16_t(0x0201), v16);
+
+  uint32_t v32 = 0x01020304;
+  ValueCodec::swap(&v32);
+  ASSERT_EQ(uint32_t(0x04030201), v32);
+
+  int64_t v64 = 0x0102030405060708;
+  ValueCodec::swap(&v64);
+  ASSERT_EQ(int64_t(0x0807060504030201), v64);
+
+  uint8_t v8 = 0x12;
+  ValueCodec::swap(&v8);
+  ASSERT_EQ(uint8_t(0x12), v8);
+
+  // Swapping a floating-point number twice restores the original bits.
+  const double pi = Misc::PI;
+  double d = pi;
+  ValueCodec::swap(&d);
+  ValueCodec::swap(&d);
+  ASSERT_EQ(pi, d);
+}
+
+TEST_F(ValueCodecTest, swapMsbTemplate)
+{
+  uint32_t runtime = 0x01020304;
+  uint32_t compiled = runtime;
+
+  ValueCodec::swap(&runtime, true);
+  ValueCodec::swap<true>(&compiled);
+  ASSERT_EQ(runtime, compiled);
+
+  ValueCodec::swap(&runtime, false);
+  ValueCodec::swap<false>(&compiled);
+  ASSERT_EQ(runtime, compiled);
+}
+
 TEST_F(ValueCodecTest, varIntNBits)
 {
   // Bits are all 1s
@@ -371,6 +411,44 @@ TEST_F(ValueCodecTest, encodeFixedIntNegative)
   ASSERT_EQ(num, val);
 }
 
+TEST_F(ValueCodecTest, encodeFixedIntTemplate)
+{
+  const int32_t num = -0x01020304;
+  int32_t val = 0;
+  uint8_t* buffc = buff_.data();
+
+  ValueCodec::encodeFixedInt<true>(buffc, num);
+  ASSERT_EQ(uint8_t(0xFE), buffc[0]);
+  ASSERT_EQ(uint8_t(0xFC), buffc[3]);
+  ValueCodec::decodeFixedInt<true>(buffc, &val);
+  ASSERT_EQ(num, val);
+
+  ValueCodec::decodeFixedInt(buffc, &val, sizeof(val), true);
+  ASSERT_EQ(num, val);
+
+  ValueCodec::encodeFixedInt<false>(buffc, num);
+  ASSERT_EQ(uint8_t(0xFC), buffc[0]);
+  ASSERT_EQ(uint8_t(0xFE), buffc[3]);
+  ValueCodec::decodeFixedInt<false>(buffc, &val);
+  ASSERT_EQ(num, val);
+
+  ValueCodec::encodeFixedInt<true>(&buff_, uint16_t(0x0402));
+  ValueCodec::encodeFixedInt<false>(&buff_, uint16_t(0x0402));
+
+  uint16_t val16 = 0;
+  int rc = ValueCodec::decodeFixedInt<true>(&buff_, &val16);
+  ASSERT_EQ(0, rc);
+  ASSERT_EQ(uint16_t(0x0402), val16);
+  rc = ValueCodec::decodeFixedInt<false>(&buff_, &val16);
+  ASSERT_EQ(0, rc);
+  ASSERT_EQ(uint16_t(0x0402), val16);
+  ASSERT_EQ(uint32_t(0), buff_.available());
+
+  rc = ValueCodec::decodeFixedInt<true>(&buff_, &val16);
+  ASSERT_EQ(-1, rc);
+  ASSERT_EQ(ERANGE, errno);
+}
+
 TEST_F(ValueCodecTest, encodeFloatToInt)
 {
   double v = Misc::PI;
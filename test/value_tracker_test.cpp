@@ -6,17 +6,49 @@
 
 // SYSTEM INCLUDES
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdlib>
 
 // PROJECT INCLUDES
 #include "utility/common/value_tracker.hpp"
 
 //================================ TEST FIXTURES ===============================
 
-//=================================== TESTS ====================================
-
 namespace btr
 {
 
+/**
+ * Push random values and compare mean and median with the ones computed from scratch.
+ */
+template<typename T, uint32_t S>
+void checkStats(uint32_t pushes, int range)
+{
+  ValueTracker<T, S> tracker;
+  T window[S] = { 0 };
+
+  for (uint32_t n = 0; n < pushes; n++) {
+    T val = T(rand() % range);
+    tracker.push(val);
+    window[n % S] = val;
+
+    T arr[S];
+    double sum = 0;
+
+    for (uint32_t i = 0; i < S; i++) {
+      arr[i] = window[i];
+      sum += arr[i];
+    }
+
+    std::sort(arr, arr + S);
+    T median = ((S % 2) != 0 ? arr[S / 2] : T((arr[S / 2] + arr[(S / 2) - 1]) / 2));
+
+    ASSERT_EQ(T(sum / S), tracker.mean()) << "Push: " << n;
+    ASSERT_EQ(median, tracker.median()) << "Push: " << n;
+  }
+}
+
+//=================================== TESTS ====================================
+
 TEST(ValueTrackerTest, testValue)
 {
   ValueTracker<double, 3> tracker(3);
@@ -140,4 +172,94 @@ TEST(ValueTrackerTest, testMean)
   ASSERT_EQ(6, v);
 }
 
+TEST(ValueTrackerTest, testIncrementalStats)
+{
+  srand(5);
+  checkStats<uint16_t, 1>(100, 1000);
+  checkStats<uint16_t, 6>(1000, 10);
+  checkStats<int32_t, 7>(1000, 100000);
+  checkStats<uint8_t, 16>(1000, 256);
+  checkStats<double, 64>(1000, 50);
+
+  ValueTracker<int32_t, 4> tracker;
+  tracker.push(3);
+  tracker.reset(9);
+  ASSERT_EQ(9, tracker.mean());
+  ASSERT_EQ(9, tracker.median());
+  tracker.push(1);
+  ASSERT_EQ(7, tracker.mean());
+  ASSERT_EQ(9, tracker.median());
+}
+
+TEST(ValueTrackerTest, testLargeWindow)
+{
+  // Positions must stay correct long after a narrow position counter would wrap.
+  ValueTracker<int32_t, 1000> tracker;
+  ValueTracker<int32_t, 4096, true> heap_tracker;
+  ASSERT_EQ(1000u, tracker.count());
+  ASSERT_EQ(4096u, heap_tracker.count());
+
+  for (int32_t i = 1; i <= 100000; i++) {
+    tracker.push(i);
+    heap_tracker.push(-i);
+  }
+
+  for (uint32_t pos = 0; pos < 1000; pos += 7) {
+    ASSERT_EQ(int32_t(99001 + pos), tracker.value(pos));
+  }
+  ASSERT_EQ(100000, tracker.last());
+  ASSERT_EQ(1, tracker.delta());
+  ASSERT_EQ(99500, tracker.median());
+  ASSERT_EQ(99500, tracker.mean());
+
+  ASSERT_EQ(-(100000 - 4095), heap_tracker.value(0));
+  ASSERT_EQ(-100000, heap_tracker.last());
+  ASSERT_EQ(-1, heap_tracker.delta());
+  ASSERT_EQ(-(100000 - 2048), heap_tracker.median());
+
+  heap_tracker.reset(3);
+  ASSERT_EQ(3, heap_tracker.mean());
+  ASSERT_EQ(3, heap_tracker.value(4095));
+}
+
+TEST(ValueTrackerTest, testSumWidth)
+{
+  // The sum of the window doesn't fit the value type.
+  ValueTracker<int16_t, 4096> tracker;
+  ValueTracker<uint8_t, 300> small_tracker;
+
+  for (int32_t i = 0; i < 5000; i++) {
+    tracker.push(int16_t(30000 - (i % 2)));
+    small_tracker.push(uint8_t(250));
+  }
+  ASSERT_EQ(29999, tracker.mean());
+  ASSERT_EQ(250, small_tracker.mean());
+
+  tracker.reset(-32000);
+  ASSERT_EQ(-32000, tracker.mean());
+
+  // An explicit sum type.
+  ValueTracker<int32_t, 4, false, int32_t> narrow_tracker;
+  narrow_tracker.push(8);
+  ASSERT_EQ(2, narrow_tracker.mean());
+}
+
+TEST(ValueTrackerTest, testHeapAllocationFailure)
+{
+  // No system can allocate 64 GB on the heap for this test.
+  ValueTracker<uint64_t, 0xFFFFFFFF, true> tracker;
+
+  if (0 != tracker.count()) {
+    GTEST_SKIP() << "The allocation succeeded";
+  }
+
+  tracker.push(1);
+  tracker.reset(2);
+  ASSERT_EQ(0u, tracker.last());
+  ASSERT_EQ(0u, tracker.value(0));
+  ASSERT_EQ(0u, tracker.delta());
+  ASSERT_EQ(0u, tracker.median());
+  ASSERT_EQ(0u, tracker.mean());
+}
+
 } // namespace btr
@@ -0,0 +1,354 @@
+// Copyright (C) 2018 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <vector>
+
+// PROJECT INCLUDES
+#include "utility/common/wavl_tree.hpp"
+#include "utility/common/avl_tree_aggregate.hpp"
+
+namespace btr
+{
+
+//================================ TEST FIXTURES ===============================
+
+/** Plain node that records traversed keys. */
+class WavlNode : public NodeBase<WavlNode>, public NodeObserver<WavlNode>
+{
+public:
+
+  WavlNode(uint16_t key) :
+    NodeBase(key)
+  {}
+
+  std::vector<uint16_t> keys_;
+
+protected:
+
+  virtual int onTraverseImpl(WavlNode* node)
+  {
+    keys_.push_back(node->key());
+    return 0;
+  }
+};
+
+/** Node summing its keys, to check that rotations refresh augmented data. */
+class WavlSumNode : public AggregateNodeBase<WavlSumNode, uint16_t, int32_t, SumAggregate>
+{
+public:
+
+  WavlSumNode(uint16_t key) :
+    AggregateNodeBase(key, key)
+  {}
+};
+
+/**
+ * Verify binary-search-tree order and the WAVL rank rule of a subtree: rank differences of 1 or
+ * 2, and leaves of rank 1.
+ *
+ * @param node - subtree root
+ * @param count - incremented by the number of nodes in the subtree
+ * @param height - set to the subtree height
+ * @return false if the subtree is invalid
+ */
+template<typename N>
+bool checkWavl(N* node, uint32_t* count, int* height)
+{
+  *height = 0;
+
+  if (nullptr == node) {
+    return true;
+  }
+  if ((nullptr != node->left() && node->left()->key() >= node->key())
+      || (nullptr != node->right() && node->right()->key() <= node->key())) {
+    return false;
+  }
+
+  int lh = 0;
+  int rh = 0;
+
+  if (!checkWavl(node->left(), count, &lh) || !checkWavl(node->right(), count, &rh)) {
+    return false;
+  }
+
+  int rank = node->height();
+  int ld = rank - (nullptr == node->left() ? 0 : node->left()->height());
+  int rd = rank - (nullptr == node->right() ? 0 : node->right()->height());
+
+  if (ld < 1 || ld > 2 || rd < 1 || rd > 2) {
+    return false;
+  }
+  if (nullptr == node->left() && nullptr == node->right() && 1 != rank) {
+    return false;
+  }
+
+  *height = (lh > rh ? lh : rh) + 1;
+  ++(*count);
+  return true;
+}
+
+/**
+ * Verify sizes and sums of all nodes in a subtree.
+ */
+bool checkSums(WavlSumNode* node)
+{
+  if (nullptr == node) {
+    return true;
+  }
+
+  uint32_t size = 1;
+  int32_t sum = node->value();
+
+  if (nullptr != node->left()) {
+    size += node->left()->size();
+    sum += node->left()->aggregate();
+  }
+  if (nullptr != node->right()) {
+    size += node->right()->size();
+    sum += node->right()->aggregate();
+  }
+  return (size == node->size() && sum == node->aggregate()
+      && checkSums(node->left()) && checkSums(node->right()));
+}
+
+//=================================== TESTS ====================================
+
+TEST(WavlTreeTest, insertErase)
+{
+  WavlTree<WavlNode> tree;
+  uint16_t keys[] = { 1, 9, 3, 7 };
+
+  for (auto key : keys) {
+    tree.insert(key);
+  }
+
+  // Without erases the tree is an AVL tree.
+  ASSERT_EQ(3, tree.root()->key());
+  ASSERT_EQ(3, WavlTree<WavlNode>::height(tree.root()));
+
+  WavlNode* successor = tree.search(7);
+  successor->keys_.push_back(91);
+
+  // The successor is relinked in place of the erased root and keeps its data.
+  ASSERT_TRUE(successor == tree.erase(3));
+  ASSERT_TRUE(nullptr == tree.search(3));
+  ASSERT_EQ(1u, successor->keys_.size());
+
+  // Erasing a missing key changes nothing.
+  ASSERT_TRUE(successor == tree.erase(3));
+
+  tree.erase(9);
+  tree.erase(1);
+  ASSERT_TRUE(successor == tree.root());
+  ASSERT_EQ(1, successor->height());
+
+  tree.erase(7);
+  ASSERT_TRUE(nullptr == tree.root());
+}
+
+TEST(WavlTreeTest, ranks)
+{
+  WavlTree<WavlNode> tree;
+  uint32_t count = 0;
+  int height = 0;
+
+  // Erasing the leaves of a complete tree demotes their parents only. The grandparents keep
+  // their ranks with two children two ranks lower, where AvlTree would lower their heights.
+  for (uint16_t key = 1; key <= 15; key++) {
+    tree.insert(key);
+  }
+  for (uint16_t key = 1; key <= 15; key += 2) {
+    tree.erase(key);
+  }
+
+  ASSERT_TRUE(checkWavl(tree.root(), &count, &height));
+  ASSERT_EQ(7u, count);
+  ASSERT_EQ(3, height);
+  ASSERT_EQ(8, tree.root()->key());
+  ASSERT_EQ(4, tree.root()->height());
+  ASSERT_EQ(3, tree.search(4)->height());
+  ASSERT_EQ(1, tree.search(2)->height());
+  ASSERT_EQ(1, tree.search(6)->height());
+}
+
+TEST(WavlTreeTest, churn)
+{
+  WavlTree<WavlNode, uint16_t, int16_t, PoolNodeAllocator<WavlNode>> tree;
+  std::map<uint16_t, WavlNode*> nodes;
+  srand(7);
+
+  for (uint32_t i = 0; i < 30000; i++) {
+    uint16_t key = rand() % 2000;
+
+    if (rand() % 2 == 0) {
+      tree.erase(key);
+      nodes.erase(key);
+    } else if (nullptr == tree.search(key)) {
+      tree.insert(key);
+      nodes[key] = tree.search(key);
+    }
+
+    if (i % 500 == 0) {
+      uint32_t count = 0;
+      int height = 0;
+      ASSERT_TRUE(checkWavl(tree.root(), &count, &height)) << "Step: " << i;
+      ASSERT_EQ(nodes.size(), count);
+      ASSERT_GE(2 * std::log2(count + 1), height);
+
+      // Erasing keys must not move other nodes.
+      for (auto& entry : nodes) {
+        ASSERT_TRUE(entry.second == tree.search(entry.first)) << entry.first;
+      }
+    }
+  }
+  ASSERT_EQ(nodes.size(), tree.allocator().count());
+
+  // Drain the tree in an order different from insertion.
+  for (auto it = nodes.rbegin(); it != nodes.rend(); ++it) {
+    tree.erase(it->first);
+  }
+  ASSERT_TRUE(nullptr == tree.root());
+  ASSERT_EQ(0u, tree.allocator().count());
+}
+
+TEST(WavlTreeTest, augmented)
+{
+  WavlTree<WavlSumNode> tree;
+  std::set<uint16_t> expected;
+  srand(11);
+
+  for (uint32_t i = 0; i < 5000; i++) {
+    uint16_t key = rand() % 300;
+
+    if (rand() % 3 == 0) {
+      tree.erase(key);
+      expected.erase(key);
+    } else {
+      tree.insert(key);
+      expected.insert(key);
+    }
+    ASSERT_TRUE(checkSums(tree.root())) << "Step: " << i;
+  }
+
+  int32_t sum = 0;
+
+  for (auto key : expected) {
+    sum += key;
+  }
+  ASSERT_EQ(expected.size(), tree.root()->size());
+  ASSERT_EQ(sum, tree.root()->aggregate());
+}
+
+TEST(WavlTreeTest, iterate)
+{
+  WavlTree<WavlNode> tree;
+  std::set<uint16_t> expected;
+  srand(13);
+
+  for (uint32_t i = 0; i < 2000; i++) {
+    uint16_t key = rand() % 500 * 2;
+
+    if (rand() % 3 == 0) {
+      tree.erase(key);
+      expected.erase(key);
+    } else {
+      tree.insert(key);
+      expected.insert(key);
+    }
+  }
+
+  auto exp = expected.begin();
+
+  for (auto it = tree.begin(); it != tree.end(); ++it, ++exp) {
+    ASSERT_EQ(*exp, it->key());
+  }
+  ASSERT_TRUE(exp == expected.end());
+
+  // Backwards from the end.
+  auto rexp = expected.rbegin();
+  auto it = tree.end();
+
+  while (it != tree.begin()) {
+    --it;
+    ASSERT_EQ(*rexp++, it->key());
+  }
+
+  // Odd keys are absent, so both bounds land on the next even key.
+  for (uint16_t key = 1; key < 1000; key += 2) {
+    auto lower = expected.lower_bound(key);
+    WavlTree<WavlNode>::Iterator found = tree.lowerBound(key);
+    ASSERT_TRUE(tree.upperBound(key) == found);
+
+    if (lower == expected.end()) {
+      ASSERT_TRUE(tree.end() == found);
+    } else {
+      ASSERT_EQ(*lower, found->key());
+    }
+  }
+
+  WavlTree<WavlNode>::Iterator first;
+  WavlTree<WavlNode>::Iterator last;
+  uint16_t key = *expected.begin();
+  tree.equalRange(key, &first, &last);
+  ASSERT_EQ(key, first->key());
+  ASSERT_TRUE(++first == last);
+}
+
+TEST(WavlTreeTest, traverse)
+{
+  WavlTree<WavlNode> tree;
+  WavlNode observer(0);
+
+  for (uint16_t key : { 5, 1, 9, 3, 7 }) {
+    tree.insert(key);
+  }
+
+  ASSERT_EQ(0, tree.traverse(tree.root(), &observer));
+  ASSERT_EQ((std::vector<uint16_t>{ 1, 3, 5, 7, 9 }), observer.keys_);
+
+  observer.keys_.clear();
+  ASSERT_EQ(0, tree.traverse(tree.root(), &observer, 2, 7));
+  ASSERT_EQ((std::vector<uint16_t>{ 3, 5, 7 }), observer.keys_);
+
+  std::vector<uint16_t> keys;
+  ASSERT_EQ(-1, tree.visit(tree.root(), [&keys](WavlNode* n) {
+      keys.push_back(n->key());
+      return (keys.size() < 2 ? 0 : -1);
+  }));
+  ASSERT_EQ((std::vector<uint16_t>{ 1, 3 }), keys);
+
+  ASSERT_EQ(1, tree.searchMin(tree.root())->key());
+}
+
+TEST(WavlTreeTest, allocatorExhausted)
+{
+  WavlTree<WavlNode, uint16_t, int16_t, StaticNodeAllocator<WavlNode, 8>> tree;
+
+  for (uint16_t key = 0; key < 10; key++) {
+    tree.insert(key);
+  }
+
+  uint32_t count = 0;
+  int height = 0;
+  ASSERT_TRUE(checkWavl(tree.root(), &count, &height));
+  ASSERT_EQ(8u, count);
+  ASSERT_TRUE(nullptr == tree.search(8));
+
+  // Erasing frees a slot.
+  tree.erase(0);
+  tree.insert(9);
+  ASSERT_TRUE(nullptr != tree.search(9));
+}
+
+} // namespace btr